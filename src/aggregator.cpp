@@ -0,0 +1,928 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "aggregator.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using aggregator::Status;
+
+namespace {
+
+const uint8_t kTypeAck = 2;
+const uint8_t kTypeRecord = 3;
+const uint8_t kTypeHello = 4;
+const uint8_t kProtocolVersion = 1;
+const uint8_t kFlagBacklog = 1;
+const size_t kHeaderBytes = 8;
+const size_t kRecordFields = 5; // Number, text, modem path, SMS path, timestamp
+const size_t kMaxFrameBytes = 65536;
+const size_t kMaxPendingAckBytes = 65536; // Beyond this a node is not read until it drains its acks
+const size_t kMaxOutputBytes = 65536;     // Records written to the aggregator at once
+const size_t kMaxClients = 256;
+const size_t kSpoolCompactBytes = 65536; // Acked records left in the spool before it is rewritten
+const uint32_t kBusyRetryMs = 500;
+const uint32_t kFailedRetryMs = 10000; // After a push that failed despite the scheduler's retries
+const int kConnectTimeoutMs = 5000;
+const std::chrono::milliseconds kMinBackoff(1000);
+const std::chrono::milliseconds kMaxBackoff(30000);
+
+const char* const kStatusNames[] = {"accepted", "filtered", "busy", "invalid", "duplicate"};
+
+uint32_t readUint32(const char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return ntohl(value);
+}
+
+uint16_t readUint16(const char* data) {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return ntohs(value);
+}
+
+void appendUint32(std::string& output, uint32_t value) {
+    value = htonl(value);
+    output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendUint16(std::string& output, uint16_t value) {
+    value = htons(value);
+    output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendAck(std::string& output, uint32_t id, Status status, uint32_t retry_ms) {
+    appendUint32(output, 12);
+    output += static_cast<char>(kTypeAck);
+    output += static_cast<char>(status);
+    appendUint16(output, 0);
+    appendUint32(output, id);
+    appendUint32(output, retry_ms);
+}
+
+// Length prefixed, cut at what the prefix can express
+void appendField(std::string& output, std::string_view value) {
+    value = value.substr(0, 65535);
+    appendUint16(output, static_cast<uint16_t>(value.size()));
+    output.append(value.data(), value.size());
+}
+
+// Whole frame of a record, including the length
+std::string encodeRecord(uint32_t id, const SmsRecord& record, bool backlog) {
+    std::string frame;
+    appendUint32(frame, 0);
+    frame += static_cast<char>(kTypeRecord);
+    frame += static_cast<char>(backlog ? kFlagBacklog : 0);
+    appendUint16(frame, 0);
+    appendUint32(frame, id);
+    for (std::string_view field : {record.number, record.text, record.modem_path, record.path, record.timestamp}) {
+        appendField(frame, field);
+    }
+    uint32_t length = htonl(static_cast<uint32_t>(frame.size() - 4));
+    memcpy(&frame[0], &length, 4);
+    return frame;
+}
+
+// Split the fields of a record body; false if they do not fill it exactly
+bool decodeRecord(const char* body, size_t length, std::string_view fields[kRecordFields]) {
+    size_t pos = kHeaderBytes;
+    for (size_t i = 0; i < kRecordFields; i++) {
+        if (length - pos < 2) return false;
+        size_t field_length = readUint16(body + pos);
+        pos += 2;
+        if (length - pos < field_length) return false;
+        fields[i] = std::string_view(body + pos, field_length);
+        pos += field_length;
+    }
+    return pos == length;
+}
+
+// Constant time, so the key cannot be guessed byte by byte
+bool sameKey(std::string_view given, const std::string& expected) {
+    unsigned char difference = given.size() == expected.size() ? 0 : 1;
+    for (size_t i = 0; i < given.size(); i++) {
+        difference |= static_cast<unsigned char>(given[i] ^ expected[i % std::max<size_t>(expected.size(), 1)]);
+    }
+    return difference == 0;
+}
+
+// Notice a dead peer within about a minute even while nothing is sent
+void tuneSocket(int fd) {
+    int on = 1;
+    int idle = 30, interval = 10, count = 3;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+bool aggregator::splitAddress(const std::string& address, std::string& host, std::string& port) {
+    size_t colon;
+    if (!address.empty() && address[0] == '[') {
+        size_t close = address.find(']');
+        if (close == std::string::npos || address.compare(close + 1, 1, ":") != 0) return false;
+        host = address.substr(1, close - 1);
+        colon = close + 1;
+    } else {
+        colon = address.rfind(':');
+        if (colon == std::string::npos) return false;
+        host = address.substr(0, colon);
+    }
+    port = address.substr(colon + 1);
+    return !port.empty();
+}
+
+AggregatorServer::AggregatorServer(SmsForwarder& forwarder, const std::string& address, const std::string& key,
+                                   int dedup_seconds)
+    : forwarder(forwarder), address(address), key(key), dedup_ms(static_cast<int64_t>(dedup_seconds) * 1000),
+      listener(-1), wake_pipe{-1, -1}, running(false), next_serial(1), next_ticket(1) {}
+
+AggregatorServer::~AggregatorServer() {
+    stop();
+}
+
+bool AggregatorServer::start() {
+    if (running) return true;
+
+    std::string host, port;
+    if (!aggregator::splitAddress(address, host, port)) {
+        LOG_ERROR("Invalid aggregator_listen address: " + address);
+        return false;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (rc != 0) {
+        LOG_ERROR("Cannot resolve aggregator_listen address " + address + ": " + gai_strerror(rc));
+        return false;
+    }
+
+    std::string error = "no address";
+    for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+        listener = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener < 0) continue;
+        int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(listener, ai->ai_addr, ai->ai_addrlen) == 0 && listen(listener, 64) == 0) break;
+        error = strerror(errno);
+        close(listener);
+        listener = -1;
+    }
+    freeaddrinfo(result);
+
+    if (listener < 0 || pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        LOG_ERROR("Failed to listen for fleet nodes on " + address + ": " + error);
+        stop();
+        return false;
+    }
+    if (key.empty()) {
+        LOG_WARNING("aggregator_key is empty, any host that reaches " + address + " can push through this service");
+    }
+
+    running = true;
+    worker = std::thread(&AggregatorServer::serveLoop, this);
+    LOG_INFO("Accepting SMS from fleet nodes on " + address);
+    return true;
+}
+
+void AggregatorServer::stop() {
+    if (running.exchange(false)) {
+        char byte = 0;
+        if (write(wake_pipe[1], &byte, 1) < 0) {
+            LOG_WARNING("Failed to wake aggregator thread");
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    for (const auto& client : clients) {
+        close(client.fd);
+    }
+    clients.clear();
+    // Their nodes resend them after the restart
+    pushing.clear();
+    pushing_content.clear();
+    if (listener >= 0) close(listener);
+    listener = -1;
+
+    // Pushes may still finish on the scheduler thread
+    std::lock_guard<std::mutex> lock(pushed_mutex);
+    pushed.clear();
+    for (int& fd : wake_pipe) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+}
+
+void AggregatorServer::serveLoop() {
+    while (running) {
+        ackPushes();
+
+        std::vector<pollfd> fds;
+        fds.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+        fds.push_back(pollfd{listener, POLLIN, 0});
+        for (const auto& client : clients) {
+            short events = client.output.size() < kMaxPendingAckBytes ? POLLIN : 0;
+            if (!client.output.empty()) events |= POLLOUT;
+            fds.push_back(pollfd{client.fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Aggregator poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        if (fds[0].revents) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+            if (!running) break;
+        }
+
+        // Clients first, so indexes still match the poll set
+        size_t nodes_before = 0, nodes_after = 0;
+        std::vector<Client> open;
+        for (size_t i = 0; i < clients.size(); i++) {
+            bool had_node = !clients[i].node.empty();
+            short revents = fds[i + 2].revents;
+            bool keep = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) keep = readClient(clients[i]);
+            if (keep && !clients[i].output.empty()) keep = writeClient(clients[i]);
+
+            if (had_node) nodes_before++;
+            if (keep) {
+                if (!clients[i].node.empty()) nodes_after++;
+                open.push_back(std::move(clients[i]));
+            } else {
+                if (had_node) LOG_INFO("Fleet node " + clients[i].node + " disconnected");
+                close(clients[i].fd);
+            }
+        }
+        clients.swap(open);
+        if (nodes_before != nodes_after) {
+            Metrics::getInstance().setGauge("sms_forward_aggregator_nodes", static_cast<double>(nodes_after));
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            if (clients.size() >= kMaxClients) {
+                LOG_WARNING("Too many fleet node connections, refusing connection");
+                close(fd);
+                continue;
+            }
+            tuneSocket(fd);
+            clients.push_back(Client{fd, next_serial++, std::string(), std::string(), std::string()});
+        }
+    }
+}
+
+bool AggregatorServer::readClient(Client& client) {
+    char buffer[65536];
+    ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    if (n == 0) return false;
+
+    client.input.append(buffer, static_cast<size_t>(n));
+    size_t consumed = handleFrames(client);
+    if (consumed == std::string::npos) {
+        // Framing or authentication failed, tell the node why and drop it
+        writeClient(client);
+        return false;
+    }
+    client.input.erase(0, consumed);
+    return true;
+}
+
+bool AggregatorServer::writeClient(Client& client) {
+    ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    client.output.erase(0, static_cast<size_t>(n));
+    return true;
+}
+
+size_t AggregatorServer::handleFrames(Client& client) {
+    size_t counts[5] = {};
+    size_t pos = 0;
+    bool busy = false;
+    // Records of one read share an arena
+    auto batch = std::make_shared<SmsArena>();
+
+    while (client.input.size() - pos >= 4) {
+        const char* frame = client.input.data() + pos;
+        uint32_t length = readUint32(frame);
+        if (length < kHeaderBytes || length > kMaxFrameBytes) {
+            LOG_WARNING("Invalid frame length " + std::to_string(length) + " from fleet node, closing connection");
+            appendAck(client.output, 0, Status::Invalid, 0);
+            return std::string::npos;
+        }
+        if (client.input.size() - pos - 4 < length) break;
+
+        const char* body = frame + 4;
+        uint8_t type = static_cast<uint8_t>(body[0]);
+        uint32_t id = readUint32(body + 4);
+        pos += 4 + length;
+
+        if (client.node.empty()) {
+            // Nothing is taken from a node before it has identified itself
+            uint16_t node_length = readUint16(body + 2);
+            std::string_view node(body + kHeaderBytes, std::min<size_t>(node_length, length - kHeaderBytes));
+            std::string_view given_key = std::string_view(body, length).substr(kHeaderBytes + node.size());
+            if (type != kTypeHello || static_cast<uint8_t>(body[1]) != kProtocolVersion || node.empty() ||
+                !sameKey(given_key, key)) {
+                LOG_WARNING_LIMITED("hello", "Refused fleet node " + std::string(node) +
+                                             ": bad hello, protocol version or aggregator_key");
+                appendAck(client.output, 0, Status::Invalid, 0);
+                return std::string::npos;
+            }
+            client.node = node;
+            appendAck(client.output, 0, Status::Accepted, 0);
+            LOG_INFO("Fleet node " + client.node + " connected");
+            continue;
+        }
+
+        Status status;
+        bool deferred = false;
+        if (type != kTypeRecord) {
+            status = Status::Invalid;
+        } else if (busy) {
+            // Once the queue is full, the rest of this read is refused without another look
+            status = Status::Busy;
+        } else {
+            status = handleRecord(client, id, body, length, batch, deferred);
+            busy = status == Status::Busy;
+        }
+        if (deferred) continue;
+
+        appendAck(client.output, id, status, status == Status::Busy ? kBusyRetryMs : 0);
+        counts[static_cast<int>(status)]++;
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (counts[i] == 0) continue;
+        Metrics::getInstance().increment("sms_forward_aggregator_records_total{status=\"" +
+                                         std::string(kStatusNames[i]) + "\"}", static_cast<double>(counts[i]));
+    }
+    if (counts[static_cast<int>(Status::Busy)] > 0) {
+        LOG_WARNING_LIMITED(client.node, "Push queue full, refused " +
+                            std::to_string(counts[static_cast<int>(Status::Busy)]) + " SMS from fleet node " +
+                            client.node);
+    }
+    return pos;
+}
+
+Status AggregatorServer::handleRecord(const Client& client, uint32_t id, const char* body, size_t length,
+                                      const std::shared_ptr<SmsArena>& batch, bool& deferred) {
+    std::string_view fields[kRecordFields];
+    if (!decodeRecord(body, length, fields) || fields[0].empty()) {
+        return Status::Invalid;
+    }
+
+    size_t content_key = std::hash<std::string>()(std::string(fields[0]) + '\x1f' + std::string(fields[1]));
+    int64_t now = nowMs();
+    if (seenRecently(content_key, now)) {
+        LOG_DEBUG("Duplicate SMS from " + std::string(fields[0]) + " via " + client.node);
+        return Status::Duplicate;
+    }
+    auto queued = pushing_content.find(content_key);
+    if (queued != pushing_content.end()) {
+        LOG_DEBUG("Duplicate SMS from " + std::string(fields[0]) + " via " + client.node + ", waiting for its push");
+        pushing[queued->second].waiters.push_back(Waiter{client.serial, id});
+        deferred = true;
+        return Status::Duplicate;
+    }
+
+    SmsRecord record(batch, fields[3], fields[2]);
+    record.number = record.keep(fields[0]);
+    record.text = record.keep(fields[1]);
+    record.timestamp = record.keep(fields[4]);
+
+    // The node keeps the SMS until it hears how the push went
+    uint64_t ticket = next_ticket++;
+    SmsForwarder::IngestResult result = forwarder.onRemote(
+        client.node, record, (static_cast<uint8_t>(body[1]) & kFlagBacklog) != 0,
+        [this, ticket](bool success) { onPushed(ticket, success); });
+    if (result == SmsForwarder::IngestResult::Busy) return Status::Busy;
+
+    if (result == SmsForwarder::IngestResult::Accepted) {
+        pushing[ticket] = Push{content_key, {Waiter{client.serial, id}}};
+        if (dedup_ms > 0) pushing_content[content_key] = ticket;
+        deferred = true;
+        return Status::Accepted;
+    }
+
+    if (dedup_ms > 0) {
+        seen[content_key] = now;
+        seen_order.emplace_back(now, content_key);
+    }
+    return Status::Filtered;
+}
+
+void AggregatorServer::onPushed(uint64_t ticket, bool success) {
+    std::lock_guard<std::mutex> lock(pushed_mutex);
+    if (wake_pipe[1] < 0) return;
+    pushed.emplace_back(ticket, success);
+    char byte = 0;
+    if (write(wake_pipe[1], &byte, 1) < 0 && errno != EAGAIN) {
+        LOG_WARNING("Failed to wake aggregator thread");
+    }
+}
+
+void AggregatorServer::ackPushes() {
+    std::vector<std::pair<uint64_t, bool>> finished;
+    {
+        std::lock_guard<std::mutex> lock(pushed_mutex);
+        finished.swap(pushed);
+    }
+
+    size_t counts[5] = {};
+    int64_t now = nowMs();
+    for (const auto& [ticket, success] : finished) {
+        auto it = pushing.find(ticket);
+        if (it == pushing.end()) continue;
+        Push push = std::move(it->second);
+        pushing.erase(it);
+        auto queued = pushing_content.find(push.content_key);
+        if (queued != pushing_content.end() && queued->second == ticket) pushing_content.erase(queued);
+
+        if (success && dedup_ms > 0) {
+            seen[push.content_key] = now;
+            seen_order.emplace_back(now, push.content_key);
+        }
+
+        // A node that reconnected since resends its records and gets the ack then
+        for (size_t i = 0; i < push.waiters.size(); i++) {
+            auto client = std::find_if(clients.begin(), clients.end(), [&](const Client& candidate) {
+                return candidate.serial == push.waiters[i].client;
+            });
+            if (client == clients.end()) continue;
+            Status status = !success ? Status::Busy : i == 0 ? Status::Accepted : Status::Duplicate;
+            appendAck(client->output, push.waiters[i].id, status, success ? 0 : kFailedRetryMs);
+            counts[static_cast<int>(status)]++;
+        }
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (counts[i] == 0) continue;
+        Metrics::getInstance().increment("sms_forward_aggregator_records_total{status=\"" +
+                                         std::string(kStatusNames[i]) + "\"}", static_cast<double>(counts[i]));
+    }
+}
+
+bool AggregatorServer::seenRecently(size_t content_key, int64_t now) {
+    while (!seen_order.empty() && seen_order.front().first + dedup_ms <= now) {
+        auto it = seen.find(seen_order.front().second);
+        if (it != seen.end() && it->second == seen_order.front().first) seen.erase(it);
+        seen_order.pop_front();
+    }
+    return seen.count(content_key) > 0;
+}
+
+AggregatorLink::AggregatorLink(SmsMonitor& monitor, const std::string& address, const std::string& node,
+                               const std::string& key, const std::string& spool_file, size_t spool_max_bytes)
+    : monitor(monitor), address(address), node(node), key(key), spool_file(spool_file),
+      spool_max_bytes(spool_max_bytes), wake_pipe{-1, -1}, running(false), pending_bytes(0), next_id(1),
+      connected(false), spool_bytes(0), spool_stale(0), fd(-1), backoff(kMinBackoff) {
+    if (this->node.empty()) {
+        char hostname[256] = {};
+        gethostname(hostname, sizeof(hostname) - 1);
+        this->node = hostname;
+    }
+}
+
+AggregatorLink::~AggregatorLink() {
+    stop();
+}
+
+bool AggregatorLink::start() {
+    if (running) return true;
+
+    std::string host, port;
+    if (!aggregator::splitAddress(address, host, port) || host.empty()) {
+        LOG_ERROR("Invalid aggregator_address: " + address);
+        return false;
+    }
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        LOG_ERROR("Failed to create aggregator link pipe: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    std::string dir = spool_file.substr(0, spool_file.find_last_of('/'));
+    if (!dir.empty() && dir != spool_file) mkdir(dir.c_str(), 0700);
+    loadSpool();
+    running = true;
+    worker = std::thread(&AggregatorLink::linkLoop, this);
+    LOG_INFO("Sending SMS to the aggregator at " + address + " as node " + node);
+    return true;
+}
+
+void AggregatorLink::stop() {
+    if (running.exchange(false)) {
+        char byte = 0;
+        if (write(wake_pipe[1], &byte, 1) < 0) {
+            LOG_WARNING("Failed to wake aggregator link thread");
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+
+        // Whatever was not acked is sent again after the restart
+        std::lock_guard<std::mutex> lock(mutex);
+        spoolPending();
+        if (spool_stale > 0) rewriteSpool();
+    }
+
+    for (int& pipe_fd : wake_pipe) {
+        if (pipe_fd >= 0) close(pipe_fd);
+        pipe_fd = -1;
+    }
+}
+
+void AggregatorLink::onSms(SmsRecord record) {
+    bool backlog = monitor.isReplayingBacklog();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t id = next_id++;
+        if (next_id == 0) next_id = 1; // 0 acks the hello
+        std::string frame = encodeRecord(id, record, backlog);
+
+        if (spool_max_bytes > 0 && pending_bytes + frame.size() > spool_max_bytes) {
+            // Not deleted either, so the SMS stays on the modem
+            Metrics::getInstance().increment("sms_forward_uplink_records_total{status=\"dropped\"}");
+            LOG_WARNING_LIMITED("spool full", "Aggregator spool full, dropped SMS from " +
+                                std::string(record.number) + ", it stays on the modem");
+            return;
+        }
+        bool spooled = !connected && appendSpool(frame);
+        pending_bytes += frame.size();
+        pending.push_back(Entry{id, std::move(frame), false, spooled, false, std::chrono::steady_clock::time_point()});
+        updateGauge();
+    }
+
+    char byte = 0;
+    if (write(wake_pipe[1], &byte, 1) < 0 && errno != EAGAIN) {
+        LOG_WARNING("Failed to wake aggregator link thread");
+    }
+}
+
+void AggregatorLink::linkLoop() {
+    next_attempt = std::chrono::steady_clock::now();
+    while (running) {
+        auto now = std::chrono::steady_clock::now();
+        if (fd < 0 && now >= next_attempt && !connectToAggregator()) {
+            next_attempt = now + backoff;
+            backoff = std::min(backoff * 2, kMaxBackoff);
+        }
+
+        // Until the next reconnect attempt or Busy retry
+        auto wake_at = std::chrono::steady_clock::time_point::max();
+        if (fd < 0) {
+            wake_at = next_attempt;
+        } else {
+            std::lock_guard<std::mutex> lock(mutex);
+            fillOutput(now);
+            for (const auto& entry : pending) {
+                if (!entry.sent && entry.retry_at > now) wake_at = std::min(wake_at, entry.retry_at);
+            }
+        }
+        int timeout = -1;
+        if (wake_at != std::chrono::steady_clock::time_point::max()) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(wake_at - now).count();
+            timeout = static_cast<int>(std::clamp<long long>(wait + 1, 0, 60000));
+        }
+
+        pollfd fds[2] = {{wake_pipe[0], POLLIN, 0}, {fd, 0, 0}};
+        if (fd >= 0) fds[1].events = static_cast<short>(POLLIN | (output.empty() ? 0 : POLLOUT));
+        if (poll(fds, fd >= 0 ? 2 : 1, timeout) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Aggregator link poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        if (fds[0].revents) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+        }
+        if (fd < 0) continue;
+
+        if ((fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && !readAcks()) {
+            disconnect("connection closed");
+            continue;
+        }
+        if (fd >= 0 && (fds[1].revents & POLLOUT)) {
+            ssize_t n = send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                disconnect(strerror(errno));
+            } else if (n > 0) {
+                output.erase(0, static_cast<size_t>(n));
+            }
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool AggregatorLink::connectToAggregator() {
+    std::string host, port;
+    aggregator::splitAddress(address, host, port);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (rc != 0) {
+        LOG_WARNING_LIMITED("resolve", "Cannot resolve aggregator " + address + ": " + gai_strerror(rc));
+        return false;
+    }
+
+    std::string error = "no address";
+    for (addrinfo* ai = result; ai && fd < 0 && running; ai = ai->ai_next) {
+        int candidate = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (candidate < 0) continue;
+
+        int rc_connect = connect(candidate, ai->ai_addr, ai->ai_addrlen);
+        if (rc_connect != 0 && errno == EINPROGRESS) {
+            // Wait for the handshake, or for stop()
+            pollfd fds[2] = {{candidate, POLLOUT, 0}, {wake_pipe[0], POLLIN, 0}};
+            int socket_error = ETIMEDOUT;
+            if (poll(fds, 2, kConnectTimeoutMs) > 0 && fds[0].revents) {
+                socklen_t size = sizeof(socket_error);
+                getsockopt(candidate, SOL_SOCKET, SO_ERROR, &socket_error, &size);
+            }
+            rc_connect = socket_error == 0 ? 0 : -1;
+            errno = socket_error;
+        }
+        if (rc_connect == 0) {
+            fd = candidate;
+        } else {
+            error = strerror(errno);
+            close(candidate);
+        }
+    }
+    freeaddrinfo(result);
+
+    if (fd < 0) {
+        LOG_WARNING_LIMITED(error, "Cannot reach aggregator " + address + ": " + error + ", retrying in " +
+                            std::to_string(backoff.count() / 1000) + " s");
+        return false;
+    }
+    tuneSocket(fd);
+
+    // The hello goes first; records follow without waiting for its ack
+    input.clear();
+    output.clear();
+    appendUint32(output, static_cast<uint32_t>(kHeaderBytes + node.size() + key.size()));
+    output += static_cast<char>(kTypeHello);
+    output += static_cast<char>(kProtocolVersion);
+    appendUint16(output, static_cast<uint16_t>(node.size()));
+    appendUint32(output, 0);
+    output += node;
+    output += key;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    connected = true;
+    for (auto& entry : pending) entry.sent = false;
+    return true;
+}
+
+void AggregatorLink::disconnect(const std::string& reason) {
+    close(fd);
+    fd = -1;
+    input.clear();
+    output.clear();
+    LOG_WARNING("Lost the aggregator at " + address + ": " + reason);
+
+    // Backoff is only reset once the aggregator accepts the hello
+    next_attempt = std::chrono::steady_clock::now() + backoff;
+    backoff = std::min(backoff * 2, kMaxBackoff);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    connected = false;
+    for (auto& entry : pending) entry.sent = false;
+    spoolPending();
+}
+
+bool AggregatorLink::readAcks() {
+    char buffer[16384];
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    if (n == 0) return false;
+    input.append(buffer, static_cast<size_t>(n));
+
+    size_t pos = 0;
+    while (input.size() - pos >= 16) {
+        const char* frame = input.data() + pos;
+        if (readUint32(frame) != 12 || static_cast<uint8_t>(frame[4]) != kTypeAck) {
+            LOG_ERROR("Unexpected frame from the aggregator");
+            return false;
+        }
+        // Statuses of later versions are not taken as success
+        uint8_t code = static_cast<uint8_t>(frame[5]);
+        Status status = code <= static_cast<uint8_t>(Status::Duplicate) ? static_cast<Status>(code) : Status::Invalid;
+        uint32_t id = readUint32(frame + 8);
+        pos += 16;
+
+        if (id == 0) {
+            if (status != Status::Accepted) {
+                LOG_ERROR_LIMITED("refused", "Aggregator " + address + " refused node " + node +
+                                             ", check aggregator_key");
+                return false;
+            }
+            backoff = kMinBackoff;
+            LOG_INFO("Connected to the aggregator at " + address);
+            continue;
+        }
+        handleAck(id, status, readUint32(frame + 12));
+    }
+    input.erase(0, pos);
+
+    // Acked records stay in the spool until rewriting it is worth it; after
+    // a crash before that they are resent and acked as Duplicate
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spool_stale > 0 && (spool_stale == spool_bytes ||
+                            (spool_stale >= kSpoolCompactBytes && spool_stale * 2 >= spool_bytes))) {
+        rewriteSpool();
+    }
+    return true;
+}
+
+void AggregatorLink::handleAck(uint32_t id, Status status, uint32_t retry_ms) {
+    std::string frame;
+    bool reloaded = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(pending.begin(), pending.end(), [id](const Entry& entry) { return entry.id == id; });
+        if (it == pending.end()) return;
+
+        if (status == Status::Busy) {
+            it->sent = false;
+            it->retry_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(retry_ms);
+        } else {
+            frame = std::move(it->frame);
+            reloaded = it->reloaded;
+            pending_bytes -= frame.size();
+            if (it->spooled) spool_stale += frame.size();
+            pending.erase(it);
+        }
+        updateGauge();
+    }
+    Metrics::getInstance().increment("sms_forward_uplink_records_total{status=\"" +
+                                     std::string(kStatusNames[static_cast<int>(status)]) + "\"}");
+    if (frame.empty()) return;
+
+    std::string_view fields[kRecordFields];
+    if (!decodeRecord(frame.data() + 4, frame.size() - 4, fields)) return;
+    if (status == Status::Invalid) {
+        LOG_ERROR("Aggregator refused SMS from " + std::string(fields[0]) + " as invalid");
+        return;
+    }
+    if (status == Status::Filtered) return;
+
+    // Pushed by the aggregator; a reloaded record's SMS stays on the modem
+    // and is acked again, with its current path, when the replay sends it
+    monitor.markForwarded(std::string(fields[0]), std::string(fields[1]), std::string(fields[4]));
+    if (Config::getInstance().getDeleteAfterForwarding() && !reloaded && !fields[3].empty()) {
+        if (!monitor.deleteSms(std::string(fields[3]))) {
+            LOG_ERROR("Failed to queue deletion of SMS from " + std::string(fields[0]) + " after handing it over");
+        }
+    }
+}
+
+void AggregatorLink::fillOutput(std::chrono::steady_clock::time_point now) {
+    for (auto& entry : pending) {
+        if (output.size() >= kMaxOutputBytes) break;
+        if (entry.sent || entry.retry_at > now) continue;
+        output += entry.frame;
+        entry.sent = true;
+    }
+}
+
+bool AggregatorLink::appendSpool(const std::string& data) {
+    if (spool_file.empty() || data.empty()) return false;
+    int spool = open(spool_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    bool written = spool >= 0 && write(spool, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    if (!written) {
+        LOG_ERROR_LIMITED("spool", "Cannot write aggregator spool " + spool_file + ": " + strerror(errno));
+    }
+    if (spool >= 0) close(spool);
+    // A short write leaves a tail that loadSpool discards
+    if (written) spool_bytes += data.size();
+    return written;
+}
+
+void AggregatorLink::spoolPending() {
+    std::string data;
+    for (const auto& entry : pending) {
+        if (!entry.spooled) data += entry.frame;
+    }
+    if (!appendSpool(data)) return;
+    for (auto& entry : pending) entry.spooled = true;
+}
+
+void AggregatorLink::rewriteSpool() {
+    if (spool_file.empty()) return;
+
+    std::string data;
+    for (const auto& entry : pending) {
+        if (entry.spooled) data += entry.frame;
+    }
+    if (data.empty()) {
+        unlink(spool_file.c_str());
+        spool_bytes = 0;
+        spool_stale = 0;
+        return;
+    }
+
+    std::string tmp_path = spool_file + ".tmp";
+    int spool = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool written = spool >= 0 && write(spool, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    if (spool >= 0) close(spool);
+    if (!written || rename(tmp_path.c_str(), spool_file.c_str()) != 0) {
+        LOG_ERROR_LIMITED("spool", "Cannot write aggregator spool " + spool_file + ": " + strerror(errno));
+        return;
+    }
+    spool_bytes = data.size();
+    spool_stale = 0;
+}
+
+void AggregatorLink::loadSpool() {
+    if (spool_file.empty()) return;
+    int spool = open(spool_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (spool < 0) return;
+
+    std::string data;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(spool, buffer, sizeof(buffer))) > 0) data.append(buffer, static_cast<size_t>(n));
+    close(spool);
+
+    // Records get ids of this run
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t pos = 0;
+    std::string_view fields[kRecordFields];
+    while (data.size() - pos >= 4) {
+        uint32_t length = readUint32(data.data() + pos);
+        if (length < kHeaderBytes || length > kMaxFrameBytes || data.size() - pos - 4 < length ||
+            !decodeRecord(data.data() + pos + 4, length, fields)) {
+            LOG_ERROR("Corrupt aggregator spool " + spool_file + ", discarding its tail");
+            break;
+        }
+        std::string frame = data.substr(pos, 4 + length);
+        uint32_t id = htonl(next_id++);
+        memcpy(&frame[8], &id, 4);
+        pending_bytes += frame.size();
+        pending.push_back(Entry{ntohl(id), std::move(frame), false, true, true, std::chrono::steady_clock::time_point()});
+        pos += 4 + length;
+    }
+    // A corrupt tail goes with the next compaction
+    spool_bytes = data.size();
+    spool_stale = data.size() - pos;
+    updateGauge();
+    if (!pending.empty()) {
+        LOG_INFO("Resending " + std::to_string(pending.size()) + " SMS spooled for the aggregator");
+    }
+}
+
+void AggregatorLink::updateGauge() {
+    Metrics::getInstance().setGauge("sms_forward_uplink_pending", static_cast<double>(pending.size()));
+}
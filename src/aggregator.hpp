@@ -0,0 +1,184 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include "sms_forwarder.hpp"
+#include "sms_monitor.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A fleet of nodes can hand their SMS to one central forwarder, which owns
+// the WxPusher credentials, connection pool and rate limits. Nodes keep a
+// TCP connection to it and stream records in the framing of IngestSocket:
+// a big-endian u32 length, counting the bytes after it, and a body:
+//   hello:  u8 type=4, u8 version=1, u16 node length, u32 0, node, key
+//   record: u8 type=3, u8 flags, u16 0, u32 id, then number, text, modem
+//           path, SMS path and timestamp, each as u16 length and bytes;
+//           flag 1 marks messages found in storage at startup
+//   ack:    u8 type=2, u8 status, u16 0, u32 id, u32 retry after (ms)
+// The hello comes first and is acked with id 0, or refused with Invalid
+// and the connection closed when the key does not match. Every record is
+// acked with its id; Busy means resend after the delay. Accepted and
+// Duplicate are only sent once the message has been pushed, and a push
+// that failed is acked Busy.
+namespace aggregator {
+
+enum class Status : uint8_t { Accepted = 0, Filtered = 1, Busy = 2, Invalid = 3, Duplicate = 4 };
+
+// "host:port", "[v6 address]:port" or ":port" for every local address
+bool splitAddress(const std::string& address, std::string& host, std::string& port);
+
+} // namespace aggregator
+
+// Accepts records from the nodes of a fleet (sms_forward --aggregator) and
+// forwards them like local SMS. The same sender and text arriving again
+// within dedup_seconds, from another node or as a node's resend after a
+// lost ack, is acked as Duplicate without a second push; while that push
+// is still queued, its ack waits for it too.
+class AggregatorServer {
+public:
+    AggregatorServer(SmsForwarder& forwarder, const std::string& address, const std::string& key,
+                     int dedup_seconds);
+    ~AggregatorServer();
+
+    bool start();
+    void stop();
+
+private:
+    struct Client {
+        int fd;
+        uint64_t serial; // Tells a reconnected node from the connection a pending ack was for
+        std::string node; // Empty until the hello is accepted
+        std::string input;
+        std::string output;
+    };
+
+    // Records acked once their push has finished
+    struct Waiter {
+        uint64_t client;
+        uint32_t id;
+    };
+    struct Push {
+        size_t content_key;
+        std::vector<Waiter> waiters; // The first one is acked Accepted, the rest Duplicate
+    };
+
+    void serveLoop();
+    bool readClient(Client& client);
+    bool writeClient(Client& client);
+    size_t handleFrames(Client& client);
+    aggregator::Status handleRecord(const Client& client, uint32_t id, const char* body, size_t length,
+                                    const std::shared_ptr<SmsArena>& batch, bool& deferred);
+    bool seenRecently(size_t key, int64_t now_ms);
+    void onPushed(uint64_t ticket, bool success);
+    void ackPushes();
+
+    SmsForwarder& forwarder;
+    std::string address;
+    std::string key;
+    int64_t dedup_ms;
+    int listener;
+    int wake_pipe[2];
+    std::thread worker;
+    std::atomic<bool> running;
+
+    std::mutex pushed_mutex; // Guards pushed and the write end of wake_pipe
+    std::vector<std::pair<uint64_t, bool>> pushed; // Finished pushes by ticket, from the scheduler thread
+
+    // Only touched by the worker thread
+    std::vector<Client> clients;
+    uint64_t next_serial;
+    uint64_t next_ticket;
+    std::unordered_map<uint64_t, Push> pushing;     // Accepted records awaiting their push, by ticket
+    std::unordered_map<size_t, uint64_t> pushing_content; // Sender and text -> ticket, when deduplicating
+    std::unordered_map<size_t, int64_t> seen;       // Sender and text -> when first pushed
+    std::deque<std::pair<int64_t, size_t>> seen_order; // For expiring seen, oldest first
+};
+
+// The node side: sends every SMS the monitor reports to the aggregator
+// instead of pushing it, over one connection that is re-established with
+// backoff. Records waiting for their ack are resent after a reconnect;
+// while the aggregator is unreachable they are also kept in spool_file, so
+// they survive a restart; acked records are dropped from it once they make
+// up half of it, or all of it. Once the aggregator has pushed an SMS it is
+// marked forwarded and deleted as delete_after_forwarding says, except for
+// records reloaded from the spool: ModemManager renumbers its SMS when it
+// restarts, so their paths may name other messages.
+class AggregatorLink {
+public:
+    AggregatorLink(SmsMonitor& monitor, const std::string& address, const std::string& node,
+                   const std::string& key, const std::string& spool_file, size_t spool_max_bytes);
+    ~AggregatorLink();
+
+    bool start();
+    void stop();
+
+    // Called on the monitor thread
+    void onSms(SmsRecord record);
+
+private:
+    struct Entry {
+        uint32_t id;
+        std::string frame;
+        bool sent;                                      // Awaiting its ack on the current connection
+        bool spooled;                                   // Written to spool_file
+        bool reloaded;                                  // From an earlier run's spool, its SMS path may be stale
+        std::chrono::steady_clock::time_point retry_at; // After a Busy ack
+    };
+
+    void linkLoop();
+    bool connectToAggregator();
+    void disconnect(const std::string& reason);
+    bool readAcks();
+    void handleAck(uint32_t id, aggregator::Status status, uint32_t retry_ms);
+    void fillOutput(std::chrono::steady_clock::time_point now);
+    bool appendSpool(const std::string& data);
+    void spoolPending();
+    void rewriteSpool();
+    void loadSpool();
+    void updateGauge();
+
+    SmsMonitor& monitor;
+    std::string address;
+    std::string node;
+    std::string key;
+    std::string spool_file;
+    size_t spool_max_bytes;
+    int wake_pipe[2];
+    std::thread worker;
+    std::atomic<bool> running;
+
+    std::mutex mutex; // Guards the members below
+    std::deque<Entry> pending;
+    size_t pending_bytes;
+    uint32_t next_id;
+    bool connected;
+    size_t spool_bytes; // Size of spool_file, which is only appended to between compactions
+    size_t spool_stale; // Bytes of it taken by records acked since
+
+    // Only touched by the worker thread
+    int fd;
+    std::string input;
+    std::string output;
+    std::chrono::milliseconds backoff;
+    std::chrono::steady_clock::time_point next_attempt;
+};
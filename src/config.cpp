@@ -13,8 +13,29 @@
  */
 
 #include "config.hpp"
+#include "logger.hpp"
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+
+// Parse an integer value of at least min_value, keeping the current value if it is malformed
+static int parseInt(const std::string& value, int current, int min_value = 1) {
+    char* end = nullptr;
+    long parsed = std::strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0' || parsed < min_value) {
+        return current;
+    }
+    return static_cast<int>(parsed);
+}
+
+// Compile a push template, keeping the current one if value is malformed
+static void parseTemplate(const std::string& key, const std::string& value, PushTemplate& current,
+                          bool title_allowed = true) {
+    std::string error;
+    if (!current.compile(value, error, title_allowed)) {
+        LOG_WARNING("Ignoring " + key + ": " + error);
+    }
+}
 
 Config& Config::getInstance() {
     static Config instance;
@@ -25,6 +46,8 @@ bool Config::load(const std::string& config_path) {
     std::ifstream file(config_path);
     if (!file.is_open()) return false;
 
+    sender_routes.clear();
+
     std::string line;
     while (std::getline(file, line)) {
         if (line.empty() || line[0] == '#') continue;
@@ -32,7 +55,9 @@ bool Config::load(const std::string& config_path) {
         std::istringstream iss(line);
         std::string key, value;
 
-        if (std::getline(iss, key, '=') && std::getline(iss, value)) {
+        // "key=" sets an empty value, which disables optional file outputs
+        if (line.find('=') != std::string::npos && std::getline(iss, key, '=')) {
+            std::getline(iss, value);
             // Trim whitespace from key and value
             key.erase(0, key.find_first_not_of(" \t"));
             key.erase(key.find_last_not_of(" \t") + 1);
@@ -41,6 +66,23 @@ bool Config::load(const std::string& config_path) {
 
             if (key == "wx_pusher_token") wx_pusher_token = value;
             else if (key == "wx_pusher_uid") wx_pusher_uid = value;
+            else if (key == "wx_pusher_topic_ids") wx_pusher_topic_ids = value;
+            else if (key == "route_verification_codes") route_verification_codes = value;
+            else if (key == "route_undelivered_codes") route_undelivered_codes = value;
+            else if (key == "route_sender") {
+                // May repeat: <sender prefix>:<recipients>
+                size_t colon = value.find(':');
+                if (colon != std::string::npos && colon > 0) {
+                    sender_routes.emplace_back(value.substr(0, colon), value.substr(colon + 1));
+                }
+            }
+            else if (key == "wx_pusher_endpoint") wx_pusher_endpoint = value;
+            else if (key == "wx_pusher_secondary_endpoint") wx_pusher_secondary_endpoint = value;
+            else if (key == "push_hedging") {
+                push_hedging = !(value == "false" || value == "0" || value == "no");
+            }
+            else if (key == "wx_pusher_ca_file") wx_pusher_ca_file = value;
+            else if (key == "tls_session_file") tls_session_file = value;
             else if (key == "forward_existing_sms") {
                 // Convert string to boolean
                 forward_existing_sms = !(value == "false" || value == "0" || value == "no");
@@ -57,8 +99,53 @@ bool Config::load(const std::string& config_path) {
                 // Convert string to boolean
                 delete_after_forwarding = (value == "true" || value == "1" || value == "yes");
             }
+            else if (key == "push_rate_per_minute") push_rate_per_minute = parseInt(value, push_rate_per_minute);
+            else if (key == "push_burst") push_burst = parseInt(value, push_burst);
+            else if (key == "storage_check_interval") storage_check_interval = parseInt(value, storage_check_interval);
+            else if (key == "storage_prune_threshold") storage_prune_threshold = parseInt(value, storage_prune_threshold, 0);
+            else if (key == "metrics_file") metrics_file = value;
+            else if (key == "dbus_address") dbus_address = value;
+            else if (key == "archive_dir") archive_dir = value;
+            else if (key == "max_inflight_sms") max_inflight_sms = parseInt(value, max_inflight_sms, 0);
+            else if (key == "max_queued_bytes") max_queued_bytes = parseInt(value, max_queued_bytes, 0);
+            else if (key == "max_pending_retries") max_pending_retries = parseInt(value, max_pending_retries, 0);
+            else if (key == "shed_policy") shed_policy = value;
+            else if (key == "spill_file") spill_file = value;
+            else if (key == "spill_max_bytes") spill_max_bytes = parseInt(value, spill_max_bytes, 0);
+            else if (key == "watchdog_stall_seconds") watchdog_stall_seconds = parseInt(value, watchdog_stall_seconds, 0);
+            else if (key == "watchdog_restart_seconds") watchdog_restart_seconds = parseInt(value, watchdog_restart_seconds, 0);
+            else if (key == "send_socket") send_socket = value;
+            else if (key == "send_interval_ms") send_interval_ms = parseInt(value, send_interval_ms, 0);
+            else if (key == "send_queue_limit") send_queue_limit = parseInt(value, send_queue_limit, 0);
+            else if (key == "log_repeat_interval") log_repeat_interval = parseInt(value, log_repeat_interval, 0);
+            else if (key == "flight_recorder_events") flight_recorder_events = parseInt(value, flight_recorder_events, 0);
+            else if (key == "flight_recorder_file") flight_recorder_file = value;
+            else if (key == "delivery_poll_seconds") delivery_poll_seconds = parseInt(value, delivery_poll_seconds, 0);
+            else if (key == "push_title_template") parseTemplate(key, value, push_title_template, false);
+            else if (key == "push_summary_template") parseTemplate(key, value, push_summary_template);
+            else if (key == "push_code_summary_template") parseTemplate(key, value, push_code_summary_template);
+            else if (key == "push_content_template") parseTemplate(key, value, push_content_template);
+            else if (key == "delivery_timeout_seconds") delivery_timeout_seconds = parseInt(value, delivery_timeout_seconds);
+            else if (key == "aggregator_listen") aggregator_listen = value;
+            else if (key == "aggregator_key") aggregator_key = value;
+            else if (key == "aggregator_dedup_seconds") aggregator_dedup_seconds = parseInt(value, aggregator_dedup_seconds, 0);
+            else if (key == "aggregator_address") aggregator_address = value;
+            else if (key == "node_name") node_name = value;
+            else if (key == "aggregator_spool_file") aggregator_spool_file = value;
+            else if (key == "aggregator_spool_max_bytes") aggregator_spool_max_bytes = parseInt(value, aggregator_spool_max_bytes, 0);
+            else if (key == "ingest_socket") ingest_socket = value;
+            else if (key == "watch_network") {
+                watch_network = !(value == "false" || value == "0" || value == "no");
+            }
         }
     }
 
-    return !wx_pusher_token.empty() && !wx_pusher_uid.empty();
+    // A fleet node only needs WxPusher settings when it pushes ingested messages itself
+    return (!wx_pusher_token.empty() && (!wx_pusher_uid.empty() || !wx_pusher_topic_ids.empty())) ||
+           !aggregator_address.empty();
+}
+
+std::string Config::getWxPusherRecipients() const {
+    if (wx_pusher_uid.empty() || wx_pusher_topic_ids.empty()) return wx_pusher_uid + wx_pusher_topic_ids;
+    return wx_pusher_uid + "," + wx_pusher_topic_ids;
 }
@@ -13,7 +13,10 @@
  */
 
 #pragma once
+#include "push_template.hpp"
 #include <string>
+#include <utility>
+#include <vector>
 
 class Config {
 public:
@@ -22,17 +25,130 @@ public:
 
     std::string getWxPusherToken() const { return wx_pusher_token; }
     std::string getWxPusherUid() const { return wx_pusher_uid; }
+    std::string getWxPusherTopicIds() const { return wx_pusher_topic_ids; }
+    // Default recipients: the UIDs and topic IDs in one comma separated list
+    std::string getWxPusherRecipients() const;
+    std::string getRouteVerificationCodes() const { return route_verification_codes; }
+    std::string getRouteUndeliveredCodes() const { return route_undelivered_codes; }
+    // Sender prefix and recipient list of each route_sender entry, in file order
+    const std::vector<std::pair<std::string, std::string>>& getSenderRoutes() const { return sender_routes; }
+    std::string getWxPusherEndpoint() const { return wx_pusher_endpoint; }
+    std::string getWxPusherSecondaryEndpoint() const { return wx_pusher_secondary_endpoint; }
+    bool getPushHedging() const { return push_hedging; }
+    std::string getWxPusherCaFile() const { return wx_pusher_ca_file; }
+    std::string getTlsSessionFile() const { return tls_session_file; }
     bool getForwardExistingSms() const { return forward_existing_sms; }
     bool getOnlyForwardVerificationCodes() const { return only_forward_verification_codes; }
     bool getDebugMode() const { return debug_mode; }
     bool getDeleteAfterForwarding() const { return delete_after_forwarding; }
+    int getPushRatePerMinute() const { return push_rate_per_minute; }
+    int getPushBurst() const { return push_burst; }
+    int getStorageCheckInterval() const { return storage_check_interval; }
+    int getStoragePruneThreshold() const { return storage_prune_threshold; }
+    std::string getMetricsFile() const { return metrics_file; }
+    std::string getDbusAddress() const { return dbus_address; }
+    std::string getArchiveDir() const { return archive_dir; }
+    int getMaxInflightSms() const { return max_inflight_sms; }
+    int getMaxQueuedBytes() const { return max_queued_bytes; }
+    int getMaxPendingRetries() const { return max_pending_retries; }
+    std::string getShedPolicy() const { return shed_policy; }
+    std::string getSpillFile() const { return spill_file; }
+    int getSpillMaxBytes() const { return spill_max_bytes; }
+    int getWatchdogStallSeconds() const { return watchdog_stall_seconds; }
+    int getWatchdogRestartSeconds() const { return watchdog_restart_seconds; }
+    std::string getSendSocket() const { return send_socket; }
+    int getSendIntervalMs() const { return send_interval_ms; }
+    int getSendQueueLimit() const { return send_queue_limit; }
+    std::string getIngestSocket() const { return ingest_socket; }
+    bool getWatchNetwork() const { return watch_network; }
+    int getLogRepeatInterval() const { return log_repeat_interval; }
+    int getFlightRecorderEvents() const { return flight_recorder_events; }
+    std::string getFlightRecorderFile() const { return flight_recorder_file; }
+    std::string getAggregatorListen() const { return aggregator_listen; }
+    std::string getAggregatorKey() const { return aggregator_key; }
+    int getAggregatorDedupSeconds() const { return aggregator_dedup_seconds; }
+    std::string getAggregatorAddress() const { return aggregator_address; }
+    std::string getNodeName() const { return node_name; }
+    std::string getAggregatorSpoolFile() const { return aggregator_spool_file; }
+    int getAggregatorSpoolMaxBytes() const { return aggregator_spool_max_bytes; }
+    int getDeliveryPollSeconds() const { return delivery_poll_seconds; }
+    int getDeliveryTimeoutSeconds() const { return delivery_timeout_seconds; }
+    // Compiled when the config is loaded; an empty title keeps the built-in ones
+    const PushTemplate& getPushTitleTemplate() const { return push_title_template; }
+    const PushTemplate& getPushSummaryTemplate() const { return push_summary_template; }
+    const PushTemplate& getPushCodeSummaryTemplate() const { return push_code_summary_template; }
+    const PushTemplate& getPushContentTemplate() const { return push_content_template; }
 
 private:
-    Config() : forward_existing_sms(true), only_forward_verification_codes(false), debug_mode(false), delete_after_forwarding(false) {} // Default values for backward compatibility
+    // Default values for backward compatibility
+    Config()
+        : forward_existing_sms(true), only_forward_verification_codes(false), debug_mode(false),
+          delete_after_forwarding(false), push_rate_per_minute(20), push_burst(5),
+          storage_check_interval(300), storage_prune_threshold(0),
+          metrics_file("/var/run/sms_forward.metrics"),
+          wx_pusher_endpoint("https://wxpusher.zjiecode.com/api/send/message"),
+          push_hedging(false), tls_session_file("/var/lib/sms_forward/tls_sessions"),
+          watchdog_stall_seconds(15), watchdog_restart_seconds(60),
+          archive_dir(""),
+          max_inflight_sms(256), max_queued_bytes(1048576), max_pending_retries(64),
+          shed_policy("coalesce,spill,drop_non_otp"), spill_file("/var/lib/sms_forward/spill"),
+          spill_max_bytes(4194304), send_interval_ms(3000), send_queue_limit(100),
+          watch_network(true), log_repeat_interval(60), flight_recorder_events(4096),
+          flight_recorder_file("/var/log/sms_forward.flight"), aggregator_listen("0.0.0.0:7810"),
+          aggregator_dedup_seconds(600), aggregator_spool_file("/var/lib/sms_forward/aggregator_spool"),
+          aggregator_spool_max_bytes(1048576), delivery_poll_seconds(0), delivery_timeout_seconds(600),
+          push_summary_template(PushTemplate::kDefaultSummary),
+          push_code_summary_template(PushTemplate::kDefaultCodeSummary),
+          push_content_template(PushTemplate::kDefaultContent) {}
     std::string wx_pusher_token;
-    std::string wx_pusher_uid;
+    std::string wx_pusher_uid; // Comma separated UIDs
+    std::string wx_pusher_topic_ids; // Comma separated topic IDs
+    std::string route_verification_codes; // Recipients of verification codes, empty uses the default
+    std::string route_undelivered_codes; // Recipients of re-pushed undelivered codes, empty uses the same
+    std::vector<std::pair<std::string, std::string>> sender_routes; // Sender prefix -> recipients
     bool forward_existing_sms; // Whether to forward existing SMS messages at startup
     bool only_forward_verification_codes; // Whether to only forward verification code SMS messages
     bool debug_mode; // Whether to enable debug logging
     bool delete_after_forwarding; // Whether to delete SMS messages after forwarding
+    int push_rate_per_minute; // Sustained WxPusher request budget
+    int push_burst; // Number of requests that may be sent back to back
+    int storage_check_interval; // Seconds between modem storage occupancy checks
+    int storage_prune_threshold; // Messages per storage that trigger pruning, 0 disables pruning
+    std::string metrics_file; // Prometheus text file with runtime metrics, empty disables export
+    std::string dbus_address; // Bus to find ModemManager on, empty means the system bus
+    std::string wx_pusher_endpoint; // WxPusher send API, overridable for local testing
+    std::string wx_pusher_secondary_endpoint; // Relay that hedged requests go to, empty uses the endpoint
+    bool push_hedging; // Whether to resend pushes that failed to connect, and hedge to the secondary endpoint
+    std::string wx_pusher_ca_file; // CA bundle for verifying WxPusher, empty uses the libcurl default
+    std::string tls_session_file; // TLS sessions kept across restarts, empty disables persistence
+    int watchdog_stall_seconds; // Loop lag that is logged as a stall, 0 disables stall detection
+    int watchdog_restart_seconds; // Stall after which an unsupervised process aborts, 0 never aborts
+    std::string archive_dir; // Local archive of received SMS, empty (default) disables archiving
+    int max_inflight_sms; // Queued and in-flight pushes, 0 means unlimited
+    int max_queued_bytes; // Bytes of queued pushes, 0 means unlimited
+    int max_pending_retries; // Throttled pushes and failed deletions awaiting retry, 0 means unlimited
+    std::string shed_policy; // Comma separated: coalesce, spill, drop_non_otp
+    std::string spill_file; // Where shed messages wait when spilling is enabled
+    int spill_max_bytes; // Spill file size limit, beyond it messages are dropped
+    std::string send_socket; // Unix socket accepting outbound SMS, empty disables sending
+    int send_interval_ms; // Minimum gap between outbound SMS on one modem
+    int send_queue_limit; // Outbound SMS waiting or being sent, 0 means unlimited
+    std::string ingest_socket; // Unix socket for messages from local producers, empty disables it
+    bool watch_network; // Whether to hold pushes while there is no default route
+    int log_repeat_interval; // Seconds a repeating log line stays suppressed, 0 logs every repeat
+    int flight_recorder_events; // Recent log events kept in memory for dumps, 0 disables the recorder
+    std::string flight_recorder_file; // Where the recorder is dumped
+    std::string aggregator_listen; // host:port the aggregator accepts fleet nodes on
+    std::string aggregator_key; // Shared secret of the fleet, empty accepts any node
+    int aggregator_dedup_seconds; // Same sender and text within this window is pushed once, 0 disables
+    std::string aggregator_address; // host:port of the aggregator to hand SMS to, empty pushes directly
+    std::string node_name; // Name of this node at the aggregator, empty uses the host name
+    std::string aggregator_spool_file; // SMS kept while the aggregator is unreachable
+    int aggregator_spool_max_bytes; // SMS awaiting the aggregator, beyond it they stay on the modem
+    int delivery_poll_seconds; // Seconds between delivery status queries, 0 disables tracking
+    int delivery_timeout_seconds; // Pushes not delivered within this time expire
+    PushTemplate push_title_template; // First line of a push, empty for the built-in titles
+    PushTemplate push_summary_template; // Notification text
+    PushTemplate push_code_summary_template; // Notification text when a verification code was found
+    PushTemplate push_content_template; // Full message
 };
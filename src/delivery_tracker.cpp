@@ -0,0 +1,108 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "delivery_tracker.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+
+DeliveryTracker::DeliveryTracker(int poll_seconds, int expire_seconds)
+    : poll_interval(poll_seconds), expire_after(expire_seconds),
+      next_poll(std::chrono::steady_clock::time_point::max()), next_id(0), cursor(0) {}
+
+const char* DeliveryTracker::stateName(State state) {
+    switch (state) {
+        case State::Delivered: return "delivered";
+        case State::Failed: return "failed";
+        case State::Expired: return "expired";
+        case State::Unknown: return "unknown";
+    }
+    return "unknown";
+}
+
+void DeliveryTracker::track(const std::vector<WxPusher::Receipt>& receipts, Callback callback) {
+    if (receipts.empty()) return;
+    if (pushes.size() >= kMaxTracked) {
+        // Nothing is lost but the final state, the push itself went out
+        LOG_WARNING_LIMITED("delivery tracking full", "Not tracking delivery, " +
+                            std::to_string(pushes.size()) + " pushes are already pending");
+        Metrics::getInstance().increment("sms_forward_delivery_total{state=\"untracked\"}");
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    Push push{{}, now + expire_after, std::move(callback), 0, false};
+    for (const auto& receipt : receipts) push.pending.push_back(receipt.send_record_id);
+    pushes.emplace(++next_id, std::move(push));
+    if (pushes.size() == 1) next_poll = now + poll_interval;
+    Metrics::getInstance().setGauge("sms_forward_delivery_pending", static_cast<double>(pushes.size()));
+}
+
+void DeliveryTracker::poll(WxPusher& pusher) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<Callback, State>> settled;
+
+    while (!pushes.empty() && pushes.begin()->second.expires <= now) {
+        Push& push = pushes.begin()->second;
+        settled.emplace_back(std::move(push.callback), push.answered ? State::Expired : State::Unknown);
+        pushes.erase(pushes.begin());
+    }
+
+    // Round robin from where the last poll stopped, so a long backlog does
+    // not starve the pushes at its end. A query that gets no answer ends the
+    // round: the next ones would most likely fail the same way, and a failed
+    // query says nothing about the record
+    size_t queries = 0;
+    auto it = pushes.lower_bound(cursor);
+    for (size_t visited = 0, total = pushes.size(); visited < total && queries < kQueriesPerPoll; visited++) {
+        if (it == pushes.end()) it = pushes.begin();
+        Push& push = it->second;
+        bool delivered = false;
+        bool answered = true;
+        while (push.next < push.pending.size() && !delivered && queries < kQueriesPerPoll) {
+            WxPusher::Delivery state = WxPusher::Delivery::Pending;
+            queries++;
+            if (!pusher.queryDelivery(push.pending[push.next], state)) {
+                answered = false;
+                break;
+            }
+            push.answered = true;
+            delivered = state == WxPusher::Delivery::Delivered;
+            if (state == WxPusher::Delivery::Failed) {
+                push.pending.erase(push.pending.begin() + static_cast<std::ptrdiff_t>(push.next));
+            } else if (!delivered) {
+                push.next++;
+            }
+        }
+        cursor = it->first;
+        if (!answered || (!delivered && push.next < push.pending.size())) break;
+
+        if (delivered || push.pending.empty()) {
+            settled.emplace_back(std::move(push.callback), delivered ? State::Delivered : State::Failed);
+            it = pushes.erase(it);
+        } else {
+            push.next = 0;
+            ++it;
+        }
+        cursor = it == pushes.end() ? 0 : it->first;
+    }
+
+    next_poll = pushes.empty() ? std::chrono::steady_clock::time_point::max() : now + poll_interval;
+    Metrics::getInstance().setGauge("sms_forward_delivery_pending", static_cast<double>(pushes.size()));
+
+    for (auto& entry : settled) {
+        Metrics::getInstance().increment(std::string("sms_forward_delivery_total{state=\"") +
+                                         stateName(entry.second) + "\"}");
+        if (entry.first) entry.first(entry.second);
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include "wx_pusher.hpp"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Follows pushes WxPusher accepted until each reaches a final state. A push
+// is delivered once any of its recipients has it, failed once every
+// recipient failed, and expired if neither happened in time. A push whose
+// send records WxPusher never answered about ends unknown instead, since
+// nothing says it did not arrive. Send records are queried one at a time,
+// round robin across pushes, a bounded number per poll interval however
+// many pushes are outstanding. Used from the push scheduler thread only.
+class DeliveryTracker {
+public:
+    enum class State { Delivered, Failed, Expired, Unknown };
+
+    // Called once, on the scheduler thread, when the push reaches its final state
+    using Callback = std::function<void(State)>;
+
+    DeliveryTracker(int poll_seconds, int expire_seconds);
+
+    // Follow the send records of one push
+    void track(const std::vector<WxPusher::Receipt>& receipts, Callback callback);
+
+    std::chrono::steady_clock::time_point nextPoll() const { return next_poll; }
+
+    // Expire overdue pushes and query the next few send records
+    void poll(WxPusher& pusher);
+
+    static const char* stateName(State state);
+
+private:
+    static const size_t kQueriesPerPoll = 10;
+    static const size_t kMaxTracked = 2048;
+
+    struct Push {
+        std::vector<int64_t> pending; // Send records not yet delivered or failed
+        std::chrono::steady_clock::time_point expires;
+        Callback callback;
+        size_t next;                  // Pending record the next query resumes at
+        bool answered;                // WxPusher answered a query about it at least once
+    };
+
+    std::chrono::seconds poll_interval;
+    std::chrono::seconds expire_after;
+    std::chrono::steady_clock::time_point next_poll;
+    std::map<uint64_t, Push> pushes; // By tracking order, so the oldest expire first
+    uint64_t next_id;
+    uint64_t cursor;                 // Push the next poll starts at
+};
@@ -0,0 +1,65 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "dns_resolver.hpp"
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netinet/in.h>
+#include <resolv.h>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+// Append the addresses of one record type, lowering ttl to the smallest seen
+void queryRecords(const std::string& host, int type, std::vector<std::string>& addresses, int& ttl) {
+    unsigned char answer[NS_PACKETSZ * 4];
+    int length = res_query(host.c_str(), ns_c_in, type, answer, sizeof(answer));
+    if (length <= 0) return;
+
+    ns_msg msg;
+    if (ns_initparse(answer, length, &msg) != 0) return;
+
+    int count = ns_msg_count(msg, ns_s_an);
+    for (int i = 0; i < count; i++) {
+        ns_rr rr;
+        if (ns_parserr(&msg, ns_s_an, i, &rr) != 0) continue;
+        if (ns_rr_type(rr) != type) continue; // CNAME chain entries
+
+        char text[INET6_ADDRSTRLEN];
+        int family = type == ns_t_a ? AF_INET : AF_INET6;
+        size_t expected = type == ns_t_a ? sizeof(in_addr) : sizeof(in6_addr);
+        if (ns_rr_rdlen(rr) != expected || !inet_ntop(family, ns_rr_rdata(rr), text, sizeof(text))) continue;
+
+        // curl expects IPv6 addresses in CURLOPT_RESOLVE to be bracketed
+        addresses.push_back(type == ns_t_a ? std::string(text) : "[" + std::string(text) + "]");
+        ttl = std::min(ttl, static_cast<int>(ns_rr_ttl(rr)));
+    }
+}
+
+} // namespace
+
+bool resolveWithTtl(const std::string& host, std::vector<std::string>& addresses, int& ttl) {
+    addresses.clear();
+    ttl = INT_MAX;
+
+    // The resolver state is per thread; reload it so resolv.conf changes
+    // made by the network scripts after a reconnect are picked up
+    res_init();
+
+    queryRecords(host, ns_t_a, addresses, ttl);
+    queryRecords(host, ns_t_aaaa, addresses, ttl);
+    return !addresses.empty();
+}
@@ -0,0 +1,24 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <string>
+#include <vector>
+
+// Resolve the A and AAAA records of host through the system resolver,
+// returning the addresses as text together with the smallest record TTL in
+// seconds. Unlike getaddrinfo this exposes the TTL, so callers can refresh
+// their own cache ahead of expiry instead of resolving on the send path.
+bool resolveWithTtl(const std::string& host, std::vector<std::string>& addresses, int& ttl);
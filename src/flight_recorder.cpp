@@ -0,0 +1,238 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "flight_recorder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+FlightRecorder* g_recorder = nullptr;
+
+void dumpHandler(int) {
+    int saved_errno = errno;
+    if (g_recorder) g_recorder->dump("signal");
+    errno = saved_errno;
+}
+
+int64_t clockNs(clockid_t clock) {
+    timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+uint32_t threadId() {
+    static thread_local uint32_t id = static_cast<uint32_t>(syscall(SYS_gettid));
+    return id;
+}
+
+const char* levelName(uint8_t level) {
+    switch (level) {
+        case 'D': return "DEBUG";
+        case 'I': return "INFO";
+        case 'W': return "WARNING";
+        case 'E': return "ERROR";
+        case 'F': return "FATAL";
+        default:  return "?";
+    }
+}
+
+// Buffered write(2) output without allocation or stdio, for signal handlers
+class DumpWriter {
+public:
+    explicit DumpWriter(int fd) : fd(fd), used(0), failed(false) {}
+
+    void text(const char* data, size_t length) {
+        while (length > 0) {
+            if (used == sizeof(buffer)) flush();
+            size_t chunk = std::min(length, sizeof(buffer) - used);
+            memcpy(buffer + used, data, chunk);
+            used += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    void text(const char* data) { text(data, strlen(data)); }
+
+    // Unsigned decimal, zero padded to width digits
+    void number(uint64_t value, int width = 1) {
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value > 0 && count < 20);
+        while (count < width && count < 20) digits[count++] = '0';
+        while (count > 0) text(&digits[--count], 1);
+    }
+
+    // Seconds with microseconds
+    void seconds(int64_t ns) {
+        if (ns < 0) {
+            text("-");
+            ns = -ns;
+        }
+        number(static_cast<uint64_t>(ns / 1000000000));
+        text(".");
+        number(static_cast<uint64_t>(ns % 1000000000 / 1000), 6);
+    }
+
+    bool flush() {
+        size_t done = 0;
+        while (done < used) {
+            ssize_t written = write(fd, buffer + done, used - done);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                failed = true;
+                break;
+            }
+            done += static_cast<size_t>(written);
+        }
+        used = 0;
+        return !failed;
+    }
+
+private:
+    int fd;
+    size_t used;
+    bool failed;
+    char buffer[4096];
+};
+
+} // namespace
+
+FlightRecorder& FlightRecorder::getInstance() {
+    static FlightRecorder instance;
+    return instance;
+}
+
+void FlightRecorder::start(int count, const std::string& dump_path) {
+    if (count <= 0 || events.load() != nullptr) return;
+
+    size_t capacity = 1;
+    while (capacity < static_cast<size_t>(count)) capacity <<= 1;
+
+    size_t length = std::min(dump_path.size(), sizeof(path) - 1);
+    memcpy(path, dump_path.data(), length);
+    path[length] = '\0';
+
+    // Kept for the life of the process, the handlers may use it up to the end
+    mask = capacity - 1;
+    events.store(new Event[capacity](), std::memory_order_release);
+    g_recorder = this;
+
+    struct sigaction action{};
+    action.sa_handler = dumpHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+void FlightRecorder::record(char level, std::string_view message) {
+    Event* ring = events.load(std::memory_order_acquire);
+    if (!ring) return;
+
+    uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+    Event& event = ring[index & mask];
+    event.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.mono_ns = clockNs(CLOCK_MONOTONIC);
+    event.thread = threadId();
+    event.level = static_cast<uint8_t>(level);
+    // length beyond kTextBytes marks a truncated line
+    event.length = static_cast<uint8_t>(std::min<size_t>(message.size(), 255));
+    memcpy(event.text, message.data(), std::min(message.size(), kTextBytes));
+
+    event.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+bool FlightRecorder::dump(const char* reason) {
+    Event* ring = events.load(std::memory_order_acquire);
+    if (!ring || dumping.exchange(true)) return false;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        dumping.store(false);
+        return false;
+    }
+
+    // Event times are monotonic; the header pairs that clock with the wall
+    // clock so they can be related to the log
+    int64_t mono_now = clockNs(CLOCK_MONOTONIC);
+    DumpWriter out(fd);
+    out.text("# sms_forward flight recorder, reason ");
+    out.text(reason);
+    out.text(", pid ");
+    out.number(static_cast<uint64_t>(getpid()));
+    out.text("\n# monotonic ");
+    out.seconds(mono_now);
+    out.text(" = unix time ");
+    out.seconds(clockNs(CLOCK_REALTIME));
+    out.text("\n# monotonic time, age, thread, level, message\n");
+
+    uint64_t end = next.load(std::memory_order_acquire);
+    uint64_t begin = end > mask + 1 ? end - (mask + 1) : 0;
+    uint64_t lost = 0;
+    for (uint64_t index = begin; index < end; index++) {
+        const Event& event = ring[index & mask];
+        uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+
+        // Copy, then make sure no writer reused the slot meanwhile
+        Event copy;
+        copy.mono_ns = event.mono_ns;
+        copy.thread = event.thread;
+        copy.level = event.level;
+        copy.length = event.length;
+        memcpy(copy.text, event.text, std::min<size_t>(copy.length, kTextBytes));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != 2 * index + 2 || event.sequence.load(std::memory_order_relaxed) != sequence) {
+            lost++;
+            continue;
+        }
+
+        out.seconds(copy.mono_ns);
+        out.text(" -");
+        out.seconds(mono_now - copy.mono_ns);
+        out.text(" ");
+        out.number(copy.thread);
+        out.text(" ");
+        out.text(levelName(copy.level));
+        out.text(" ");
+        // Continuation lines of stack traces and the like stay indented
+        for (size_t i = 0; i < std::min<size_t>(copy.length, kTextBytes); i++) {
+            if (copy.text[i] == '\n') out.text("\n    ");
+            else out.text(&copy.text[i], 1);
+        }
+        out.text(copy.length > kTextBytes ? "...\n" : "\n");
+    }
+    if (lost > 0) {
+        out.text("# ");
+        out.number(lost);
+        out.text(" events overwritten while dumping\n");
+    }
+
+    bool ok = out.flush();
+    close(fd);
+    dumping.store(false);
+    return ok;
+}
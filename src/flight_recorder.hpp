@@ -0,0 +1,63 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Keeps the most recent log events, debug lines only with debug_mode, in a
+// fixed ring in memory. Recording copies the line into a preallocated slot
+// without locks, allocation or I/O. The ring is written to a file on
+// SIGUSR1, on a crash and when the watchdog sees a stall, so those come with
+// the context that led up to them.
+class FlightRecorder {
+public:
+    static FlightRecorder& getInstance();
+
+    // Allocate room for events (rounded up to a power of two) and install
+    // the SIGUSR1 handler. 0 events disables the recorder. Call once.
+    void start(int events, const std::string& dump_path);
+
+    void record(char level, std::string_view message);
+
+    // Write the ring to dump_path, oldest event first, replacing the
+    // previous dump. Async-signal-safe; events recorded while it runs may
+    // be missing from the dump.
+    bool dump(const char* reason);
+
+private:
+    static constexpr size_t kTextBytes = 106;
+
+    // 128 bytes
+    struct Event {
+        std::atomic<uint64_t> sequence; // 2n+1 while event n is written, 2n+2 once complete
+        int64_t mono_ns;                // CLOCK_MONOTONIC
+        uint32_t thread;
+        uint8_t level;
+        uint8_t length;                 // Of the message, up to 255
+        char text[kTextBytes];
+    };
+
+    FlightRecorder() : events(nullptr), mask(0), next(0), dumping(false) {}
+
+    std::atomic<Event*> events;
+    size_t mask;
+    std::atomic<uint64_t> next;   // Index of the next event
+    std::atomic<bool> dumping;    // Concurrent or nested dumps are skipped
+    char path[256];               // Copied so dump() needs no allocation
+};
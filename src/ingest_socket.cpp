@@ -0,0 +1,253 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "ingest_socket.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const uint8_t kTypeMessage = 1;
+const uint8_t kTypeAck = 2;
+const size_t kMessageHeaderBytes = 8;
+const size_t kMaxFrameBytes = 65536;
+const size_t kMaxPendingAckBytes = 65536; // Beyond this a client is not read until it drains its acks
+const size_t kMaxClients = 32;
+const uint32_t kBusyRetryMs = 200;
+
+uint32_t readUint32(const char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return ntohl(value);
+}
+
+uint16_t readUint16(const char* data) {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return ntohs(value);
+}
+
+void appendAck(std::string& output, uint32_t id, IngestSocket::Status status, uint32_t retry_ms) {
+    char frame[16] = {};
+    uint32_t value = htonl(12);
+    memcpy(frame, &value, 4);
+    frame[4] = static_cast<char>(kTypeAck);
+    frame[5] = static_cast<char>(status);
+    value = htonl(id);
+    memcpy(frame + 8, &value, 4);
+    value = htonl(retry_ms);
+    memcpy(frame + 12, &value, 4);
+    output.append(frame, sizeof(frame));
+}
+
+} // namespace
+
+IngestSocket::IngestSocket(SmsForwarder& forwarder, const std::string& path)
+    : forwarder(forwarder), path(path), listener(-1), wake_pipe{-1, -1}, running(false) {}
+
+IngestSocket::~IngestSocket() {
+    stop();
+}
+
+bool IngestSocket::start() {
+    if (running) return true;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Ingest socket path too long: " + path);
+        return false;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0 || pipe2(wake_pipe, O_CLOEXEC) != 0) {
+        LOG_ERROR("Failed to create ingest socket: " + std::string(strerror(errno)));
+        stop();
+        return false;
+    }
+
+    // A stale socket from a previous run would make bind fail
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+        LOG_ERROR("Failed to listen on " + path + ": " + std::string(strerror(errno)));
+        stop();
+        return false;
+    }
+    // Producers use our WxPusher credentials; only root and the socket's group may
+    chmod(path.c_str(), 0660);
+
+    running = true;
+    worker = std::thread(&IngestSocket::serveLoop, this);
+    LOG_INFO("Accepting messages for forwarding on " + path);
+    return true;
+}
+
+void IngestSocket::stop() {
+    if (running.exchange(false)) {
+        char byte = 0;
+        if (write(wake_pipe[1], &byte, 1) < 0) {
+            LOG_WARNING("Failed to wake ingest socket thread");
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+        unlink(path.c_str());
+    }
+
+    for (const auto& client : clients) {
+        close(client.fd);
+    }
+    clients.clear();
+    if (listener >= 0) close(listener);
+    for (int& fd : wake_pipe) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    listener = -1;
+}
+
+void IngestSocket::serveLoop() {
+    while (running) {
+        std::vector<pollfd> fds;
+        fds.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+        fds.push_back(pollfd{listener, POLLIN, 0});
+        for (const auto& client : clients) {
+            short events = client.output.size() < kMaxPendingAckBytes ? POLLIN : 0;
+            if (!client.output.empty()) events |= POLLOUT;
+            fds.push_back(pollfd{client.fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Ingest socket poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        if (fds[0].revents) break;
+
+        // Clients first, so indexes still match the poll set
+        std::vector<Client> open;
+        for (size_t i = 0; i < clients.size(); i++) {
+            short revents = fds[i + 2].revents;
+            bool keep = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) keep = readClient(clients[i]);
+            if (keep && !clients[i].output.empty()) keep = writeClient(clients[i]);
+
+            if (keep) {
+                open.push_back(std::move(clients[i]));
+            } else {
+                close(clients[i].fd);
+            }
+        }
+        clients.swap(open);
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            if (clients.size() >= kMaxClients) {
+                LOG_WARNING("Too many ingest socket clients, refusing connection");
+                close(fd);
+                continue;
+            }
+            clients.push_back(Client{fd, std::string(), std::string()});
+        }
+    }
+}
+
+bool IngestSocket::readClient(Client& client) {
+    char buffer[65536];
+    ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    if (n == 0) return false;
+
+    client.input.append(buffer, static_cast<size_t>(n));
+    size_t consumed = handleFrames(client);
+    if (consumed == std::string::npos) {
+        // Framing is lost, nothing after the bad frame can be trusted
+        writeClient(client);
+        return false;
+    }
+    client.input.erase(0, consumed);
+    return true;
+}
+
+bool IngestSocket::writeClient(Client& client) {
+    ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    client.output.erase(0, static_cast<size_t>(n));
+    return true;
+}
+
+size_t IngestSocket::handleFrames(Client& client) {
+    size_t counts[4] = {};
+    size_t pos = 0;
+    bool busy = false;
+
+    while (client.input.size() - pos >= 4) {
+        const char* frame = client.input.data() + pos;
+        uint32_t length = readUint32(frame);
+        if (length < kMessageHeaderBytes || length > kMaxFrameBytes) {
+            LOG_WARNING("Invalid ingest frame length " + std::to_string(length) + ", closing client");
+            appendAck(client.output, 0, Status::Invalid, 0);
+            counts[static_cast<int>(Status::Invalid)]++;
+            pos = std::string::npos;
+            break;
+        }
+        if (client.input.size() - pos - 4 < length) break;
+
+        const char* body = frame + 4;
+        uint16_t source_length = readUint16(body + 2);
+        uint32_t id = readUint32(body + 4);
+        Status status;
+        if (static_cast<uint8_t>(body[0]) != kTypeMessage || kMessageHeaderBytes + source_length >= length) {
+            status = Status::Invalid;
+        } else if (busy) {
+            // Once the queue is full, the rest of this read is refused without another look
+            status = Status::Busy;
+        } else {
+            std::string source(body + kMessageHeaderBytes, source_length);
+            std::string text(body + kMessageHeaderBytes + source_length, length - kMessageHeaderBytes - source_length);
+            SmsForwarder::IngestResult result = forwarder.onIngest(source.empty() ? "ingest" : source, text);
+            status = result == SmsForwarder::IngestResult::Accepted ? Status::Accepted
+                   : result == SmsForwarder::IngestResult::Filtered ? Status::Filtered : Status::Busy;
+            busy = status == Status::Busy;
+        }
+
+        appendAck(client.output, id, status, status == Status::Busy ? kBusyRetryMs : 0);
+        counts[static_cast<int>(status)]++;
+        pos += 4 + length;
+    }
+
+    const char* names[] = {"accepted", "filtered", "busy", "invalid"};
+    for (int i = 0; i < 4; i++) {
+        if (counts[i] == 0) continue;
+        Metrics::getInstance().increment("sms_forward_ingest_messages_total{status=\"" + std::string(names[i]) + "\"}",
+                                         static_cast<double>(counts[i]));
+    }
+    if (counts[static_cast<int>(Status::Busy)] > 0) {
+        LOG_WARNING("Push queue full, refused " + std::to_string(counts[static_cast<int>(Status::Busy)]) +
+                    " ingested messages");
+    }
+    return pos;
+}
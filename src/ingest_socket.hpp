@@ -0,0 +1,64 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include "sms_forwarder.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local Unix socket through which other daemons feed messages into the
+// forwarding pipeline. Every frame is a big-endian u32 length, counting the
+// bytes after it, and a body:
+//   message: u8 type=1, u8 flags=0, u16 source length, u32 id, source, text
+//   ack:     u8 type=2, u8 status, u16 0, u32 id, u32 retry after (ms)
+// Producers may write any number of messages at once; each gets an ack with
+// the same id, and the acks for one read go out in one write. A Busy ack
+// means the message was not taken and should be resent after the delay.
+// A client that stops reading its acks is no longer read from either.
+class IngestSocket {
+public:
+    enum class Status : uint8_t { Accepted = 0, Filtered = 1, Busy = 2, Invalid = 3 };
+
+    IngestSocket(SmsForwarder& forwarder, const std::string& path);
+    ~IngestSocket();
+
+    bool start();
+    void stop();
+
+private:
+    struct Client {
+        int fd;
+        std::string input;
+        std::string output;
+    };
+
+    void serveLoop();
+    bool readClient(Client& client);
+    bool writeClient(Client& client);
+    size_t handleFrames(Client& client);
+
+    SmsForwarder& forwarder;
+    std::string path;
+    int listener;
+    int wake_pipe[2];
+    std::thread worker;
+    std::atomic<bool> running;
+
+    // Only touched by the worker thread
+    std::vector<Client> clients;
+};
@@ -0,0 +1,257 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "json_reader.hpp"
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Deeper documents are refused rather than risking the stack
+const int kMaxDepth = 32;
+
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : text(text), pos(0) {}
+
+    bool parseDocument(JsonValue& value) {
+        if (!parseValue(value, 0)) return false;
+        skipSpace();
+        return pos == text.size();
+    }
+
+private:
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool literal(std::string_view word) {
+        if (text.compare(pos, word.size(), word) != 0) return false;
+        pos += word.size();
+        return true;
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+        if (depth > kMaxDepth) return false;
+        skipSpace();
+        if (pos >= text.size()) return false;
+
+        switch (text[pos]) {
+            case '{': return parseObject(value, depth);
+            case '[': return parseArray(value, depth);
+            case '"':
+                value.type = JsonValue::Type::String;
+                return parseString(value.string);
+            case 't':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = true;
+                return literal("true");
+            case 'f':
+                value.type = JsonValue::Type::Bool;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                return parseNumber(value);
+        }
+    }
+
+    bool parseObject(JsonValue& value, int depth) {
+        value.type = JsonValue::Type::Object;
+        pos++;
+        skipSpace();
+        if (pos < text.size() && text[pos] == '}') {
+            pos++;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            std::string key;
+            if (pos >= text.size() || text[pos] != '"' || !parseString(key)) return false;
+            skipSpace();
+            if (pos >= text.size() || text[pos++] != ':') return false;
+            value.members.emplace_back(std::move(key), JsonValue());
+            if (!parseValue(value.members.back().second, depth + 1)) return false;
+            skipSpace();
+            if (pos >= text.size()) return false;
+            char c = text[pos++];
+            if (c == '}') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool parseArray(JsonValue& value, int depth) {
+        value.type = JsonValue::Type::Array;
+        pos++;
+        skipSpace();
+        if (pos < text.size() && text[pos] == ']') {
+            pos++;
+            return true;
+        }
+        while (true) {
+            value.items.emplace_back();
+            if (!parseValue(value.items.back(), depth + 1)) return false;
+            skipSpace();
+            if (pos >= text.size()) return false;
+            char c = text[pos++];
+            if (c == ']') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool parseHex(uint32_t& code) {
+        if (text.size() - pos < 4) return false;
+        code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text[pos++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= static_cast<uint32_t>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool parseString(std::string& out) {
+        pos++; // Opening quote
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"') return true;
+            if (static_cast<unsigned char>(c) < 0x20) return false;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) return false;
+            char escape = text[pos++];
+            switch (escape) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!parseHex(code)) return false;
+                    // A surrogate pair encodes one code point beyond the BMP
+                    if (code >= 0xd800 && code < 0xdc00 && text.compare(pos, 2, "\\u") == 0) {
+                        pos += 2;
+                        uint32_t low;
+                        if (!parseHex(low) || low < 0xdc00 || low >= 0xe000) return false;
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    bool parseNumber(JsonValue& value) {
+        size_t start = pos;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        size_t digits = pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+        if (pos == digits) return false;
+        bool integral = true;
+        if (pos < text.size() && text[pos] == '.') {
+            integral = false;
+            pos++;
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+        }
+        if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+            integral = false;
+            pos++;
+            if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) pos++;
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+        }
+
+        std::string number(text.substr(start, pos - start));
+        value.type = JsonValue::Type::Number;
+        value.number = strtod(number.c_str(), nullptr);
+        if (integral) {
+            value.integer = strtoll(number.c_str(), nullptr, 10);
+        } else if (std::fabs(value.number) < 9e18) {
+            value.integer = static_cast<int64_t>(std::trunc(value.number));
+        }
+        return true;
+    }
+
+    std::string_view text;
+    size_t pos;
+};
+
+} // namespace
+
+const JsonValue* JsonValue::find(std::string_view key) const {
+    for (const auto& member : members) {
+        if (member.first == key) return &member.second;
+    }
+    return nullptr;
+}
+
+bool parseJson(std::string_view text, JsonValue& value) {
+    value = JsonValue();
+    return JsonParser(text).parseDocument(value);
+}
+
+void appendJsonEscaped(std::string& out, std::string_view text) {
+    static const char kHex[] = "0123456789abcdef";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += kHex[(c >> 4) & 0xf];
+                    out += kHex[c & 0xf];
+                } else {
+                    out += c;
+                }
+        }
+    }
+}
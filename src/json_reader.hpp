@@ -0,0 +1,46 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A parsed JSON document, enough for reading API responses
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    int64_t integer = 0;      // Exact value of integral numbers, such as IDs
+    std::string string;
+    std::vector<JsonValue> items;                           // Array elements
+    std::vector<std::pair<std::string, JsonValue>> members; // Object members in document order
+
+    // Member of an object, nullptr if this is no object or lacks it
+    const JsonValue* find(std::string_view key) const;
+
+    bool isTrue() const { return type == Type::Bool && boolean; }
+    int64_t asInteger(int64_t fallback = 0) const { return type == Type::Number ? integer : fallback; }
+};
+
+// Parse text as a single JSON value; false if it is not valid JSON
+bool parseJson(std::string_view text, JsonValue& value);
+
+// Append text to out as the contents of a JSON string literal
+void appendJsonEscaped(std::string& out, std::string_view text);
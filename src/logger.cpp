@@ -14,7 +14,11 @@
 
 #include "logger.hpp"
 #include "config.hpp"
+#include "flight_recorder.hpp"
+#include "metrics.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <cxxabi.h>
@@ -24,6 +28,9 @@ static Logger* g_logger = nullptr;
 
 // 信号处理函数
 void signalHandler(int sig) {
+    // The dump is signal-safe, unlike logging, so it goes first
+    FlightRecorder::getInstance().dump("crash");
+
     if (g_logger) {
         g_logger->logCrash(sig);
     }
@@ -93,15 +100,20 @@ std::string Logger::getStackTrace() {
         return "<empty stack trace, possibly corrupt>";
     }
 
+    // 跳过第一帧（当前函数）
+    return formatStackTrace(addrlist + 1, addrlen - 1);
+}
+
+std::string Logger::formatStackTrace(void* const* frames, int count) {
     // 解析地址为符号
-    char** symbollist = backtrace_symbols(addrlist, addrlen);
+    char** symbollist = backtrace_symbols(frames, count);
     if (symbollist == nullptr) {
         return "<failed to get backtrace symbols>";
     }
 
     std::stringstream ss;
-    for (int i = 1; i < addrlen; i++) { // 跳过第一帧（当前函数）
-        ss << "#" << (i-1) << ": " << symbollist[i] << "\n";
+    for (int i = 0; i < count; i++) {
+        ss << "#" << i << ": " << symbollist[i] << "\n";
 
         // 尝试解析符号名（去除名称修饰）
         char* begin_name = nullptr;
@@ -140,6 +152,7 @@ std::string Logger::getStackTrace() {
 }
 
 void Logger::log(const std::string& level, const std::string& message) {
+    FlightRecorder::getInstance().record(level[0], message);
     if (!log_file.is_open()) return;
 
     auto now = std::chrono::system_clock::now();
@@ -162,3 +175,109 @@ void Logger::debug(const std::string& message) {
     }
 }
 void Logger::warning(const std::string& message) { log("WARNING", message); }
+
+void Logger::addLimiter(LogLimiter* limiter) {
+    std::lock_guard<std::mutex> lock(limiters_mutex);
+    limiters.push_back(limiter);
+}
+
+void Logger::removeLimiter(LogLimiter* limiter) {
+    std::lock_guard<std::mutex> lock(limiters_mutex);
+    limiters.erase(std::remove(limiters.begin(), limiters.end(), limiter), limiters.end());
+}
+
+void Logger::flushRepeats() {
+    if (Config::getInstance().getLogRepeatInterval() <= 0) return;
+
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::lock_guard<std::mutex> lock(limiters_mutex);
+    for (LogLimiter* limiter : limiters) {
+        limiter->summarize(now_ms);
+    }
+}
+
+LogLimiter::LogLimiter(const char* level, const char* file, int line) : level(level), file(file), line(line) {
+    const char* slash = strrchr(file, '/');
+    if (slash) this->file = slash + 1;
+    Logger::getInstance().addLimiter(this);
+}
+
+LogLimiter::~LogLimiter() {
+    Logger::getInstance().removeLimiter(this);
+}
+
+LogLimiter::Ticket LogLimiter::admit(std::string_view key) {
+    int interval = Config::getInstance().getLogRepeatInterval();
+    if (interval <= 0) return Ticket{true, nullptr, 0};
+
+    // 0 marks a free slot, so no key hashes to it
+    uint64_t hash = std::hash<std::string_view>()(key) | 1;
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    Slot* slot = nullptr;
+    for (int i = 0; i < kSlots && !slot; i++) {
+        Slot& candidate = slots[(hash + i) % kSlots];
+        uint64_t current = candidate.key.load(std::memory_order_acquire);
+        if (current == 0) candidate.key.compare_exchange_strong(current, hash);
+        if (current == 0 || current == hash) slot = &candidate;
+    }
+    // All taken: reuse a key that has been quiet for a whole interval
+    for (int i = 0; i < kSlots && !slot; i++) {
+        Slot& candidate = slots[i];
+        uint64_t current = candidate.key.load(std::memory_order_acquire);
+        if (candidate.repeats.load(std::memory_order_relaxed) == 0 &&
+            now_ms >= candidate.next_ms.load(std::memory_order_relaxed) + interval * 1000LL &&
+            candidate.key.compare_exchange_strong(current, hash)) {
+            slot = &candidate;
+        }
+    }
+    // Too many distinct keys at once; write rather than merge them
+    if (!slot) return Ticket{true, nullptr, 0};
+
+    int64_t next_ms = slot->next_ms.load(std::memory_order_relaxed);
+    if (now_ms < next_ms || !slot->next_ms.compare_exchange_strong(next_ms, now_ms + interval * 1000LL)) {
+        slot->repeats.fetch_add(1, std::memory_order_relaxed);
+        return Ticket{false, slot, 0};
+    }
+    return Ticket{true, slot, slot->repeats.exchange(0)};
+}
+
+void LogLimiter::write(const Ticket& ticket, const std::string& message) {
+    if (ticket.repeats > 0) {
+        Metrics::getInstance().increment("sms_forward_log_suppressed_total", static_cast<double>(ticket.repeats));
+        Logger::getInstance().log(level, message + " (" + std::to_string(ticket.repeats) +
+                                  " repeats suppressed before this)");
+    } else {
+        Logger::getInstance().log(level, message);
+    }
+
+    if (ticket.slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ticket.slot->message = message;
+    }
+}
+
+void LogLimiter::summarize(int64_t now_ms) {
+    int interval = Config::getInstance().getLogRepeatInterval();
+    for (Slot& slot : slots) {
+        if (slot.key.load(std::memory_order_acquire) == 0) continue;
+        int64_t next_ms = slot.next_ms.load(std::memory_order_relaxed);
+        if (now_ms < next_ms || slot.repeats.load(std::memory_order_relaxed) == 0) continue;
+        // A new window, so a steady repeat yields one summary per interval
+        if (!slot.next_ms.compare_exchange_strong(next_ms, now_ms + interval * 1000LL)) continue;
+        long repeats = slot.repeats.exchange(0);
+        if (repeats == 0) continue;
+
+        std::string message;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            message = slot.message;
+        }
+        Metrics::getInstance().increment("sms_forward_log_suppressed_total", static_cast<double>(repeats));
+        Logger::getInstance().log(level, "Repeated " + std::to_string(repeats) + " times in the last " +
+                                  std::to_string(interval) + " s (" + std::string(file) + ":" +
+                                  std::to_string(line) + "): " + message);
+    }
+}
@@ -13,9 +13,13 @@
  */
 
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <mutex>
+#include <vector>
 #include <csignal>
 #include <execinfo.h>
 #include <cstdlib>
@@ -24,6 +28,8 @@
 // 信号处理函数声明
 void signalHandler(int sig);
 
+class LogLimiter;
+
 class Logger {
 public:
     static Logger& getInstance();
@@ -39,18 +45,84 @@ public:
     // 获取调用栈信息
     std::string getStackTrace();
 
+    // 将 backtrace() 得到的地址格式化为调用栈信息
+    std::string formatStackTrace(void* const* frames, int count);
+
     void info(const std::string& message);
     void error(const std::string& message);
     void debug(const std::string& message);
     void warning(const std::string& message);
 
+    // Write "repeated N times" summaries for limited lines whose interval
+    // has passed. Called periodically, so a line that stops repeating is
+    // still accounted for.
+    void flushRepeats();
+    void addLimiter(LogLimiter* limiter);
+    void removeLimiter(LogLimiter* limiter);
+
 private:
     Logger() = default;
     std::ofstream log_file;
     std::mutex mutex;
+    std::mutex limiters_mutex;
+    std::vector<LogLimiter*> limiters;
+};
+
+// Suppresses one call site's repeats of the same line. The first line for a
+// key is written; repeats within log_repeat_interval are only counted, and
+// reported with the next line written for that key or by flushRepeats.
+// Different keys, e.g. different error messages, are limited separately.
+// Deciding to suppress takes no lock and formats nothing.
+class LogLimiter {
+public:
+    static const int kSlots = 8;
+
+    struct Slot {
+        std::atomic<uint64_t> key{0};    // Hash of the key, 0 while unused
+        std::atomic<int64_t> next_ms{0}; // Until then repeats are suppressed
+        std::atomic<long> repeats{0};
+        std::string message;             // Last line written, guarded by the limiter's mutex
+    };
+
+    // Result of admit: write the line if allowed
+    struct Ticket {
+        bool allowed;
+        Slot* slot;   // nullptr when every slot is busy with other keys
+        long repeats; // Suppressed since the last line for the key
+    };
+
+    LogLimiter(const char* level, const char* file, int line);
+    ~LogLimiter();
+    LogLimiter(const LogLimiter&) = delete;
+    LogLimiter& operator=(const LogLimiter&) = delete;
+
+    Ticket admit(std::string_view key);
+    void write(const Ticket& ticket, const std::string& message);
+
+    // Report repeats whose interval ended; called by Logger::flushRepeats
+    void summarize(int64_t now_ms);
+
+private:
+    const char* level;
+    const char* file;
+    int line;
+    Slot slots[kSlots];
+    std::mutex mutex;
 };
 
 #define LOG_INFO(msg) Logger::getInstance().info(msg)
 #define LOG_ERROR(msg) Logger::getInstance().error(msg)
 #define LOG_DEBUG(msg) Logger::getInstance().debug(msg)
 #define LOG_WARNING(msg) Logger::getInstance().warning(msg)
+
+// For lines that can repeat for every signal or request, such as errors
+// from a misbehaving modem. key separates distinct errors of one call site;
+// msg is only evaluated when the line is written.
+#define LOG_LIMITED(level, key, msg) \
+    do { \
+        static LogLimiter log_limiter_(level, __FILE__, __LINE__); \
+        LogLimiter::Ticket log_ticket_ = log_limiter_.admit(key); \
+        if (log_ticket_.allowed) log_limiter_.write(log_ticket_, msg); \
+    } while (0)
+#define LOG_ERROR_LIMITED(key, msg) LOG_LIMITED("ERROR", key, msg)
+#define LOG_WARNING_LIMITED(key, msg) LOG_LIMITED("WARNING", key, msg)
@@ -13,73 +13,105 @@
  */
 
 #include "sms_monitor.hpp"
+#include "sms_forwarder.hpp"
 #include "wx_pusher.hpp"
+#include "push_scheduler.hpp"
+#include "delivery_tracker.hpp"
 #include "config.hpp"
 #include "logger.hpp"
+#include "sms_archive.hpp"
+#include "sms_sender.hpp"
+#include "send_socket.hpp"
+#include "ingest_socket.hpp"
+#include "network_watcher.hpp"
+#include "aggregator.hpp"
+#include "watchdog.hpp"
+#include "flight_recorder.hpp"
+#include <climits>
+#include <cstdlib>
+#include <ctime>
 #include <iostream>
-#include <regex>
+#include <optional>
 
-// Function to check if a message contains a verification code
-bool isVerificationCode(const std::string& message) {
-    try {
-        if (message.empty()) {
-            LOG_WARNING("Empty message passed to isVerificationCode");
-            return false;
-        }
+// Print archived SMS matching the query options, oldest first
+static int runQuery(const std::string& config_path, const std::string& sender,
+                    int64_t from_ms, int64_t to_ms, long limit) {
+    // Only the archive location is needed, credentials may be missing
+    Config::getInstance().load(config_path);
+    std::string dir = Config::getInstance().getArchiveDir();
+    if (dir.empty()) {
+        std::cerr << "SMS archive is disabled (archive_dir is empty)" << std::endl;
+        return 1;
+    }
 
-        // Simple check for common verification code keywords before using regex
-        // This is faster and less prone to errors
-        if (message.find("\u9a8c\u8bc1\u7801") != std::string::npos ||
-            message.find("code") != std::string::npos ||
-            message.find("Code") != std::string::npos) {
-            return true;
-        }
+    SmsArchive archive(dir);
+    if (!archive.open(false)) {
+        std::cerr << "Cannot open SMS archive in " << dir << std::endl;
+        return 1;
+    }
 
-        // Check for common verification code keywords
-        try {
-            static const std::vector<std::string> keywords = {
-                "\u9a8c\u8bc1\u7801", "\u9a8c\u8bc1\u78bc", "\u6821\u9a8c\u7801", "\u6821\u9a8c\u78bc", "\u52a8\u6001\u7801", "\u52a8\u6001\u78bc",
-                "\u786e\u8ba4\u7801", "\u78ba\u8a8d\u78bc", "\u77ed\u4fe1\u7801", "\u77ed\u4fe1\u78bc", "code", "Code", "CODE"
-            };
-
-            for (const auto& keyword : keywords) {
-                try {
-                    if (message.find(keyword) != std::string::npos) {
-                        // Look for 4-6 digit numbers in the message
-                        try {
-                            std::regex digit_pattern("[0-9]{4,6}");
-                            std::smatch match;
-                            if (std::regex_search(message, match, digit_pattern)) {
-                                return true;
-                            }
-                        } catch (const std::exception& e) {
-                            LOG_ERROR("Exception in digit pattern regex: " + std::string(e.what()));
-                            // If regex fails, assume it's a verification code
-                            return true;
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    LOG_ERROR("Exception in keyword find: " + std::string(e.what()));
-                    // Continue with next keyword
-                }
-            }
-        } catch (const std::exception& e) {
-            LOG_ERROR("Exception in keywords initialization: " + std::string(e.what()));
+    // A sender's history defaults to the last 20 messages, a time range to all of it
+    if (limit < 0) limit = sender.empty() ? 0 : 20;
+
+    for (const auto& record : archive.query(sender, from_ms, to_ms, static_cast<size_t>(limit))) {
+        time_t seconds = static_cast<time_t>(record.archived_ms / 1000);
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+
+        std::string text = record.text;
+        for (size_t pos = text.find('\n'); pos != std::string::npos; pos = text.find('\n', pos + 5)) {
+            text.replace(pos, 1, "\n    ");
         }
 
-        return false;
-    } catch (const std::exception& e) {
-        LOG_ERROR("Exception in isVerificationCode: " + std::string(e.what()));
-        return false;
-    } catch (...) {
-        LOG_ERROR("Unknown exception in isVerificationCode");
-        return false;
+        std::cout << when << "." << std::to_string(1000 + record.archived_ms % 1000).substr(1)
+                  << " [" << SmsArchive::statusName(record.status) << "] " << record.sender
+                  << " (" << record.modem << ", " << record.timestamp << ")\n    " << text << "\n";
     }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
     try {
-        if (!Logger::getInstance().init("/var/log/sms_forward.log")) {
+        std::string config_path = "/etc/sms_forward.conf";
+        std::string log_path = "/var/log/sms_forward.log";
+        bool query = false;
+        bool aggregator = false;
+        std::string query_sender;
+        int64_t query_from = 0;
+        int64_t query_to = LLONG_MAX;
+        long query_limit = -1;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if ((arg == "-c" || arg == "--config") && i + 1 < argc) {
+                config_path = argv[++i];
+            } else if ((arg == "-l" || arg == "--log") && i + 1 < argc) {
+                log_path = argv[++i];
+            } else if (arg == "--aggregator") {
+                aggregator = true;
+            } else if (arg == "--query") {
+                query = true;
+            } else if (arg == "--sender" && i + 1 < argc) {
+                query_sender = argv[++i];
+            } else if (arg == "--from" && i + 1 < argc) {
+                query_from = atoll(argv[++i]);
+            } else if (arg == "--to" && i + 1 < argc) {
+                query_to = atoll(argv[++i]);
+            } else if (arg == "--limit" && i + 1 < argc) {
+                query_limit = atol(argv[++i]);
+            } else {
+                std::cerr << "Usage: " << argv[0] << " [--config <path>] [--log <path>] [--aggregator]\n"
+                          << "       " << argv[0] << " [--config <path>] --query [--sender <number>]"
+                          << " [--from <ms>] [--to <ms>] [--limit <n>]" << std::endl;
+                return 1;
+            }
+        }
+
+        if (query) {
+            return runQuery(config_path, query_sender, query_from, query_to, query_limit);
+        }
+
+        if (!Logger::getInstance().init(log_path)) {
             std::cerr << "Failed to initialize logger" << std::endl;
             return 1;
         }
@@ -112,70 +144,159 @@ int main(int argc, char* argv[]) {
             abort();
         });
 
-        if (!Config::getInstance().load("/etc/sms_forward.conf")) {
+        if (!Config::getInstance().load(config_path)) {
             LOG_ERROR("Failed to load config");
             return 1;
         }
 
-        WxPusher pusher(
-            Config::getInstance().getWxPusherToken(),
-            Config::getInstance().getWxPusherUid()
+        FlightRecorder::getInstance().start(
+            Config::getInstance().getFlightRecorderEvents(),
+            Config::getInstance().getFlightRecorderFile()
+        );
+
+        Watchdog::getInstance().start(
+            Config::getInstance().getWatchdogStallSeconds(),
+            Config::getInstance().getWatchdogRestartSeconds()
         );
 
+        // A fleet node hands its SMS to the aggregator, which pushes them, so
+        // it needs WxPusher credentials and a push queue of its own only for
+        // messages from its ingest socket
+        bool node = !aggregator && !Config::getInstance().getAggregatorAddress().empty();
+        bool pushes = !node || !Config::getInstance().getIngestSocket().empty();
+        if (pushes && (Config::getInstance().getWxPusherToken().empty() ||
+                       Config::getInstance().getWxPusherRecipients().empty())) {
+            LOG_ERROR("Failed to load config: wx_pusher_token and a uid or topic are required");
+            Watchdog::getInstance().stop();
+            return 1;
+        }
+
+        std::optional<WxPusher> pusher;
+        if (pushes) {
+            pusher.emplace(
+                Config::getInstance().getWxPusherToken(),
+                Config::getInstance().getWxPusherRecipients(),
+                Config::getInstance().getWxPusherEndpoint(),
+                Config::getInstance().getWxPusherCaFile(),
+                Config::getInstance().getTlsSessionFile()
+            );
+            pusher->setTemplates(
+                Config::getInstance().getPushSummaryTemplate(),
+                Config::getInstance().getPushCodeSummaryTemplate(),
+                Config::getInstance().getPushContentTemplate()
+            );
+            if (Config::getInstance().getPushHedging()) {
+                pusher->enableHedging(Config::getInstance().getWxPusherSecondaryEndpoint());
+            }
+        }
+
         SmsMonitor monitor;
         if (!monitor.init()) {
             std::cerr << "Failed to init SMS monitor" << std::endl;
             return 1;
         }
 
-        monitor.setCallback([&pusher, &monitor](const std::string& sender, const std::string& content, MMSms* sms) {
-            try {
-                LOG_DEBUG("Callback invoked with sender=" + sender + ", content=" + content);
-
-                // Check if we should only forward verification codes
-                if (Config::getInstance().getOnlyForwardVerificationCodes()) {
-                    // Check if we should only forward verification codes and extract the code if present
-                    bool is_verification = false;
-                    std::string verification_code = "";
-
-                    try {
-                        is_verification = isVerificationCode(content);
-                        LOG_DEBUG("Verification code check: " + std::string(is_verification ? "true" : "false"));
-                    } catch (const std::exception& e) {
-                        LOG_ERROR("Exception in verification code check: " + std::string(e.what()));
-                        // Default to forwarding the message if verification check fails
-                        is_verification = true;
-                    }
-
-                    // Skip non-verification code messages if configured to do so
-                    if (Config::getInstance().getOnlyForwardVerificationCodes() && !is_verification) {
-                        LOG_INFO("Skipping non-verification code SMS from " + sender);
-                        return;
-                    }
-                }
+        // Outlives the scheduler, whose thread polls it
+        DeliveryTracker delivery_tracker(
+            Config::getInstance().getDeliveryPollSeconds(),
+            Config::getInstance().getDeliveryTimeoutSeconds()
+        );
+        std::optional<PushScheduler> scheduler;
+        std::optional<NetworkWatcher> network_watcher;
+        std::optional<SmsForwarder> forwarder;
+        SmsArchive archive(Config::getInstance().getArchiveDir());
+        if (pusher) {
+            scheduler.emplace(
+                *pusher,
+                Config::getInstance().getPushRatePerMinute(),
+                Config::getInstance().getPushBurst()
+            );
+            if (Config::getInstance().getDeliveryPollSeconds() > 0) {
+                scheduler->setDeliveryTracker(&delivery_tracker);
+            }
+            scheduler->start();
 
-                bool forwarding_success = false;
-                try {
-                    forwarding_success = pusher.sendMessage("New SMS from " + sender, content);
-                    LOG_DEBUG("WxPusher sendMessage result: " + std::string(forwarding_success ? "success" : "failure"));
-
-                    // Only delete SMS if forwarding was successful and deletion is enabled
-                    if (forwarding_success && Config::getInstance().getDeleteAfterForwarding() && sms != nullptr) {
-                        if (monitor.deleteSms(sms)) {
-                            LOG_INFO("SMS from " + sender + " deleted after successful forwarding");
-                        } else {
-                            LOG_ERROR("Failed to delete SMS from " + sender + " after forwarding");
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    LOG_ERROR("Exception in WxPusher sendMessage: " + std::string(e.what()));
-                }
-            } catch (const std::exception& e) {
-                LOG_ERROR("Exception in SMS callback: " + std::string(e.what()));
-            } catch (...) {
-                LOG_ERROR("Unknown exception in SMS callback");
+            network_watcher.emplace(*scheduler);
+            if (Config::getInstance().getWatchNetwork() && !network_watcher->start()) {
+                LOG_WARNING("Pushes are not held while the network is down");
             }
-        });
+
+            forwarder.emplace(*scheduler, monitor);
+            if (Config::getInstance().getArchiveDir().empty()) {
+                LOG_INFO("SMS archive disabled");
+            } else if (archive.open(true)) {
+                forwarder->setArchive(&archive);
+            } else {
+                LOG_WARNING("SMS archive unavailable, messages are not archived");
+            }
+            if (!Config::getInstance().getRouteVerificationCodes().empty()) {
+                forwarder->routeVerificationCodes(pusher->addRecipients(Config::getInstance().getRouteVerificationCodes()));
+            }
+            if (!Config::getInstance().getRouteUndeliveredCodes().empty()) {
+                forwarder->routeUndeliveredCodes(pusher->addRecipients(Config::getInstance().getRouteUndeliveredCodes()));
+            }
+            for (const auto& route : Config::getInstance().getSenderRoutes()) {
+                forwarder->routeSender(route.first, pusher->addRecipients(route.second));
+            }
+        }
+
+        AggregatorLink uplink(
+            monitor,
+            node ? Config::getInstance().getAggregatorAddress() : std::string(),
+            Config::getInstance().getNodeName(),
+            Config::getInstance().getAggregatorKey(),
+            Config::getInstance().getAggregatorSpoolFile(),
+            static_cast<size_t>(Config::getInstance().getAggregatorSpoolMaxBytes())
+        );
+        if (node) {
+            if (!uplink.start()) {
+                LOG_ERROR("Failed to set up the aggregator link");
+                Watchdog::getInstance().stop();
+                return 1;
+            }
+            monitor.setCallback([&uplink](SmsRecord record) {
+                uplink.onSms(std::move(record));
+            });
+        } else {
+            monitor.setCallback([&forwarder](SmsRecord record) {
+                forwarder->onSms(std::move(record));
+            });
+        }
+
+        std::optional<AggregatorServer> aggregator_server;
+        if (aggregator) {
+            aggregator_server.emplace(
+                *forwarder,
+                Config::getInstance().getAggregatorListen(),
+                Config::getInstance().getAggregatorKey(),
+                Config::getInstance().getAggregatorDedupSeconds()
+            );
+            if (!aggregator_server->start()) {
+                scheduler->stop();
+                Watchdog::getInstance().stop();
+                return 1;
+            }
+        }
+
+        SmsSender sender(Config::getInstance().getSendIntervalMs(), Config::getInstance().getSendQueueLimit());
+        SendSocket send_socket(sender, Config::getInstance().getSendSocket());
+        if (!Config::getInstance().getSendSocket().empty()) {
+            sender.start();
+            if (!send_socket.start()) {
+                LOG_WARNING("Outbound SMS unavailable, send socket could not be opened");
+            }
+        }
+
+        std::optional<IngestSocket> ingest_socket;
+        if (!Config::getInstance().getIngestSocket().empty()) {
+            ingest_socket.emplace(*forwarder, Config::getInstance().getIngestSocket());
+            if (!ingest_socket->start()) {
+                LOG_WARNING("Message ingest unavailable, ingest socket could not be opened");
+            }
+        }
+
+        // Messages shed to disk before a restart go first
+        if (forwarder) forwarder->drainSpill();
 
         // Check for existing SMS messages after callback is set (if enabled in config)
         if (Config::getInstance().getForwardExistingSms()) {
@@ -187,8 +308,20 @@ int main(int argc, char* argv[]) {
 
         LOG_INFO("SMS Forward service started successfully");
         std::cout << "SMS Forward started" << std::endl;
+        Watchdog::notify("READY=1");
         monitor.run();
 
+        // Stop the scheduler while the forwarder its completions refer to is
+        // alive; pushes still queued fail, and accepted ingested messages spill
+        Watchdog::notify("STOPPING=1");
+        uplink.stop();
+        if (aggregator_server) aggregator_server->stop();
+        if (ingest_socket) ingest_socket->stop();
+        send_socket.stop();
+        sender.stop();
+        if (network_watcher) network_watcher->stop();
+        if (scheduler) scheduler->stop();
+        Watchdog::getInstance().stop();
         return 0;
     } catch (const std::exception& e) {
         LOG_ERROR("Unhandled exception in main: " + std::string(e.what()));
@@ -0,0 +1,73 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "metrics.hpp"
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+void Metrics::setGauge(const std::string& name, double value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    gauges[name] = value;
+    dirty = true;
+}
+
+void Metrics::increment(const std::string& name, double delta) {
+    std::lock_guard<std::mutex> lock(mutex);
+    counters[name] += delta;
+    dirty = true;
+}
+
+static void writeFamily(std::ofstream& out, const std::map<std::string, double>& values, const char* type) {
+    // Samples of one metric must be contiguous, so group them by name without labels
+    std::map<std::string, std::vector<const std::pair<const std::string, double>*>> families;
+    for (const auto& entry : values) {
+        families[entry.first.substr(0, entry.first.find('{'))].push_back(&entry);
+    }
+
+    for (const auto& family : families) {
+        out << "# TYPE " << family.first << " " << type << "\n";
+        for (const auto* sample : family.second) {
+            out << sample->first << " " << sample->second << "\n";
+        }
+    }
+}
+
+bool Metrics::flush(const std::string& path) {
+    if (path.empty()) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dirty) return true;
+
+    // Write to a temporary file and rename so readers never see a partial file
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        if (!out.is_open()) return false;
+        writeFamily(out, counters, "counter");
+        writeFamily(out, gauges, "gauge");
+        if (!out.good()) return false;
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        return false;
+    }
+    dirty = false;
+    return true;
+}
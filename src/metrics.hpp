@@ -0,0 +1,38 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+
+// Process-wide counters and gauges, exported as a Prometheus text file.
+// Metric names may carry labels, e.g. sms_forward_storage_messages{storage="me"}.
+class Metrics {
+public:
+    static Metrics& getInstance();
+
+    void setGauge(const std::string& name, double value);
+    void increment(const std::string& name, double delta = 1.0);
+
+    // Write all metrics to path if anything changed since the last write
+    bool flush(const std::string& path);
+
+private:
+    Metrics() : dirty(false) {}
+    std::mutex mutex;
+    std::map<std::string, double> gauges;
+    std::map<std::string, double> counters;
+    bool dirty;
+};
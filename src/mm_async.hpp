@@ -0,0 +1,205 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <utility>
+#include <ModemManager.h>
+#include <libmm-glib.h>
+#include <gio/gio.h>
+
+// C++20 coroutine adapters over the GAsyncReadyCallback style of GIO and
+// libmm-glib. An operation starts when it is awaited and the coroutine
+// resumes from its callback, i.e. from the dispatch of the main context
+// that was the thread default when it started. All coroutines of a thread
+// therefore run interleaved on that one context, one step at a time,
+// without blocking it and without locks between them.
+
+// Fire-and-forget coroutine. Calling it runs the body up to the first
+// suspension; the frame frees itself when the body finishes. Bodies are
+// expected not to throw.
+struct AsyncTask {
+    struct promise_type {
+        AsyncTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// Outcome of an awaited call. On success the caller owns value (an object
+// reference or variant to release); otherwise error is set.
+template <typename T>
+struct AsyncResult {
+    T value{};
+    GError* error = nullptr;
+
+    AsyncResult() = default;
+    AsyncResult(AsyncResult&& other) noexcept
+        : value(std::exchange(other.value, T{})), error(std::exchange(other.error, nullptr)) {}
+    AsyncResult& operator=(AsyncResult&&) = delete;
+    ~AsyncResult() {
+        if (error) g_error_free(error);
+    }
+
+    bool ok() const { return error == nullptr; }
+    std::string message() const { return error ? error->message : "unknown error"; }
+};
+
+// Awaits one asynchronous call. start(callback, user_data) issues it and
+// finish(source, result) collects its outcome when the callback arrives.
+template <typename Start, typename Finish>
+class GAsyncAwaiter {
+public:
+    GAsyncAwaiter(Start start, Finish finish) : start(std::move(start)), finish(std::move(finish)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        waiting = handle;
+        start(&GAsyncAwaiter::onReady, this);
+    }
+
+    // Runs inside the callback, while source and result are still valid
+    auto await_resume() { return finish(source, result); }
+
+private:
+    static void onReady(GObject* source, GAsyncResult* result, gpointer user_data) {
+        auto* self = static_cast<GAsyncAwaiter*>(user_data);
+        self->source = source;
+        self->result = result;
+        // The awaiter may be gone once the coroutine moves on
+        self->waiting.resume();
+    }
+
+    Start start;
+    Finish finish;
+    std::coroutine_handle<> waiting;
+    GObject* source = nullptr;
+    GAsyncResult* result = nullptr;
+};
+
+template <typename Start, typename Finish>
+GAsyncAwaiter<Start, Finish> awaitAsync(Start start, Finish finish) {
+    return GAsyncAwaiter<Start, Finish>(std::move(start), std::move(finish));
+}
+
+// Resumes after a delay, without blocking the thread's main context
+class SleepAwaiter {
+public:
+    explicit SleepAwaiter(guint delay_ms) : delay_ms(delay_ms) {}
+
+    bool await_ready() const noexcept { return delay_ms == 0; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        waiting = handle;
+        GSource* timer = g_timeout_source_new(delay_ms);
+        g_source_set_callback(timer, onTimeout, this, nullptr);
+        g_source_attach(timer, g_main_context_get_thread_default());
+        g_source_unref(timer);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    static gboolean onTimeout(gpointer user_data) {
+        static_cast<SleepAwaiter*>(user_data)->waiting.resume();
+        return G_SOURCE_REMOVE;
+    }
+
+    guint delay_ms;
+    std::coroutine_handle<> waiting;
+};
+
+inline SleepAwaiter sleepFor(guint delay_ms) {
+    return SleepAwaiter(delay_ms);
+}
+
+// Method call on a ModemManager object; the reply is a tuple of reply_type
+inline auto callModemManager(GDBusConnection* bus, std::string object_path, const char* interface,
+                             const char* method, GVariant* parameters, const GVariantType* reply_type,
+                             int timeout_ms) {
+    return awaitAsync(
+        [=, object_path = std::move(object_path)](GAsyncReadyCallback callback, gpointer user_data) {
+            g_dbus_connection_call(bus, MM_DBUS_SERVICE, object_path.c_str(), interface, method, parameters,
+                                   reply_type, G_DBUS_CALL_FLAGS_NONE, timeout_ms, nullptr, callback, user_data);
+        },
+        [](GObject* source, GAsyncResult* result) {
+            AsyncResult<GVariant*> outcome;
+            outcome.value = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &outcome.error);
+            return outcome;
+        });
+}
+
+// ObjectManager.GetManagedObjects on ModemManager, a (a{oa{sa{sv}}})
+inline auto getManagedObjects(GDBusConnection* bus) {
+    return callModemManager(bus, MM_DBUS_PATH, "org.freedesktop.DBus.ObjectManager", "GetManagedObjects",
+                            nullptr, G_VARIANT_TYPE("(a{oa{sa{sv}}})"), 10000);
+}
+
+// Messaging.Create, yielding the new SMS object
+inline auto messagingCreate(MMModemMessaging* messaging, MMSmsProperties* properties) {
+    return awaitAsync(
+        [=](GAsyncReadyCallback callback, gpointer user_data) {
+            mm_modem_messaging_create(messaging, properties, nullptr, callback, user_data);
+        },
+        [](GObject* source, GAsyncResult* result) {
+            AsyncResult<MMSms*> outcome;
+            outcome.value = mm_modem_messaging_create_finish(MM_MODEM_MESSAGING(source), result, &outcome.error);
+            return outcome;
+        });
+}
+
+// Sms.Send
+inline auto smsSend(MMSms* sms) {
+    return awaitAsync(
+        [=](GAsyncReadyCallback callback, gpointer user_data) {
+            mm_sms_send(sms, nullptr, callback, user_data);
+        },
+        [](GObject* source, GAsyncResult* result) {
+            AsyncResult<bool> outcome;
+            outcome.value = mm_sms_send_finish(MM_SMS(source), result, &outcome.error);
+            return outcome;
+        });
+}
+
+// Messaging.Delete
+inline auto messagingDelete(MMModemMessaging* messaging, std::string sms_path) {
+    return awaitAsync(
+        [=, sms_path = std::move(sms_path)](GAsyncReadyCallback callback, gpointer user_data) {
+            mm_modem_messaging_delete(messaging, sms_path.c_str(), nullptr, callback, user_data);
+        },
+        [](GObject* source, GAsyncResult* result) {
+            AsyncResult<bool> outcome;
+            outcome.value = mm_modem_messaging_delete_finish(MM_MODEM_MESSAGING(source), result, &outcome.error);
+            return outcome;
+        });
+}
+
+// Collect the standard output of a process started with a stdout pipe
+inline auto subprocessCommunicate(GSubprocess* process) {
+    return awaitAsync(
+        [=](GAsyncReadyCallback callback, gpointer user_data) {
+            g_subprocess_communicate_utf8_async(process, nullptr, nullptr, callback, user_data);
+        },
+        [](GObject* source, GAsyncResult* result) {
+            AsyncResult<gchar*> outcome;
+            g_subprocess_communicate_utf8_finish(G_SUBPROCESS(source), result, &outcome.value, nullptr,
+                                                 &outcome.error);
+            return outcome;
+        });
+}
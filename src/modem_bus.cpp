@@ -0,0 +1,51 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "modem_bus.hpp"
+#include "config.hpp"
+
+DBusConnection* openModemBus(DBusError* error) {
+    std::string address = Config::getInstance().getDbusAddress();
+    if (address.empty()) {
+        return dbus_bus_get(DBUS_BUS_SYSTEM, error);
+    }
+
+    DBusConnection* connection = dbus_connection_open(address.c_str(), error);
+    if (!connection) {
+        return nullptr;
+    }
+
+    // Send Hello so the connection gets a unique name and can receive signals
+    if (!dbus_bus_register(connection, error)) {
+        dbus_connection_unref(connection);
+        return nullptr;
+    }
+    return connection;
+}
+
+GDBusConnection* openModemBusGio(GError** error) {
+    std::string address = Config::getInstance().getDbusAddress();
+    if (address.empty()) {
+        return g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, error);
+    }
+
+    return g_dbus_connection_new_for_address_sync(
+        address.c_str(),
+        static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+        nullptr,  // observer
+        nullptr,  // cancellable
+        error
+    );
+}
@@ -0,0 +1,25 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include <dbus/dbus.h>
+#include <gio/gio.h>
+
+// Connect to the bus ModemManager lives on. This is the system bus unless
+// dbus_address is configured, e.g. to talk to the mock ModemManager on a
+// private session bus. Release the result with dbus_connection_unref.
+DBusConnection* openModemBus(DBusError* error);
+
+// GDBus counterpart of openModemBus. Release the result with g_object_unref.
+GDBusConnection* openModemBusGio(GError** error);
@@ -0,0 +1,294 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "modem_mirror.hpp"
+#include "logger.hpp"
+#include "modem_bus.hpp"
+#include <ModemManager.h>
+#include <algorithm>
+#include <utility>
+#include <gio/gio.h>
+
+ModemMirror::ModemMirror() : bus(nullptr) {}
+
+ModemMirror::~ModemMirror() {
+    if (bus) {
+        g_object_unref(bus);
+    }
+}
+
+bool ModemMirror::ensureBus() {
+    if (bus) return true;
+
+    GError* error = nullptr;
+    bus = openModemBusGio(&error);
+    if (error) {
+        LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
+        g_error_free(error);
+        bus = nullptr;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Property reads kept in flight at once; the bus limits pending replies
+// per connection, so very large storages are fetched in windows
+const size_t kMaxInFlight = 64;
+
+} // namespace
+
+ModemMirror::Fetch::Fetch(GDBusConnection* bus, std::vector<SmsRecord>& records, std::vector<size_t> pending,
+                          bool ok)
+    : bus(bus), records(records), pending(std::move(pending)), next(0), outstanding(0), ok(ok) {}
+
+void ModemMirror::Fetch::await_suspend(std::coroutine_handle<> handle) {
+    waiting = handle;
+    issue();
+}
+
+bool ModemMirror::Fetch::await_resume() {
+    // Replay in arrival order
+    std::sort(records.begin(), records.end(), [](const SmsRecord& a, const SmsRecord& b) {
+        return a.timestamp < b.timestamp;
+    });
+    return ok;
+}
+
+void ModemMirror::Fetch::issue() {
+    while (next < pending.size() && outstanding < kMaxInFlight) {
+        size_t index = pending[next++];
+        outstanding++;
+        g_dbus_connection_call(bus, MM_DBUS_SERVICE, records[index].path.data(),
+                               "org.freedesktop.DBus.Properties", "GetAll",
+                               g_variant_new("(s)", MM_DBUS_INTERFACE_SMS), G_VARIANT_TYPE("(a{sv})"),
+                               G_DBUS_CALL_FLAGS_NONE, 5000, nullptr, onReady,
+                               new std::pair<Fetch*, size_t>(this, index));
+    }
+}
+
+void ModemMirror::Fetch::onReady(GObject* source, GAsyncResult* result, gpointer user_data) {
+    auto* call = static_cast<std::pair<Fetch*, size_t>*>(user_data);
+    Fetch* fetch = call->first;
+    SmsRecord& record = fetch->records[call->second];
+    delete call;
+
+    GError* error = nullptr;
+    GVariant* reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+    if (error) {
+        LOG_WARNING_LIMITED(error->message,
+                            "Failed to read SMS " + std::string(record.path) + ": " + std::string(error->message));
+        g_error_free(error);
+    } else {
+        GVariant* properties = g_variant_get_child_value(reply, 0);
+        ModemMirror::decodeSms(properties, record);
+        g_variant_unref(properties);
+        g_variant_unref(reply);
+    }
+
+    fetch->outstanding--;
+    fetch->issue();
+    // The fetch lives in the coroutine frame and is gone once it resumes
+    if (fetch->outstanding == 0) fetch->waiting.resume();
+}
+
+void ModemMirror::decodeSms(GVariant* properties, SmsRecord& record) {
+    guint32 value = 0;
+    gint32 sms_class = 0;
+    const gchar* str = nullptr;
+    if (g_variant_lookup(properties, "State", "u", &value)) record.state = static_cast<MMSmsState>(value);
+    if (g_variant_lookup(properties, "Storage", "u", &value)) record.storage = static_cast<MMSmsStorage>(value);
+    if (g_variant_lookup(properties, "Class", "i", &sms_class)) record.sms_class = sms_class;
+    // The strings belong to the variant; the record keeps copies in its arena
+    if (g_variant_lookup(properties, "Number", "&s", &str)) record.number = record.keep(str);
+    if (g_variant_lookup(properties, "Text", "&s", &str)) record.text = record.keep(str);
+    if (g_variant_lookup(properties, "Timestamp", "&s", &str)) record.timestamp = record.keep(str);
+    if (g_variant_lookup(properties, "SMSC", "&s", &str)) record.smsc = record.keep(str);
+}
+
+void ModemMirror::loadManagedObjects(GVariant* objects, std::vector<SmsRecord>* records,
+                                     std::vector<size_t>* pending) {
+    std::set<std::string> listed;
+    std::unordered_map<std::string, size_t> decoded; // SMS path -> record index
+    auto arena = records ? std::make_shared<SmsArena>() : nullptr;
+
+    // Modems carry the paths of their messages in the Messages property.
+    // ModemManager exports SMS objects outside the ObjectManager, but their
+    // properties are taken from here too when an implementation includes them.
+    GVariantIter object_iter;
+    const gchar* object_path = nullptr;
+    GVariant* interfaces = nullptr;
+    g_variant_iter_init(&object_iter, objects);
+    while (g_variant_iter_next(&object_iter, "{&o@a{sa{sv}}}", &object_path, &interfaces)) {
+        GVariant* messaging = g_variant_lookup_value(interfaces, MM_DBUS_INTERFACE_MODEM_MESSAGING, G_VARIANT_TYPE_VARDICT);
+        if (messaging) {
+            std::vector<std::string> paths;
+            GVariant* messages = g_variant_lookup_value(messaging, "Messages", G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+            if (messages) {
+                gsize count = 0;
+                const gchar** list = g_variant_get_objv(messages, &count);
+                for (gsize i = 0; i < count; i++) {
+                    paths.push_back(list[i]);
+                }
+                g_free(list);
+                g_variant_unref(messages);
+            }
+            addModem(object_path, paths);
+            listed.insert(object_path);
+            g_variant_unref(messaging);
+        }
+
+        GVariant* sms = records ? g_variant_lookup_value(interfaces, MM_DBUS_INTERFACE_SMS, G_VARIANT_TYPE_VARDICT) : nullptr;
+        if (sms) {
+            SmsRecord record(arena, object_path, "");
+            decodeSms(sms, record);
+            decoded[object_path] = records->size();
+            records->push_back(std::move(record));
+            g_variant_unref(sms);
+        }
+        g_variant_unref(interfaces);
+    }
+
+    for (const auto& modem_path : modemPaths()) {
+        if (!listed.count(modem_path)) removeModem(modem_path);
+    }
+    if (!records) return;
+
+    // Every mirrored SMS gets a record; the ones not decoded above are fetched
+    for (const auto& entry : sms_owner) {
+        auto it = decoded.find(entry.first);
+        if (it != decoded.end()) {
+            SmsRecord& record = (*records)[it->second];
+            record.modem_path = record.keep(entry.second);
+            continue;
+        }
+        pending->push_back(records->size());
+        records->emplace_back(arena, entry.first, entry.second);
+    }
+}
+
+ModemMirror::Fetch ModemMirror::fetchRecords(const std::string& modem_path, const std::vector<std::string>& sms_paths,
+                                             std::vector<SmsRecord>& records) {
+    records.clear();
+    if (!ensureBus()) return Fetch(nullptr, records, {}, false);
+
+    auto arena = std::make_shared<SmsArena>();
+    std::vector<size_t> pending;
+    for (const auto& path : sms_paths) {
+        pending.push_back(records.size());
+        records.emplace_back(arena, path, modem_path);
+    }
+    return Fetch(bus, records, std::move(pending), true);
+}
+
+void ModemMirror::clear() {
+    modems.clear();
+    sms_owner.clear();
+}
+
+void ModemMirror::seed(GVariant* objects) {
+    loadManagedObjects(objects, nullptr, nullptr);
+
+    LOG_INFO("Mirrored " + std::to_string(modems.size()) + " modems holding " +
+             std::to_string(sms_owner.size()) + " SMS");
+}
+
+ModemMirror::Fetch ModemMirror::snapshot(GVariant* objects, std::vector<SmsRecord>& records) {
+    records.clear();
+    if (!ensureBus()) return Fetch(nullptr, records, {}, false);
+
+    std::vector<size_t> pending;
+    loadManagedObjects(objects, &records, &pending);
+
+    LOG_INFO("Snapshot of " + std::to_string(records.size()) + " SMS on " +
+             std::to_string(modems.size()) + " modems");
+    return Fetch(bus, records, std::move(pending), true);
+}
+
+std::string ModemMirror::ownerOf(const std::string& sms_path) const {
+    auto it = sms_owner.find(sms_path);
+    return it == sms_owner.end() ? std::string() : it->second;
+}
+
+std::vector<std::string> ModemMirror::messagesOf(const std::string& modem_path) const {
+    auto it = modems.find(modem_path);
+    if (it == modems.end()) return {};
+    return std::vector<std::string>(it->second.begin(), it->second.end());
+}
+
+std::vector<std::string> ModemMirror::modemPaths() const {
+    std::vector<std::string> paths;
+    for (const auto& modem : modems) {
+        paths.push_back(modem.first);
+    }
+    return paths;
+}
+
+bool ModemMirror::addSms(const std::string& modem_path, const std::string& sms_path) {
+    if (!sms_owner.emplace(sms_path, modem_path).second) return false;
+    modems[modem_path].insert(sms_path);
+    return true;
+}
+
+void ModemMirror::removeSms(const std::string& sms_path) {
+    auto it = sms_owner.find(sms_path);
+    if (it == sms_owner.end()) return;
+
+    auto modem = modems.find(it->second);
+    if (modem != modems.end()) {
+        modem->second.erase(sms_path);
+    }
+    sms_owner.erase(it);
+}
+
+void ModemMirror::addModem(const std::string& modem_path, const std::vector<std::string>& sms_paths) {
+    modems[modem_path];
+    for (const auto& path : sms_paths) {
+        addSms(modem_path, path);
+    }
+    LOG_DEBUG("Mirror added modem " + modem_path + " with " + std::to_string(sms_paths.size()) + " SMS");
+}
+
+void ModemMirror::removeModem(const std::string& modem_path) {
+    auto it = modems.find(modem_path);
+    if (it == modems.end()) return;
+
+    for (const auto& path : it->second) {
+        sms_owner.erase(path);
+    }
+    modems.erase(it);
+    LOG_DEBUG("Mirror removed modem " + modem_path);
+}
+
+std::vector<std::string> ModemMirror::reconcileModem(const std::string& modem_path, GVariant* messages) {
+    std::vector<std::string> added;
+    std::set<std::string> current;
+    gsize count = 0;
+    const gchar** list = g_variant_get_objv(messages, &count);
+    for (gsize i = 0; i < count; i++) {
+        current.insert(list[i]);
+        if (addSms(modem_path, list[i])) {
+            added.push_back(list[i]);
+        }
+    }
+    g_free(list);
+
+    // Drop paths the modem no longer reports, in case a Deleted was missed
+    for (const auto& path : messagesOf(modem_path)) {
+        if (!current.count(path)) removeSms(path);
+    }
+    return added;
+}
@@ -0,0 +1,113 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include "sms_record.hpp"
+#include <coroutine>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <libmm-glib.h>
+
+// In-memory copy of the ModemManager object tree: which modems exist and
+// which SMS objects each one holds. It is seeded from a GetManagedObjects
+// reply the monitor awaits and then kept current from the ObjectManager and
+// Messaging signals it receives, so every event only costs work for the
+// objects it names. The mirror itself never waits on the bus. Used from the
+// monitor thread only.
+class ModemMirror {
+public:
+    // Awaitable property reads of the records that still lack them, a
+    // window at a time, answered through the thread's main context. The
+    // awaiting coroutine resumes once every read has finished, with false
+    // if the records could not be listed; they are then sorted by
+    // timestamp. records must outlive the await.
+    class Fetch {
+    public:
+        Fetch(GDBusConnection* bus, std::vector<SmsRecord>& records, std::vector<size_t> pending, bool ok);
+        Fetch(const Fetch&) = delete;
+        Fetch& operator=(const Fetch&) = delete;
+
+        bool await_ready() const noexcept { return !ok || pending.empty(); }
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume();
+
+    private:
+        static void onReady(GObject* source, GAsyncResult* result, gpointer user_data);
+        void issue();
+
+        GDBusConnection* bus;
+        std::vector<SmsRecord>& records;
+        std::vector<size_t> pending; // Indexes of records still to fetch
+        size_t next;
+        size_t outstanding;
+        bool ok;
+        std::coroutine_handle<> waiting;
+    };
+
+    ModemMirror();
+    ~ModemMirror();
+
+    // Load the modem list and their message paths from a GetManagedObjects
+    // reply. Modems missing from it are dropped; SMS that signals added
+    // while it was on its way are kept.
+    void seed(GVariant* objects);
+
+    // Seed the same way and decode the properties of every stored SMS into
+    // records, issuing all property reads at once instead of one round trip
+    // per SMS
+    Fetch snapshot(GVariant* objects, std::vector<SmsRecord>& records);
+
+    // Decode the given SMS of one modem the same way, without re-seeding
+    Fetch fetchRecords(const std::string& modem_path, const std::vector<std::string>& sms_paths,
+                       std::vector<SmsRecord>& records);
+
+    // Forget everything, e.g. when ModemManager went away
+    void clear();
+
+    // Shared GDBus connection for asynchronous reads, nullptr if unavailable
+    GDBusConnection* connection() { return ensureBus() ? bus : nullptr; }
+
+    // Fill record from an a{sv} of SMS properties
+    static void decodeSms(GVariant* properties, SmsRecord& record);
+
+    bool hasSms(const std::string& sms_path) const { return sms_owner.count(sms_path) > 0; }
+    std::string ownerOf(const std::string& sms_path) const;
+    size_t smsCount() const { return sms_owner.size(); }
+
+    // Message paths currently known for a modem
+    std::vector<std::string> messagesOf(const std::string& modem_path) const;
+    std::vector<std::string> modemPaths() const;
+
+    // Deltas from signals. addSms returns false if the SMS was already known.
+    bool addSms(const std::string& modem_path, const std::string& sms_path);
+    void removeSms(const std::string& sms_path);
+    void addModem(const std::string& modem_path, const std::vector<std::string>& sms_paths);
+    void removeModem(const std::string& modem_path);
+
+    // Bring one modem's message list in line with its Messages property
+    // (an array of object paths) and return the paths not mirrored yet
+    std::vector<std::string> reconcileModem(const std::string& modem_path, GVariant* messages);
+
+private:
+    bool ensureBus();
+    void loadManagedObjects(GVariant* objects, std::vector<SmsRecord>* records, std::vector<size_t>* pending);
+
+    GDBusConnection* bus;
+    std::map<std::string, std::set<std::string>> modems; // Modem path -> SMS paths
+    std::unordered_map<std::string, std::string> sms_owner; // SMS path -> modem path
+};
@@ -0,0 +1,256 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "network_watcher.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Routes and addresses change in bursts while a link comes up; the table
+// is read once the burst has settled
+const int kSettleMs = 200;
+const size_t kBufferBytes = 16384;
+
+// Whether a route message is a default route in the main table
+bool isDefaultRoute(const nlmsghdr* header) {
+    const rtmsg* route = static_cast<const rtmsg*>(NLMSG_DATA(header));
+    if (route->rtm_dst_len != 0 || route->rtm_type != RTN_UNICAST) return false;
+    if (route->rtm_flags & RTM_F_CLONED) return false;
+
+    unsigned table = route->rtm_table;
+    int length = RTM_PAYLOAD(header);
+    for (const rtattr* attr = RTM_RTA(route); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+        if (attr->rta_type == RTA_TABLE) table = *static_cast<const unsigned*>(RTA_DATA(attr));
+    }
+    return table == RT_TABLE_MAIN;
+}
+
+// Address changes that could strand a connection; host and link scoped
+// addresses never carry traffic to WxPusher
+bool isRoutableAddress(const nlmsghdr* header) {
+    const ifaddrmsg* address = static_cast<const ifaddrmsg*>(NLMSG_DATA(header));
+    return address->ifa_scope == RT_SCOPE_UNIVERSE;
+}
+
+} // namespace
+
+NetworkWatcher::NetworkWatcher(PushScheduler& scheduler)
+    : scheduler(scheduler), sock(-1), wake_pipe{-1, -1}, running(false), online(true),
+      addresses_changed(false) {}
+
+NetworkWatcher::~NetworkWatcher() {
+    stop();
+}
+
+bool NetworkWatcher::start() {
+    if (running) return true;
+
+    sock = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0 || pipe2(wake_pipe, O_CLOEXEC) != 0) {
+        LOG_WARNING("Cannot watch the network, netlink unavailable: " + std::string(strerror(errno)));
+        stop();
+        return false;
+    }
+
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        LOG_WARNING("Cannot watch the network, netlink bind failed: " + std::string(strerror(errno)));
+        stop();
+        return false;
+    }
+
+    // Subscribed first, so no change between the first read and the loop is missed
+    bool known = false;
+    online = hasDefaultRoute(known) || !known;
+    if (!online) scheduler.setNetworkUp(false);
+    Metrics::getInstance().setGauge("sms_forward_network_up", online ? 1 : 0);
+
+    running = true;
+    worker = std::thread(&NetworkWatcher::watchLoop, this);
+    LOG_INFO(std::string("Watching the routing table, ") + (online ? "default route present" : "no default route"));
+    return true;
+}
+
+void NetworkWatcher::stop() {
+    if (running.exchange(false)) {
+        char byte = 0;
+        if (write(wake_pipe[1], &byte, 1) < 0) {
+            LOG_WARNING("Failed to wake network watcher thread");
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    if (sock >= 0) close(sock);
+    if (wake_pipe[0] >= 0) close(wake_pipe[0]);
+    if (wake_pipe[1] >= 0) close(wake_pipe[1]);
+    sock = -1;
+    wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+bool NetworkWatcher::hasDefaultRoute(bool& known) {
+    known = false;
+
+    // A dump on its own socket, so replies do not mix with notifications
+    int dump = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (dump < 0) {
+        LOG_WARNING("Cannot read the routing table: " + std::string(strerror(errno)));
+        return false;
+    }
+    timeval timeout{1, 0};
+    setsockopt(dump, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct {
+        nlmsghdr header;
+        rtmsg route;
+    } request{};
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+    request.header.nlmsg_type = RTM_GETROUTE;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = 1;
+    request.route.rtm_family = AF_UNSPEC;
+
+    bool found = false;
+    if (send(dump, &request, request.header.nlmsg_len, 0) < 0) {
+        LOG_WARNING("Cannot read the routing table: " + std::string(strerror(errno)));
+        close(dump);
+        return false;
+    }
+
+    char buffer[kBufferBytes];
+    bool done = false;
+    while (!done) {
+        ssize_t n = recv(dump, buffer, sizeof(buffer), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_WARNING("Reading the routing table failed: " + std::string(strerror(errno)));
+            close(dump);
+            return false;
+        }
+
+        int length = static_cast<int>(n);
+        for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type == NLMSG_ERROR) {
+                LOG_WARNING("Kernel refused to dump the routing table");
+                close(dump);
+                return false;
+            }
+            if (header->nlmsg_type == NLMSG_DONE) {
+                done = true;
+                break;
+            }
+            if (header->nlmsg_type == RTM_NEWROUTE && isDefaultRoute(header)) found = true;
+        }
+        if (n == 0) done = true;
+    }
+
+    close(dump);
+    known = true;
+    return found;
+}
+
+void NetworkWatcher::evaluate() {
+    bool known = false;
+    bool up = hasDefaultRoute(known);
+    // Without a readable table pushes are better attempted than held
+    if (!known) up = true;
+
+    if (up != online) {
+        online = up;
+        if (up) {
+            LOG_INFO("Default route is back, sending queued pushes");
+        } else {
+            LOG_WARNING("No default route, holding pushes until the network returns");
+        }
+        Metrics::getInstance().increment(std::string("sms_forward_network_changes_total{state=\"") +
+                                         (up ? "up" : "down") + "\"}");
+        // Coming back reconnects anyway
+        scheduler.setNetworkUp(up);
+        addresses_changed = false;
+    } else if (up && addresses_changed) {
+        LOG_INFO("Local addresses changed, reconnecting to WxPusher");
+        scheduler.requestReconnect();
+        addresses_changed = false;
+    }
+}
+
+void NetworkWatcher::watchLoop() {
+    char buffer[kBufferBytes];
+    bool pending = false;
+
+    while (running) {
+        pollfd fds[2] = {{sock, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+        int ready = poll(fds, 2, pending ? kSettleMs : -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Network watcher poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        if (!running) break;
+
+        if (ready == 0) {
+            pending = false;
+            evaluate();
+            continue;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        while (true) {
+            ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                // Notifications were dropped; assume the worst and read the table again
+                if (errno == ENOBUFS) {
+                    pending = true;
+                    addresses_changed = true;
+                    continue;
+                }
+                break;
+            }
+
+            int length = static_cast<int>(n);
+            for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, length);
+                 header = NLMSG_NEXT(header, length)) {
+                switch (header->nlmsg_type) {
+                case RTM_NEWROUTE:
+                case RTM_DELROUTE:
+                    if (isDefaultRoute(header)) pending = true;
+                    break;
+                case RTM_NEWADDR:
+                case RTM_DELADDR:
+                    if (isRoutableAddress(header)) {
+                        pending = true;
+                        addresses_changed = true;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+    }
+}
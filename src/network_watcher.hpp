@@ -0,0 +1,48 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include "push_scheduler.hpp"
+#include <atomic>
+#include <thread>
+
+// Follows the kernel routing table over rtnetlink and tells the push
+// scheduler whether a default route exists. Pushes are held while there is
+// none and sent as soon as one appears. When the local addresses change
+// while online, e.g. after the LTE bearer reconnected, the scheduler drops
+// connections bound to the old address.
+class NetworkWatcher {
+public:
+    explicit NetworkWatcher(PushScheduler& scheduler);
+    ~NetworkWatcher();
+
+    // Returns false if netlink is unavailable; pushes are then never held
+    bool start();
+    void stop();
+
+private:
+    void watchLoop();
+    bool hasDefaultRoute(bool& known);
+    void evaluate();
+
+    PushScheduler& scheduler;
+    int sock;
+    int wake_pipe[2];
+    std::thread worker;
+    std::atomic<bool> running;
+
+    // Only touched by the worker thread
+    bool online;
+    bool addresses_changed;
+};
@@ -0,0 +1,45 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// USDT probes for tracing the pipeline with bpftrace or perf on production
+// builds. Every probe takes the trace id of the SMS first, then sizes or
+// outcomes; see tools/bpftrace for the probe list and example scripts.
+// Without SMS_FORWARD_USDT (no sys/sdt.h) they compile to nothing, but
+// still use their arguments so those do not become unused.
+#ifdef SMS_FORWARD_USDT
+#include <sys/sdt.h>
+#define SMS_PROBE1(name, a) DTRACE_PROBE1(sms_forward, name, a)
+#define SMS_PROBE2(name, a, b) DTRACE_PROBE2(sms_forward, name, a, b)
+#define SMS_PROBE3(name, a, b, c) DTRACE_PROBE3(sms_forward, name, a, b, c)
+#else
+#define SMS_PROBE1(name, a) do { (void)(a); } while (0)
+#define SMS_PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#define SMS_PROBE3(name, a, b, c) do { (void)(a); (void)(b); (void)(c); } while (0)
+#endif
+
+// Identifies one SMS across probes: FNV-1a of its D-Bus path, 0 if unknown
+inline uint64_t smsTraceId(std::string_view sms_path) {
+    if (sms_path.empty()) return 0;
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : sms_path) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,360 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "push_scheduler.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "watchdog.hpp"
+#include <algorithm>
+
+PushScheduler::PushScheduler(WxPusher& pusher, int rate_per_minute, int burst)
+    : pusher(pusher), tracker(nullptr), running(false), warm_up_requested(true), reconnect_requested(false), network_up(true),
+      base_rate(rate_per_minute / 60.0), current_rate(rate_per_minute / 60.0),
+      burst(burst), tokens(burst), last_refill(std::chrono::steady_clock::now()),
+      max_messages(0), max_bytes(0), max_retries(0), evict_for_codes(false),
+      queued_messages(0), queued_bytes(0),
+      next_push_id(static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())) {}
+
+PushScheduler::~PushScheduler() {
+    stop();
+}
+
+void PushScheduler::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    running = true;
+    worker = std::thread(&PushScheduler::workerLoop, this);
+    LOG_INFO("Push scheduler started (" + std::to_string(base_rate * 60.0) + "/min, burst " +
+             std::to_string(static_cast<int>(burst)) + ")");
+}
+
+void PushScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    std::vector<Job> left;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& lane : lanes) {
+            for (auto& job : lane) left.push_back(std::move(job));
+            lane.clear();
+        }
+        queued_messages = 0;
+        queued_bytes = 0;
+    }
+    if (left.empty()) return;
+
+    LOG_WARNING("Push scheduler stopped with " + std::to_string(left.size()) + " pending pushes");
+    for (auto& job : left) {
+        if (job.done) job.done(false);
+    }
+}
+
+bool PushScheduler::isRunning() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+}
+
+void PushScheduler::setBudget(size_t messages, size_t bytes, int retries, bool evict) {
+    std::lock_guard<std::mutex> lock(mutex);
+    max_messages = messages;
+    max_bytes = bytes;
+    max_retries = retries;
+    evict_for_codes = evict;
+}
+
+void PushScheduler::setDeliveryTracker(DeliveryTracker* delivery_tracker) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tracker = delivery_tracker;
+}
+
+bool PushScheduler::fits(size_t bytes) const {
+    return (max_messages == 0 || queued_messages + 1 <= max_messages) &&
+           (max_bytes == 0 || queued_bytes + bytes <= max_bytes);
+}
+
+bool PushScheduler::evictOne(std::vector<Job>& evicted) {
+    // Newest first, from the least urgent lane, skipping pushes that must not be shed
+    for (int i = kLaneCount - 1; i > static_cast<int>(Lane::VerificationCode); i--) {
+        for (auto it = lanes[i].rbegin(); it != lanes[i].rend(); ++it) {
+            if (!it->shed) continue;
+            queued_messages--;
+            queued_bytes -= it->message.bytes();
+            evicted.push_back(std::move(*it));
+            lanes[i].erase(std::next(it).base());
+            return true;
+        }
+    }
+    return false;
+}
+
+int PushScheduler::pendingRetries() const {
+    int retries = 0;
+    for (const auto& lane : lanes) {
+        for (const auto& job : lane) {
+            if (job.attempts > 0) retries++;
+        }
+    }
+    return retries;
+}
+
+void PushScheduler::publishLoad() {
+    Metrics::getInstance().setGauge("sms_forward_push_queue_messages", static_cast<double>(queued_messages));
+    Metrics::getInstance().setGauge("sms_forward_push_queue_bytes", static_cast<double>(queued_bytes));
+}
+
+bool PushScheduler::hasRoom(double fraction) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (max_messages == 0 || queued_messages < max_messages * fraction) &&
+           (max_bytes == 0 || queued_bytes < max_bytes * fraction);
+}
+
+bool PushScheduler::submit(Lane lane, PushMessage message, Completion done,
+                           Shed shed, uint64_t trace_id, size_t recipients, Delivered delivered) {
+    size_t bytes = message.bytes();
+    std::vector<Job> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!fits(bytes)) {
+            // Only verification codes may push others out, and only if that makes room
+            size_t evictable_messages = 0, evictable_bytes = 0;
+            if (evict_for_codes && lane == Lane::VerificationCode) {
+                for (int i = static_cast<int>(Lane::Normal); i < kLaneCount; i++) {
+                    for (const auto& job : lanes[i]) {
+                        if (!job.shed) continue;
+                        evictable_messages++;
+                        evictable_bytes += job.message.bytes();
+                    }
+                }
+            }
+            bool room = (max_messages == 0 || queued_messages - evictable_messages + 1 <= max_messages) &&
+                        (max_bytes == 0 || queued_bytes - evictable_bytes + bytes <= max_bytes);
+            if (!room) {
+                LOG_DEBUG("Push refused, queue holds " + std::to_string(queued_messages) + " messages, " +
+                          std::to_string(queued_bytes) + " bytes");
+                return false;
+            }
+            while (!fits(bytes) && evictOne(evicted)) {}
+        }
+
+        queued_messages++;
+        queued_bytes += bytes;
+        lanes[static_cast<int>(lane)].push_back(
+            Job{std::move(message), std::move(done), std::move(shed), 0, trace_id, recipients, ++next_push_id,
+                std::move(delivered)});
+        publishLoad();
+        LOG_DEBUG("Queued push in lane " + std::to_string(static_cast<int>(lane)) +
+                  ", tokens available: " + std::to_string(tokens));
+    }
+    cv.notify_one();
+
+    for (auto& job : evicted) {
+        LOG_WARNING("Evicted a queued push to make room for a verification code");
+        Metrics::getInstance().increment("sms_forward_shed_total{action=\"evicted\"}");
+        job.shed();
+    }
+    return true;
+}
+
+void PushScheduler::requestWarmUp() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        warm_up_requested = true;
+    }
+    cv.notify_one();
+}
+
+void PushScheduler::setNetworkUp(bool up) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (up == network_up) return;
+        network_up = up;
+        pusher.suspend(!up);
+        // Pooled connections did not survive the outage
+        if (up) reconnect_requested = true;
+    }
+    Metrics::getInstance().setGauge("sms_forward_network_up", up ? 1 : 0);
+    cv.notify_one();
+}
+
+void PushScheduler::requestReconnect() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reconnect_requested = true;
+    }
+    cv.notify_one();
+}
+
+void PushScheduler::refill(std::chrono::steady_clock::time_point now) {
+    std::chrono::duration<double> elapsed = now - last_refill;
+    tokens = std::min(burst, tokens + elapsed.count() * current_rate);
+    last_refill = now;
+}
+
+double PushScheduler::tokensNeeded(int lane) const {
+    // Backlog replay only runs while the bucket is at least half full, which
+    // keeps budget in reserve for verification codes arriving mid-replay
+    if (lane == static_cast<int>(Lane::Backlog)) {
+        return std::max(1.0, burst / 2.0);
+    }
+    return 1.0;
+}
+
+void PushScheduler::onThrottled() {
+    // Multiplicative decrease: halve the rate and drain the bucket
+    current_rate = std::max(base_rate / 8.0, current_rate / 2.0);
+    tokens = 0.0;
+    LOG_WARNING("Push rate reduced to " + std::to_string(current_rate * 60.0) + "/min after throttling");
+}
+
+void PushScheduler::onDelivered() {
+    // Additive increase back towards the configured rate
+    if (current_rate < base_rate) {
+        current_rate = std::min(base_rate, current_rate + base_rate / 10.0);
+        LOG_DEBUG("Push rate recovered to " + std::to_string(current_rate * 60.0) + "/min");
+    }
+}
+
+void PushScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (running) {
+        // Queued pushes wait for the network instead of timing out one by one
+        if (!network_up) {
+            cv.wait(lock);
+            continue;
+        }
+
+        // Connection upkeep runs on this thread because it owns the curl handle
+        if (reconnect_requested) {
+            reconnect_requested = false;
+            warm_up_requested = false;
+            lock.unlock();
+            Watchdog::Stage stage(WatchedLoop::Push, "reconnect");
+            pusher.reconnect();
+            lock.lock();
+            continue;
+        }
+        if (warm_up_requested) {
+            warm_up_requested = false;
+            lock.unlock();
+            Watchdog::Stage stage(WatchedLoop::Push, "connection warm-up");
+            pusher.warmUp();
+            lock.lock();
+            continue;
+        }
+        if (std::chrono::steady_clock::now() >= pusher.nextMaintenance()) {
+            lock.unlock();
+            Watchdog::Stage stage(WatchedLoop::Push, "DNS refresh");
+            pusher.maintain();
+            lock.lock();
+            continue;
+        }
+        // Delivery state can wait, a verification code cannot
+        if (tracker && std::chrono::steady_clock::now() >= tracker->nextPoll() &&
+            lanes[static_cast<int>(Lane::VerificationCode)].empty()) {
+            lock.unlock();
+            Watchdog::Stage stage(WatchedLoop::Push, "delivery poll");
+            tracker->poll(pusher);
+            lock.lock();
+            continue;
+        }
+
+        refill(std::chrono::steady_clock::now());
+
+        // Strict priority: only the highest non-empty lane may consume budget,
+        // lower lanes wait until it has drained
+        int lane = -1;
+        for (int i = 0; i < kLaneCount; i++) {
+            if (!lanes[i].empty()) {
+                lane = i;
+                break;
+            }
+        }
+
+        if (lane < 0) {
+            auto wake = pusher.nextMaintenance();
+            if (tracker) wake = std::min(wake, tracker->nextPoll());
+            cv.wait_until(lock, wake);
+            continue;
+        }
+
+        double needed = tokensNeeded(lane);
+        if (tokens < needed) {
+            double wait_seconds = (needed - tokens) / current_rate;
+            cv.wait_for(lock, std::chrono::duration<double>(wait_seconds));
+            continue;
+        }
+
+        Job job = std::move(lanes[lane].front());
+        lanes[lane].pop_front();
+        tokens -= 1.0;
+
+        lock.unlock();
+        bool success, throttled, interrupted;
+        {
+            Watchdog::Stage stage(WatchedLoop::Push, "WxPusher request");
+            success = pusher.sendMessage(job.message, job.trace_id, job.recipients, job.push_id);
+            throttled = !success && pusher.wasThrottled();
+            interrupted = !success && pusher.wasInterrupted();
+        }
+        if (success && tracker && job.delivered) {
+            tracker->track(pusher.lastReceipts(), std::move(job.delivered));
+        }
+        lock.lock();
+
+        if (interrupted) {
+            // The network went down; the push goes out again, with its token, once it is back
+            tokens = std::min(burst, tokens + 1.0);
+            lanes[lane].push_front(std::move(job));
+            continue;
+        }
+
+        if (throttled) {
+            onThrottled();
+            bool retry_budget = max_retries == 0 || pendingRetries() < max_retries;
+            if (++job.attempts < kMaxThrottledAttempts && retry_budget) {
+                // Put it back at the head of its lane so ordering is preserved
+                lanes[lane].push_front(std::move(job));
+                continue;
+            }
+            if (!retry_budget) {
+                Metrics::getInstance().increment("sms_forward_shed_total{action=\"retry_dropped\"}");
+                LOG_ERROR("Giving up on throttled push, " + std::to_string(max_retries) + " retries already pending");
+            } else {
+                LOG_ERROR("Giving up on push after " + std::to_string(job.attempts) + " throttled attempts");
+            }
+        } else if (success) {
+            onDelivered();
+        }
+
+        queued_messages--;
+        queued_bytes -= job.message.bytes();
+        publishLoad();
+
+        if (job.done) {
+            lock.unlock();
+            job.done(success);
+            lock.lock();
+        }
+    }
+}
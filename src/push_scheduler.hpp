@@ -0,0 +1,137 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include "delivery_tracker.hpp"
+#include "wx_pusher.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Queues outbound pushes and sends them through a token bucket so that bursts
+// of SMS do not exceed the WxPusher rate limit. Pushes are taken from three
+// priority lanes; verification codes always go first. The queue is bounded by
+// message count, bytes and pending retries; pushes that do not fit are refused.
+class PushScheduler {
+public:
+    enum class Lane { VerificationCode = 0, Normal = 1, Backlog = 2 };
+
+    // Called on the scheduler thread once the push has succeeded or failed
+    using Completion = std::function<void(bool)>;
+    // Called instead of the completion when a queued push is evicted
+    using Shed = std::function<void()>;
+    // Called on the scheduler thread with the final state of a sent push
+    using Delivered = DeliveryTracker::Callback;
+
+    PushScheduler(WxPusher& pusher, int rate_per_minute, int burst);
+    ~PushScheduler();
+
+    void start();
+    // Pushes still queued are completed as failed, on the calling thread,
+    // so their owners can keep them for the next run
+    void stop();
+    bool isRunning();
+
+    // Limits on queued and in-flight pushes, their bytes and throttled
+    // retries waiting in the queue. With evict_for_codes, a verification code
+    // that does not fit evicts the newest other push that has a shed
+    // callback instead of being refused.
+    void setBudget(size_t max_messages, size_t max_bytes, int max_retries, bool evict_for_codes);
+
+    // Follow sent pushes with tracker, which the worker polls between
+    // pushes. tracker must outlive the scheduler; set it before start.
+    void setDeliveryTracker(DeliveryTracker* tracker);
+
+    // Returns false, without calling done, if the push exceeds the budget.
+    // A push without shed is never evicted, e.g. one whose producer was
+    // already told it was taken.
+    // trace_id tags the push in the USDT probes; recipients is a list
+    // registered with WxPusher::addRecipients. Without a delivery tracker,
+    // delivered is never called.
+    bool submit(Lane lane, PushMessage message, Completion done,
+                Shed shed = nullptr, uint64_t trace_id = 0, size_t recipients = 0,
+                Delivered delivered = nullptr);
+
+    // True while the queue uses less than fraction of both budgets
+    bool hasRoom(double fraction);
+
+    // Re-establish the WxPusher connection from the worker thread, e.g.
+    // after the network changed. The worker also warms up when it starts.
+    void requestWarmUp();
+
+    // Hold pushes while there is no route to the internet. A push in flight
+    // is abandoned and queued again without counting as an attempt; when
+    // the network returns the worker reconnects and drains the queue at once.
+    void setNetworkUp(bool up);
+
+    // Drop pooled connections and reconnect from the worker thread, after
+    // the local addresses changed
+    void requestReconnect();
+
+private:
+    static const int kLaneCount = 3;
+    static const int kMaxThrottledAttempts = 5;
+
+    struct Job {
+        PushMessage message;
+        Completion done;
+        Shed shed;
+        int attempts;
+        uint64_t trace_id;
+        size_t recipients;
+        uint64_t push_id;   // Idempotency key, kept across throttled retries
+        Delivered delivered;
+    };
+
+    void workerLoop();
+    void refill(std::chrono::steady_clock::time_point now);
+    double tokensNeeded(int lane) const;
+    void onThrottled();
+    void onDelivered();
+    bool fits(size_t bytes) const;
+    bool evictOne(std::vector<Job>& evicted);
+    int pendingRetries() const;
+    void publishLoad();
+
+    WxPusher& pusher;
+    DeliveryTracker* tracker; // nullptr while delivery is not tracked
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> lanes[kLaneCount];
+    std::thread worker;
+    bool running;
+    bool warm_up_requested;
+    bool reconnect_requested;
+    bool network_up;
+
+    double base_rate;    // Configured refill rate in tokens per second
+    double current_rate; // Refill rate after adapting to throttling
+    double burst;        // Bucket capacity
+    double tokens;
+    std::chrono::steady_clock::time_point last_refill;
+
+    size_t max_messages;   // 0 means unlimited
+    size_t max_bytes;      // 0 means unlimited
+    int max_retries;       // 0 means unlimited
+    bool evict_for_codes;
+    size_t queued_messages; // Including the push in flight
+    size_t queued_bytes;
+    uint64_t next_push_id;  // Seeded from the clock so ids differ across restarts
+};
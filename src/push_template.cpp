@@ -0,0 +1,146 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "push_template.hpp"
+#include "json_reader.hpp"
+#include <cstdlib>
+
+PushTemplate::PushTemplate(std::string_view source) {
+    std::string error;
+    compile(source, error);
+}
+
+bool PushTemplate::compile(std::string_view source, std::string& error, bool title_allowed) {
+    static const struct {
+        std::string_view name;
+        Field field;
+    } kFields[] = {
+        {"title", Field::Title}, {"sender", Field::Sender}, {"text", Field::Text}, {"code", Field::Code},
+        {"modem", Field::Modem}, {"time", Field::Time}, {"node", Field::Node},
+    };
+
+    std::vector<Segment> parsed;
+    std::string text;
+    auto addLiteral = [&](std::string_view bytes) {
+        if (!parsed.empty() && parsed.back().field == Field::Literal) {
+            parsed.back().length += static_cast<uint32_t>(bytes.size());
+        } else {
+            parsed.push_back(Segment{Field::Literal, static_cast<uint32_t>(text.size()),
+                                     static_cast<uint32_t>(bytes.size())});
+        }
+        text += bytes;
+    };
+
+    for (size_t pos = 0; pos < source.size();) {
+        char c = source[pos];
+        if ((c == '{' || c == '}') && pos + 1 < source.size() && source[pos + 1] == c) {
+            addLiteral(source.substr(pos, 1));
+            pos += 2;
+            continue;
+        }
+        if (c == '\\' && pos + 1 < source.size() && source[pos + 1] == 'n') {
+            addLiteral("\n");
+            pos += 2;
+            continue;
+        }
+        if (c == '}') {
+            error = "unmatched } at offset " + std::to_string(pos);
+            return false;
+        }
+        if (c != '{') {
+            size_t next = source.find_first_of("{}\\", pos + 1);
+            if (next == std::string_view::npos) next = source.size();
+            addLiteral(source.substr(pos, next - pos));
+            pos = next;
+            continue;
+        }
+
+        size_t close = source.find('}', pos);
+        if (close == std::string_view::npos) {
+            error = "unterminated placeholder at offset " + std::to_string(pos);
+            return false;
+        }
+        std::string_view name = source.substr(pos + 1, close - pos - 1);
+        pos = close + 1;
+
+        uint32_t limit = 0;
+        if (name.substr(0, 15) == "text_truncated:") {
+            std::string digits(name.substr(15));
+            char* end = nullptr;
+            long parsed_limit = std::strtol(digits.c_str(), &end, 10);
+            if (digits.empty() || *end != '\0' || parsed_limit < 1 || parsed_limit > 65535) {
+                error = "bad length in {" + std::string(name) + "}";
+                return false;
+            }
+            name = "text";
+            limit = static_cast<uint32_t>(parsed_limit);
+        }
+
+        const auto* match = std::end(kFields);
+        for (const auto& entry : kFields) {
+            if (entry.name == name) match = &entry;
+        }
+        if (match == std::end(kFields)) {
+            error = "unknown placeholder {" + std::string(name) + "}";
+            return false;
+        }
+        if (match->field == Field::Title && !title_allowed) {
+            error = "{title} cannot be used here";
+            return false;
+        }
+        parsed.push_back(Segment{match->field, 0, limit});
+    }
+
+    segments = std::move(parsed);
+    literals = std::move(text);
+    return true;
+}
+
+void PushTemplate::render(const PushMessage& message, std::string& out, bool json) const {
+    auto append = [&](std::string_view value) {
+        if (json) {
+            appendJsonEscaped(out, value);
+        } else {
+            out += value;
+        }
+    };
+
+    for (const auto& segment : segments) {
+        switch (segment.field) {
+            case Field::Literal: append(std::string_view(literals).substr(segment.offset, segment.length)); break;
+            case Field::Title: append(message.title); break;
+            case Field::Sender: append(message.sender); break;
+            case Field::Code: append(message.code); break;
+            case Field::Modem: append(message.modem); break;
+            case Field::Time: append(message.time); break;
+            case Field::Node: append(message.node); break;
+            case Field::Text: {
+                // Cut at a code point boundary, counting UTF-8 lead bytes
+                std::string_view text = message.text;
+                size_t cut = text.size();
+                uint32_t points = 0;
+                for (size_t i = 0; segment.length > 0 && i < text.size(); i++) {
+                    if ((static_cast<unsigned char>(text[i]) & 0xc0) == 0x80) continue;
+                    if (points++ == segment.length) {
+                        cut = i;
+                        break;
+                    }
+                }
+                append(text.substr(0, cut));
+                if (cut < text.size()) out += "…";
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One push and the fields its templates may refer to
+struct PushMessage {
+    std::string title;  // Headline chosen by the forwarder, e.g. "New SMS from 10086"
+    std::string sender;
+    std::string text;
+    std::string code;   // Verification code found in the text, empty if none
+    std::string modem;  // Modem index as used by mmcli -m, empty if unknown
+    std::string time;   // Send time as reported by the modem, empty if unknown
+    std::string node;   // Fleet node that received it, empty for local messages
+
+    size_t bytes() const {
+        return title.size() + sender.size() + text.size() + code.size() + modem.size() + time.size() + node.size();
+    }
+};
+
+// Push text with placeholders, compiled once into a list of literal and
+// field segments and rendered by appending to the request being built.
+// Placeholders: {title} {sender} {text} {text_truncated:N} {code} {modem}
+// {time} {node}; {{ and }} are literal braces and \n is a line break.
+class PushTemplate {
+public:
+    static constexpr const char* kDefaultSummary = "{title}";
+    static constexpr const char* kDefaultCodeSummary = "{code} {title}";
+    static constexpr const char* kDefaultContent = "{title}\n{text}";
+
+    PushTemplate() = default;
+    // source must be valid, for built-in templates
+    explicit PushTemplate(std::string_view source);
+
+    // Replace this template with source. On a syntax error, or {title} when
+    // title_allowed is false, it is left unchanged and error says why.
+    bool compile(std::string_view source, std::string& error, bool title_allowed = true);
+
+    bool empty() const { return segments.empty(); }
+
+    // Append the text to out, escaped for a JSON string when json is set
+    void render(const PushMessage& message, std::string& out, bool json) const;
+
+private:
+    enum class Field : uint8_t { Literal, Title, Sender, Text, Code, Modem, Time, Node };
+
+    struct Segment {
+        Field field;
+        uint32_t offset; // Literal: bytes in literals
+        uint32_t length; // Literal: byte count; text: code point limit, 0 for none
+    };
+
+    std::vector<Segment> segments;
+    std::string literals;
+};
@@ -0,0 +1,249 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "send_socket.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t kMaxLineBytes = 4096;
+const size_t kMaxClients = 32;
+
+// Undo the escaping of the SEND text field
+std::string unescape(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\\' || i + 1 == text.size()) {
+            result += text[i];
+            continue;
+        }
+        char c = text[++i];
+        result += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+    }
+    return result;
+}
+
+bool validNumber(const std::string& number) {
+    size_t start = !number.empty() && number[0] == '+' ? 1 : 0;
+    return number.size() > start && number.size() <= 20 &&
+           number.find_first_not_of("0123456789", start) == std::string::npos;
+}
+
+} // namespace
+
+SendSocket::SendSocket(SmsSender& sender, const std::string& path)
+    : sender(sender), path(path), listener(-1), wake_pipe{-1, -1}, running(false), next_id(1) {}
+
+SendSocket::~SendSocket() {
+    stop();
+}
+
+bool SendSocket::start() {
+    if (running) return true;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Send socket path too long: " + path);
+        return false;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || pipe2(wake_pipe, O_CLOEXEC) != 0) {
+        LOG_ERROR("Failed to create send socket: " + std::string(strerror(errno)));
+        stop();
+        return false;
+    }
+
+    // A stale socket from a previous run would make bind fail
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+        LOG_ERROR("Failed to listen on " + path + ": " + std::string(strerror(errno)));
+        close(listener);
+        listener = -1;
+        stop();
+        return false;
+    }
+    // Sending SMS costs money; only root and the socket's group may use it
+    chmod(path.c_str(), 0660);
+
+    running = true;
+    worker = std::thread(&SendSocket::serveLoop, this);
+    LOG_INFO("Accepting outbound SMS on " + path);
+    return true;
+}
+
+void SendSocket::stop() {
+    if (running.exchange(false)) {
+        char byte = 0;
+        if (write(wake_pipe[1], &byte, 1) < 0) {
+            LOG_WARNING("Failed to wake send socket thread");
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+        unlink(path.c_str());
+    }
+
+    for (const auto& client : clients) {
+        closeClient(client);
+    }
+    clients.clear();
+    if (listener >= 0) close(listener);
+    for (int& fd : wake_pipe) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    listener = -1;
+}
+
+void SendSocket::serveLoop() {
+    while (running) {
+        std::vector<pollfd> fds;
+        fds.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+        fds.push_back(pollfd{listener, POLLIN, 0});
+        for (const auto& client : clients) {
+            fds.push_back(pollfd{client->fd, POLLIN, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Send socket poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        if (fds[0].revents) break;
+
+        // Clients first, so indexes still match the poll set
+        std::vector<ClientPtr> open;
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (!fds[i + 2].revents || readClient(clients[i])) {
+                open.push_back(clients[i]);
+            } else {
+                closeClient(clients[i]);
+            }
+        }
+        clients.swap(open);
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            if (clients.size() >= kMaxClients) {
+                LOG_WARNING("Too many send socket clients, refusing connection");
+                close(fd);
+                continue;
+            }
+            auto client = std::make_shared<Client>();
+            client->fd = fd;
+            clients.push_back(client);
+        }
+    }
+}
+
+bool SendSocket::readClient(const ClientPtr& client) {
+    char buffer[4096];
+    ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+        return n < 0 && (errno == EINTR || errno == EAGAIN);
+    }
+    client->input.append(buffer, static_cast<size_t>(n));
+
+    size_t start = 0;
+    for (size_t end; (end = client->input.find('\n', start)) != std::string::npos; start = end + 1) {
+        std::string line = client->input.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) handleLine(client, line);
+    }
+    client->input.erase(0, start);
+
+    if (client->input.size() > kMaxLineBytes) {
+        reply(client, "ERROR line too long");
+        return false;
+    }
+    return true;
+}
+
+void SendSocket::handleLine(const ClientPtr& client, const std::string& line) {
+    size_t number_start = line.find(' ');
+    size_t number_end = number_start == std::string::npos ? std::string::npos : line.find(' ', number_start + 1);
+    if (line.compare(0, number_start, "SEND") != 0 || number_end == std::string::npos) {
+        reply(client, "ERROR expected: SEND <number> <text>");
+        return;
+    }
+
+    std::string number = line.substr(number_start + 1, number_end - number_start - 1);
+    std::string text = unescape(line.substr(number_end + 1));
+    if (!validNumber(number)) {
+        reply(client, "ERROR invalid number");
+        return;
+    }
+    if (text.empty()) {
+        reply(client, "ERROR empty text");
+        return;
+    }
+
+    std::string id = std::to_string(next_id++);
+    auto queued_at = std::chrono::steady_clock::now();
+
+    // Held across submit so the outcome cannot overtake the QUEUED reply
+    std::lock_guard<std::mutex> lock(client->mutex);
+    bool accepted = sender.submit(number, text, [client, id, queued_at](bool success, const std::string& detail) {
+        if (success) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - queued_at).count();
+            reply(client, "SENT " + id + " " + std::to_string(elapsed));
+        } else {
+            reply(client, "FAILED " + id + " " + detail);
+        }
+    });
+    writeLine(*client, accepted ? "QUEUED " + id : "BUSY");
+}
+
+void SendSocket::reply(const ClientPtr& client, const std::string& line) {
+    std::lock_guard<std::mutex> lock(client->mutex);
+    writeLine(*client, line);
+}
+
+void SendSocket::writeLine(Client& client, const std::string& line) {
+    if (client.fd < 0) return;
+
+    std::string data = line;
+    for (char& c : data) {
+        if (c == '\n') c = ' ';
+    }
+    data += '\n';
+    // Replies are short; a client that stops reading loses them rather than blocking the sender
+    if (send(client.fd, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+        LOG_DEBUG("Dropped send socket reply: " + std::string(strerror(errno)));
+    }
+}
+
+void SendSocket::closeClient(const ClientPtr& client) {
+    std::lock_guard<std::mutex> lock(client->mutex);
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+}
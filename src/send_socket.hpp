@@ -0,0 +1,65 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include "sms_sender.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local Unix socket accepting outbound SMS for SmsSender. The protocol is
+// line based, one request per line:
+//   SEND <number> <text>     text with \n, \t and \\ escaped
+// answered with "QUEUED <id>", "BUSY" or "ERROR <reason>", followed once
+// the SMS is done by "SENT <id> <ms>" or "FAILED <id> <reason>" while the
+// client stays connected. Closing the connection does not cancel sends.
+class SendSocket {
+public:
+    SendSocket(SmsSender& sender, const std::string& path);
+    ~SendSocket();
+
+    bool start();
+    void stop();
+
+private:
+    struct Client {
+        int fd;
+        std::mutex mutex; // Guards fd against replies from the sender thread
+        std::string input;
+    };
+    using ClientPtr = std::shared_ptr<Client>;
+
+    void serveLoop();
+    bool readClient(const ClientPtr& client);
+    void handleLine(const ClientPtr& client, const std::string& line);
+    static void reply(const ClientPtr& client, const std::string& line);
+    static void writeLine(Client& client, const std::string& line); // Caller holds client.mutex
+    static void closeClient(const ClientPtr& client);
+
+    SmsSender& sender;
+    std::string path;
+    int listener;
+    int wake_pipe[2];
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> next_id;
+
+    // Only touched by the worker thread
+    std::vector<ClientPtr> clients;
+};
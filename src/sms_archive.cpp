@@ -0,0 +1,385 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "sms_archive.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kIndexMagic[8] = {'S', 'M', 'S', 'I', 'D', 'X', '1', '\0'};
+const uint32_t kSegmentSize = 4 * 1024 * 1024; // Start a new segment beyond this
+const size_t kGrowEntries = 4096;              // Index growth step
+
+// On-disk record: this header, then sender, modem, timestamp and text bytes
+struct RecordHeader {
+    uint32_t length; // Whole record including this header
+    uint32_t text_length;
+    int64_t archived_ms;
+    uint16_t sender_length;
+    uint16_t modem_length;
+    uint16_t timestamp_length;
+    uint16_t reserved;
+};
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Create dir and its missing parents, private to the service
+void makeDirectories(const std::string& dir) {
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        mkdir(dir.substr(0, pos).c_str(), 0700);
+        if (pos == std::string::npos) break;
+    }
+}
+
+} // namespace
+
+static_assert(sizeof(RecordHeader) == 24, "record header layout");
+
+SmsArchive::SmsArchive(const std::string& dir)
+    : dir(dir), writable(false), index_fd(-1), header(nullptr), entries(nullptr), capacity(0),
+      current_segment(1), append_fd(-1), append_offset(0) {
+    static_assert(sizeof(IndexHeader) == 64, "index header layout");
+    static_assert(sizeof(IndexEntry) == 40, "index entry layout");
+}
+
+SmsArchive::~SmsArchive() {
+    if (header) munmap(header, sizeof(IndexHeader) + capacity * sizeof(IndexEntry));
+    if (index_fd >= 0) close(index_fd);
+    if (append_fd >= 0) close(append_fd);
+    for (const auto& entry : read_fds) close(entry.second);
+}
+
+std::string SmsArchive::segmentPath(uint32_t segment) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%06u.seg", segment);
+    return dir + name;
+}
+
+uint64_t SmsArchive::senderHash(std::string_view sender) {
+    // FNV-1a: stable across builds, unlike std::hash
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : sender) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+const char* SmsArchive::statusName(Status status) {
+    switch (status) {
+        case Status::Pending: return "pending";
+        case Status::Forwarded: return "forwarded";
+        case Status::Failed: return "failed";
+        case Status::Filtered: return "filtered";
+        case Status::Dropped: return "dropped";
+        case Status::Delivered: return "delivered";
+        case Status::Undelivered: return "undelivered";
+        case Status::Expired: return "expired";
+    }
+    return "unknown";
+}
+
+bool SmsArchive::mapIndex(size_t new_capacity) {
+    if (header) {
+        munmap(header, sizeof(IndexHeader) + capacity * sizeof(IndexEntry));
+        header = nullptr;
+        entries = nullptr;
+    }
+
+    size_t size = sizeof(IndexHeader) + new_capacity * sizeof(IndexEntry);
+    if (writable && ftruncate(index_fd, static_cast<off_t>(size)) != 0) {
+        LOG_ERROR("Cannot grow SMS archive index: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    void* base = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, index_fd, 0);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("Cannot map SMS archive index: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    header = static_cast<IndexHeader*>(base);
+    entries = reinterpret_cast<IndexEntry*>(static_cast<char*>(base) + sizeof(IndexHeader));
+    capacity = new_capacity;
+    return true;
+}
+
+bool SmsArchive::open(bool open_writable) {
+    writable = open_writable;
+    if (writable) makeDirectories(dir);
+
+    std::string index_path = dir + "/index";
+    index_fd = ::open(index_path.c_str(), writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0600);
+    if (index_fd < 0) {
+        LOG_ERROR("Cannot open SMS archive index " + index_path + ": " + strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(index_fd, &st) != 0) return false;
+    bool fresh = static_cast<size_t>(st.st_size) < sizeof(IndexHeader);
+    if (fresh && !writable) return false;
+
+    size_t existing = fresh ? 0 : (st.st_size - sizeof(IndexHeader)) / sizeof(IndexEntry);
+    if (!mapIndex(fresh ? kGrowEntries : existing)) return false;
+
+    if (fresh) {
+        memcpy(header->magic, kIndexMagic, sizeof(kIndexMagic));
+        header->count = 0;
+    } else if (memcmp(header->magic, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+        LOG_ERROR("SMS archive index " + index_path + " has an unknown format");
+        return false;
+    }
+
+    size_t count = std::min<size_t>(__atomic_load_n(&header->count, __ATOMIC_ACQUIRE), capacity);
+    for (size_t i = 0; i < count; i++) {
+        last_by_sender[entries[i].sender_hash] = static_cast<uint32_t>(i);
+    }
+    if (!writable) return true;
+
+    if (count > 0) {
+        const IndexEntry& last = entries[count - 1];
+        current_segment = last.segment;
+        append_offset = last.offset + last.length;
+    }
+    if (!recoverTail()) return false;
+
+    append_fd = ::open(segmentPath(current_segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (append_fd < 0) {
+        LOG_ERROR("Cannot open SMS archive segment: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    LOG_INFO("SMS archive " + dir + " holds " + std::to_string(header->count) + " messages");
+    return true;
+}
+
+bool SmsArchive::recoverTail() {
+    // Records written just before a crash may be missing from the index
+    int recovered = 0;
+    for (uint32_t segment = current_segment; ; segment++) {
+        int fd = ::open(segmentPath(segment).c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) break;
+
+        uint32_t offset = segment == current_segment ? append_offset : 0;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+
+        std::vector<char> tail(st.st_size > offset ? st.st_size - offset : 0);
+        if (!tail.empty() && pread(fd, tail.data(), tail.size(), offset) != static_cast<ssize_t>(tail.size())) {
+            close(fd);
+            return false;
+        }
+
+        size_t pos = 0;
+        while (pos + sizeof(RecordHeader) <= tail.size()) {
+            RecordHeader record;
+            memcpy(&record, tail.data() + pos, sizeof(record));
+            if (record.length < sizeof(record) + record.sender_length || pos + record.length > tail.size()) break;
+
+            std::string sender(tail.data() + pos + sizeof(record), record.sender_length);
+            if (!indexRecord(segment, offset + static_cast<uint32_t>(pos), record.length, record.archived_ms,
+                             sender, Status::Pending)) {
+                close(fd);
+                return false;
+            }
+            pos += record.length;
+            recovered++;
+        }
+
+        // Drop a partially written record so appends stay aligned
+        if (pos < tail.size() && ftruncate(fd, offset + pos) != 0) {
+            LOG_WARNING("Cannot truncate SMS archive segment " + segmentPath(segment));
+        }
+        close(fd);
+
+        current_segment = segment;
+        append_offset = offset + static_cast<uint32_t>(pos);
+    }
+
+    if (recovered > 0) {
+        LOG_WARNING("Recovered " + std::to_string(recovered) + " SMS archive records missing from the index");
+    }
+    return true;
+}
+
+bool SmsArchive::indexRecord(uint32_t segment, uint32_t offset, uint32_t length, int64_t archived_ms,
+                             std::string_view sender, Status status) {
+    size_t count = header->count;
+    if (count == capacity && !mapIndex(capacity + kGrowEntries)) return false;
+
+    uint64_t hash = senderHash(sender);
+    auto previous = last_by_sender.find(hash);
+
+    IndexEntry& entry = entries[count];
+    entry.archived_ms = archived_ms;
+    entry.sender_hash = hash;
+    entry.segment = segment;
+    entry.offset = offset;
+    entry.length = length;
+    entry.prev_by_sender = previous == last_by_sender.end() ? kNoEntry : previous->second;
+    entry.status = static_cast<uint32_t>(status);
+    entry.reserved = 0;
+
+    // Publish the entry only once it is complete, readers may be mapping it
+    __atomic_store_n(&header->count, count + 1, __ATOMIC_RELEASE);
+    last_by_sender[hash] = static_cast<uint32_t>(count);
+    return true;
+}
+
+uint32_t SmsArchive::append(std::string_view sender, std::string_view text,
+                            std::string_view modem, std::string_view timestamp) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!writable || append_fd < 0) return kNoEntry;
+
+    RecordHeader record{};
+    record.sender_length = static_cast<uint16_t>(std::min<size_t>(sender.size(), UINT16_MAX));
+    record.modem_length = static_cast<uint16_t>(std::min<size_t>(modem.size(), UINT16_MAX));
+    record.timestamp_length = static_cast<uint16_t>(std::min<size_t>(timestamp.size(), UINT16_MAX));
+    record.text_length = static_cast<uint32_t>(text.size());
+    record.length = static_cast<uint32_t>(sizeof(record) + record.sender_length + record.modem_length +
+                                          record.timestamp_length + record.text_length);
+
+    // Archive times never go backwards, even when the clock does at boot
+    size_t count = header->count;
+    int64_t last_ms = count > 0 ? entries[count - 1].archived_ms : 0;
+    record.archived_ms = std::max(nowMs(), last_ms);
+
+    std::string buffer(reinterpret_cast<const char*>(&record), sizeof(record));
+    buffer.append(sender, 0, record.sender_length);
+    buffer.append(modem, 0, record.modem_length);
+    buffer.append(timestamp, 0, record.timestamp_length);
+    buffer.append(text);
+
+    if (append_offset > 0 && append_offset + buffer.size() > kSegmentSize) {
+        int fd = ::open(segmentPath(current_segment + 1).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            LOG_ERROR("Cannot start SMS archive segment: " + std::string(strerror(errno)));
+            return kNoEntry;
+        }
+        close(append_fd);
+        append_fd = fd;
+        current_segment++;
+        append_offset = 0;
+    }
+
+    if (write(append_fd, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size())) {
+        LOG_ERROR("Failed to append to SMS archive: " + std::string(strerror(errno)));
+        return kNoEntry;
+    }
+
+    uint32_t offset = append_offset;
+    append_offset += record.length;
+    if (!indexRecord(current_segment, offset, record.length, record.archived_ms, sender, Status::Pending)) {
+        return kNoEntry;
+    }
+    return static_cast<uint32_t>(count);
+}
+
+void SmsArchive::setStatus(uint32_t entry, Status status) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!writable || entry == kNoEntry || entry >= header->count) return;
+    entries[entry].status = static_cast<uint32_t>(status);
+}
+
+int SmsArchive::segmentFd(uint32_t segment) {
+    auto it = read_fds.find(segment);
+    if (it != read_fds.end()) return it->second;
+
+    int fd = ::open(segmentPath(segment).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) read_fds[segment] = fd;
+    return fd;
+}
+
+bool SmsArchive::readRecord(const IndexEntry& entry, Record& record) {
+    int fd = segmentFd(entry.segment);
+    if (fd < 0 || entry.length < sizeof(RecordHeader)) return false;
+
+    std::vector<char> data(entry.length);
+    if (pread(fd, data.data(), data.size(), entry.offset) != static_cast<ssize_t>(data.size())) return false;
+
+    RecordHeader stored;
+    memcpy(&stored, data.data(), sizeof(stored));
+    if (stored.length != entry.length ||
+        sizeof(stored) + stored.sender_length + stored.modem_length + stored.timestamp_length +
+            stored.text_length != stored.length) {
+        return false;
+    }
+
+    const char* field = data.data() + sizeof(stored);
+    record.archived_ms = stored.archived_ms;
+    record.status = static_cast<Status>(entry.status);
+    record.sender.assign(field, stored.sender_length);
+    field += stored.sender_length;
+    record.modem.assign(field, stored.modem_length);
+    field += stored.modem_length;
+    record.timestamp.assign(field, stored.timestamp_length);
+    field += stored.timestamp_length;
+    record.text.assign(field, stored.text_length);
+    return true;
+}
+
+std::vector<SmsArchive::Record> SmsArchive::query(const std::string& sender, int64_t from_ms, int64_t to_ms,
+                                                  size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Record> results;
+    if (!header) return results;
+
+    size_t count = std::min<size_t>(__atomic_load_n(&header->count, __ATOMIC_ACQUIRE), capacity);
+    auto collect = [&](uint32_t index) {
+        Record record;
+        if (!readRecord(entries[index], record)) {
+            LOG_WARNING("Unreadable SMS archive record " + std::to_string(index));
+            return;
+        }
+        if (sender.empty() || record.sender == sender) results.push_back(std::move(record));
+    };
+
+    if (!sender.empty()) {
+        // Follow the sender's chain from its newest entry
+        auto newest = last_by_sender.find(senderHash(sender));
+        uint32_t index = newest == last_by_sender.end() ? kNoEntry : newest->second;
+        while (index != kNoEntry && index < count && (limit == 0 || results.size() < limit)) {
+            const IndexEntry& entry = entries[index];
+            if (entry.archived_ms < from_ms) break;
+            if (entry.archived_ms <= to_ms) collect(index);
+            index = entry.prev_by_sender;
+        }
+    } else {
+        // Entries are in archive time order
+        const IndexEntry* end = std::upper_bound(entries, entries + count, to_ms,
+            [](int64_t value, const IndexEntry& entry) { return value < entry.archived_ms; });
+        for (const IndexEntry* entry = end; entry != entries && (limit == 0 || results.size() < limit); ) {
+            --entry;
+            if (entry->archived_ms < from_ms) break;
+            collect(static_cast<uint32_t>(entry - entries));
+        }
+    }
+
+    std::reverse(results.begin(), results.end());
+    return results;
+}
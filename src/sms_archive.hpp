@@ -0,0 +1,103 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Local append-only archive of received SMS. Records are appended to
+// numbered segment files in the archive directory; a memory-mapped index of
+// fixed-size entries orders them by archive time and chains each entry to the
+// previous one from the same sender, so queries never scan the segments.
+// The forward status lives in the index and is the only field ever updated.
+class SmsArchive {
+public:
+    // Forwarded pushes end up Delivered, Undelivered or Expired when delivery is tracked
+    enum class Status : uint32_t {
+        Pending = 0, Forwarded = 1, Failed = 2, Filtered = 3, Dropped = 4,
+        Delivered = 5, Undelivered = 6, Expired = 7
+    };
+    static constexpr uint32_t kNoEntry = UINT32_MAX;
+
+    struct Record {
+        int64_t archived_ms;
+        Status status;
+        std::string sender;
+        std::string modem;
+        std::string timestamp; // As reported by ModemManager
+        std::string text;
+    };
+
+    explicit SmsArchive(const std::string& dir);
+    ~SmsArchive();
+
+    // Open or create the archive; read-only access never modifies it
+    bool open(bool writable);
+
+    // Returns the entry number, or kNoEntry if the archive is unusable
+    uint32_t append(std::string_view sender, std::string_view text,
+                    std::string_view modem, std::string_view timestamp);
+    void setStatus(uint32_t entry, Status status);
+
+    // Newest matching records, at most limit (0 for all), returned oldest
+    // first. An empty sender matches everyone; times are archive times in ms.
+    std::vector<Record> query(const std::string& sender, int64_t from_ms, int64_t to_ms, size_t limit);
+
+    static const char* statusName(Status status);
+
+private:
+    struct IndexHeader {
+        char magic[8];
+        uint64_t count;
+        uint8_t reserved[48];
+    };
+
+    struct IndexEntry {
+        int64_t archived_ms;
+        uint64_t sender_hash;
+        uint32_t segment;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t prev_by_sender; // Entry number, kNoEntry ends the chain
+        uint32_t status;
+        uint32_t reserved;
+    };
+
+    bool mapIndex(size_t capacity);
+    bool recoverTail();
+    bool indexRecord(uint32_t segment, uint32_t offset, uint32_t length, int64_t archived_ms,
+                     std::string_view sender, Status status);
+    bool readRecord(const IndexEntry& entry, Record& record);
+    int segmentFd(uint32_t segment);
+    std::string segmentPath(uint32_t segment) const;
+    static uint64_t senderHash(std::string_view sender);
+
+    std::string dir;
+    bool writable;
+    std::mutex mutex;
+    int index_fd;
+    IndexHeader* header;
+    IndexEntry* entries;
+    size_t capacity;                                       // Entries the mapping can hold
+    uint32_t current_segment;
+    int append_fd;                                         // Current segment, opened for appending
+    uint32_t append_offset;
+    std::unordered_map<uint64_t, uint32_t> last_by_sender; // Sender hash -> newest entry
+    std::unordered_map<uint32_t, int> read_fds;
+};
@@ -0,0 +1,332 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "sms_deleter.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "mm_async.hpp"
+#include "modem_bus.hpp"
+#include "probes.hpp"
+#include <algorithm>
+#include <map>
+#include <gio/gio.h>
+
+namespace {
+
+const int kMaxAttempts = 4;
+const auto kBatchWindow = std::chrono::milliseconds(300);
+const auto kRetryBaseDelay = std::chrono::seconds(2);
+
+// State for one in-flight asynchronous Delete call
+struct DeleteOp {
+    std::string sms_path;
+    bool success;
+    bool not_found;
+    std::string error;
+    int* outstanding;
+};
+
+AsyncTask deleteOne(MMModemMessaging* messaging, DeleteOp* op) {
+    auto outcome = co_await messagingDelete(messaging, op->sms_path);
+    op->success = outcome.value;
+    SMS_PROBE2(delete_end, smsTraceId(op->sms_path), op->success ? 1 : 0);
+    if (outcome.error) {
+        op->error = outcome.message();
+        // The SMS is already gone, which is what we wanted
+        op->not_found = op->error.find("NotFound") != std::string::npos ||
+                        op->error.find("not found") != std::string::npos;
+    }
+    (*op->outstanding)--;
+}
+
+// Extract the trailing index from a D-Bus path such as .../Modem/0 or .../SMS/22
+std::string pathIndex(const std::string& path, const std::string& fallback) {
+    size_t pos = path.rfind('/');
+    if (pos == std::string::npos || pos + 1 >= path.size()) {
+        return fallback;
+    }
+    std::string index = path.substr(pos + 1);
+    // The index ends up on a shell command line, so accept digits only
+    if (index.find_first_not_of("0123456789") != std::string::npos) {
+        return fallback;
+    }
+    return index;
+}
+
+} // namespace
+
+SmsDeleter::SmsDeleter(int max_retries)
+    : running(false), max_retries(max_retries), context(nullptr), bus(nullptr), manager(nullptr) {}
+
+SmsDeleter::~SmsDeleter() {
+    stop();
+}
+
+void SmsDeleter::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    running = true;
+    worker = std::thread(&SmsDeleter::workerLoop, this);
+}
+
+void SmsDeleter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    if (!queue.empty()) {
+        LOG_WARNING("SMS deleter stopped with " + std::to_string(queue.size()) + " pending deletions");
+        queue.clear();
+    }
+}
+
+void SmsDeleter::enqueue(const std::string& modem_path, const std::string& sms_path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(PendingDelete{modem_path, sms_path, 0, std::chrono::steady_clock::now()});
+    }
+    LOG_DEBUG("Queued SMS for deletion: " + sms_path + " (modem: " +
+              (modem_path.empty() ? std::string("unknown") : modem_path) + ")");
+    cv.notify_one();
+}
+
+void SmsDeleter::workerLoop() {
+    // Give the ModemManager proxies their own context so their signals are
+    // never dispatched on the monitor thread
+    context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        if (queue.empty()) {
+            cv.wait(lock);
+            continue;
+        }
+
+        // Sleep until the earliest retry is due
+        auto now = std::chrono::steady_clock::now();
+        auto earliest = queue.front().not_before;
+        for (const auto& item : queue) {
+            earliest = std::min(earliest, item.not_before);
+        }
+        if (earliest > now) {
+            cv.wait_until(lock, earliest);
+            continue;
+        }
+
+        // Let more requests accumulate so they share one batch
+        cv.wait_for(lock, kBatchWindow, [this] { return !running; });
+
+        now = std::chrono::steady_clock::now();
+        std::vector<PendingDelete> batch;
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->not_before <= now) {
+                batch.push_back(std::move(*it));
+                it = queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        lock.unlock();
+        std::vector<PendingDelete> failed = processBatch(batch);
+        lock.lock();
+
+        for (auto& item : failed) {
+            if (max_retries > 0 && item.attempts == 0) {
+                int pending = static_cast<int>(std::count_if(queue.begin(), queue.end(),
+                    [](const PendingDelete& queued) { return queued.attempts > 0; }));
+                if (pending >= max_retries) {
+                    // Forwarded messages left behind are removed by storage pruning
+                    Metrics::getInstance().increment("sms_forward_shed_total{action=\"delete_retry_dropped\"}");
+                    LOG_WARNING("Not retrying deletion of " + item.sms_path + ", " +
+                                std::to_string(pending) + " retries already pending");
+                    continue;
+                }
+            }
+            if (++item.attempts >= kMaxAttempts) {
+                lock.unlock();
+                if (!deleteWithMmcli(item)) {
+                    LOG_ERROR("Giving up deleting SMS " + item.sms_path + " after " +
+                              std::to_string(item.attempts) + " attempts");
+                }
+                lock.lock();
+                continue;
+            }
+            item.not_before = std::chrono::steady_clock::now() + kRetryBaseDelay * (1 << (item.attempts - 1));
+            queue.push_back(std::move(item));
+        }
+    }
+    lock.unlock();
+
+    resetManager();
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    context = nullptr;
+}
+
+bool SmsDeleter::ensureManager() {
+    if (manager) {
+        // Apply any pending object manager updates before we look up modems
+        while (g_main_context_iteration(context, FALSE)) {}
+        return true;
+    }
+
+    GError* error = nullptr;
+    bus = openModemBusGio(&error);
+    if (error) {
+        LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
+        g_error_free(error);
+        return false;
+    }
+
+    manager = mm_manager_new_sync(bus, G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE, nullptr, &error);
+    if (error) {
+        LOG_ERROR("Failed to create ModemManager proxy: " + std::string(error->message));
+        g_error_free(error);
+        resetManager();
+        return false;
+    }
+
+    return true;
+}
+
+void SmsDeleter::resetManager() {
+    if (manager) {
+        g_object_unref(manager);
+        manager = nullptr;
+    }
+    if (bus) {
+        g_object_unref(bus);
+        bus = nullptr;
+    }
+}
+
+std::string SmsDeleter::findOwner(const std::string& sms_path) {
+    std::string owner;
+    GList* modems = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
+
+    for (GList* m = modems; m && owner.empty(); m = g_list_next(m)) {
+        MMObject* modem_obj = MM_OBJECT(m->data);
+        MMModemMessaging* messaging = mm_object_peek_modem_messaging(modem_obj);
+        if (!messaging) continue;
+
+        // The Messages property is cached by the proxy, so this costs no bus traffic
+        const gchar* const* messages = mm_gdbus_modem_messaging_get_messages(MM_GDBUS_MODEM_MESSAGING(messaging));
+        for (int i = 0; messages && messages[i]; i++) {
+            if (sms_path == messages[i]) {
+                owner = g_dbus_object_get_object_path(G_DBUS_OBJECT(modem_obj));
+                break;
+            }
+        }
+    }
+
+    g_list_free_full(modems, g_object_unref);
+    return owner;
+}
+
+std::vector<SmsDeleter::PendingDelete> SmsDeleter::processBatch(std::vector<PendingDelete>& batch) {
+    std::vector<PendingDelete> failed;
+
+    if (!ensureManager()) {
+        return batch;
+    }
+
+    // Group the batch by owning modem
+    std::map<std::string, std::vector<PendingDelete>> by_modem;
+    for (auto& item : batch) {
+        if (item.modem_path.empty()) {
+            item.modem_path = findOwner(item.sms_path);
+        }
+        by_modem[item.modem_path].push_back(std::move(item));
+    }
+
+    for (auto& group : by_modem) {
+        const std::string& modem_path = group.first;
+        std::vector<PendingDelete>& items = group.second;
+
+        GDBusObject* modem_obj = modem_path.empty() ? nullptr :
+            g_dbus_object_manager_get_object(G_DBUS_OBJECT_MANAGER(manager), modem_path.c_str());
+        MMModemMessaging* messaging = modem_obj ? mm_object_get_modem_messaging(MM_OBJECT(modem_obj)) : nullptr;
+
+        if (!messaging) {
+            LOG_WARNING("No messaging interface for modem " +
+                        (modem_path.empty() ? std::string("<unknown>") : modem_path) +
+                        ", deferring " + std::to_string(items.size()) + " deletions");
+            for (auto& item : items) {
+                // Forget the owner so the next attempt resolves it again
+                item.modem_path.clear();
+                failed.push_back(std::move(item));
+            }
+            if (modem_obj) g_object_unref(modem_obj);
+            continue;
+        }
+
+        LOG_DEBUG("Deleting " + std::to_string(items.size()) + " SMS on modem " + modem_path);
+
+        // Issue every Delete at once and wait for all replies
+        int outstanding = static_cast<int>(items.size());
+        std::vector<DeleteOp> ops(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            ops[i] = DeleteOp{items[i].sms_path, false, false, std::string(), &outstanding};
+            SMS_PROBE2(delete_begin, smsTraceId(items[i].sms_path), items.size());
+            deleteOne(messaging, &ops[i]);
+        }
+        while (outstanding > 0) {
+            g_main_context_iteration(context, TRUE);
+        }
+
+        for (size_t i = 0; i < items.size(); i++) {
+            if (ops[i].success || ops[i].not_found) {
+                LOG_INFO("Deleted SMS " + items[i].sms_path + " using ModemManager API");
+            } else {
+                LOG_ERROR_LIMITED(ops[i].error, "Failed to delete SMS " + items[i].sms_path + ": " + ops[i].error);
+                failed.push_back(std::move(items[i]));
+            }
+        }
+
+        g_object_unref(messaging);
+        g_object_unref(modem_obj);
+    }
+
+    return failed;
+}
+
+bool SmsDeleter::deleteWithMmcli(const PendingDelete& item) {
+    std::string modem_index = pathIndex(item.modem_path, "0");
+    std::string sms_index = pathIndex(item.sms_path, "");
+    if (sms_index.empty()) {
+        LOG_ERROR("deleteSms: Failed to extract SMS index from path");
+        return false;
+    }
+
+    LOG_DEBUG("Attempting to delete SMS using mmcli for SMS index " + sms_index);
+
+    std::string cmd = "mmcli -m " + modem_index + " --messaging-delete-sms=" + sms_index;
+    int result = system(cmd.c_str());
+    if (result == 0) {
+        LOG_INFO("Successfully deleted SMS using mmcli");
+        return true;
+    }
+
+    LOG_ERROR("Failed to delete SMS using mmcli, return code: " + std::to_string(result));
+    return false;
+}
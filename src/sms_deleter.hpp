@@ -0,0 +1,67 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libmm-glib.h>
+
+// Deletes SMS messages from modem storage on a background thread. Requests
+// are collected into batches, grouped by the modem that owns each SMS and
+// issued as pipelined asynchronous Delete calls. Failed deletes are retried
+// with backoff and finally handed to mmcli.
+class SmsDeleter {
+public:
+    // max_retries bounds failed deletions waiting for a retry, 0 means unlimited
+    explicit SmsDeleter(int max_retries = 0);
+    ~SmsDeleter();
+
+    void start();
+    void stop();
+
+    // Queue an SMS for deletion. modem_path may be empty if the owner is unknown.
+    void enqueue(const std::string& modem_path, const std::string& sms_path);
+
+private:
+    struct PendingDelete {
+        std::string modem_path;
+        std::string sms_path;
+        int attempts;
+        std::chrono::steady_clock::time_point not_before;
+    };
+
+    void workerLoop();
+    std::vector<PendingDelete> processBatch(std::vector<PendingDelete>& batch);
+    bool ensureManager();
+    void resetManager();
+    std::string findOwner(const std::string& sms_path);
+    bool deleteWithMmcli(const PendingDelete& item);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<PendingDelete> queue;
+    std::thread worker;
+    bool running;
+    int max_retries;
+
+    // Only touched by the worker thread
+    GMainContext* context;
+    GDBusConnection* bus;
+    MMManager* manager;
+};
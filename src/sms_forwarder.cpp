@@ -0,0 +1,655 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "sms_forwarder.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "probes.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <regex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Words that introduce a verification code
+static const char* const kCodeKeywords[] = {
+    "\u9a8c\u8bc1\u7801", "\u9a8c\u8bc1\u78bc", "\u6821\u9a8c\u7801", "\u6821\u9a8c\u78bc", "\u52a8\u6001\u7801", "\u52a8\u6001\u78bc",
+    "\u786e\u8ba4\u7801", "\u78ba\u8a8d\u78bc", "\u77ed\u4fe1\u7801", "\u77ed\u4fe1\u78bc", "code", "Code", "CODE"
+};
+
+bool isVerificationCode(const std::string& message) {
+    try {
+        if (message.empty()) {
+            LOG_WARNING("Empty message passed to isVerificationCode");
+            return false;
+        }
+
+        // Simple check for common verification code keywords before using regex
+        // This is faster and less prone to errors
+        if (message.find("\u9a8c\u8bc1\u7801") != std::string::npos ||
+            message.find("code") != std::string::npos ||
+            message.find("Code") != std::string::npos) {
+            return true;
+        }
+
+        // Check for common verification code keywords
+        try {
+            static const std::vector<std::string> keywords(std::begin(kCodeKeywords), std::end(kCodeKeywords));
+
+            for (const auto& keyword : keywords) {
+                try {
+                    if (message.find(keyword) != std::string::npos) {
+                        // Look for 4-6 digit numbers in the message
+                        try {
+                            std::regex digit_pattern("[0-9]{4,6}");
+                            std::smatch match;
+                            if (std::regex_search(message, match, digit_pattern)) {
+                                return true;
+                            }
+                        } catch (const std::exception& e) {
+                            LOG_ERROR("Exception in digit pattern regex: " + std::string(e.what()));
+                            // If regex fails, assume it's a verification code
+                            return true;
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Exception in keyword find: " + std::string(e.what()));
+                    // Continue with next keyword
+                }
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR("Exception in keywords initialization: " + std::string(e.what()));
+        }
+
+        return false;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Exception in isVerificationCode: " + std::string(e.what()));
+        return false;
+    } catch (...) {
+        LOG_ERROR("Unknown exception in isVerificationCode");
+        return false;
+    }
+}
+
+std::string extractVerificationCode(const std::string& message) {
+    size_t keyword = std::string::npos;
+    for (const char* word : kCodeKeywords) keyword = std::min(keyword, message.find(word));
+
+    std::string first;
+    for (size_t pos = 0; pos < message.size();) {
+        if (!isdigit(static_cast<unsigned char>(message[pos]))) {
+            pos++;
+            continue;
+        }
+        size_t end = pos;
+        while (end < message.size() && isdigit(static_cast<unsigned char>(message[end]))) end++;
+        // Phone numbers and amounts are longer or shorter
+        if (end - pos >= 4 && end - pos <= 8) {
+            if (keyword == std::string::npos || pos > keyword) return message.substr(pos, end - pos);
+            if (first.empty()) first = message.substr(pos, end - pos);
+        }
+        pos = end;
+    }
+    return first;
+}
+
+namespace {
+
+// Ingested messages are refused beyond this share of the push budget,
+// leaving the rest for SMS
+const double kIngestQueueShare = 0.75;
+
+// Spill file record: this header, the copies as (path length, archive entry,
+// path bytes), then sender, content, node, modem and time bytes
+struct SpillHeader {
+    uint32_t magic;  // kSpillMagic
+    uint32_t length; // Whole record including this header
+    uint32_t lane;
+    uint32_t sender_length;
+    uint32_t content_length;
+    uint32_t node_length;
+    uint32_t modem_length;
+    uint32_t time_length;
+    uint32_t copies;
+};
+
+// "SPL" and the layout version, bumped whenever SpillHeader changes
+const uint32_t kSpillMagic = 0x53504c02;
+
+void appendUint32(std::string& buffer, uint32_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// The modem's index as mmcli -m takes it, the last element of its object path
+std::string modemIndex(std::string_view modem_path) {
+    size_t slash = modem_path.rfind('/');
+    return std::string(slash == std::string_view::npos ? modem_path : modem_path.substr(slash + 1));
+}
+
+} // namespace
+
+SmsForwarder::SmsForwarder(PushScheduler& scheduler, SmsMonitor& monitor)
+    : scheduler(scheduler), monitor(monitor), archive(nullptr), code_recipients(0), undelivered_code_recipients(SIZE_MAX),
+      coalesce(false), spill_enabled(false),
+      spill_path(Config::getInstance().getSpillFile()),
+      spill_max_bytes(static_cast<size_t>(Config::getInstance().getSpillMaxBytes())), spill_bytes(0),
+      spill_inherited(0) {
+    bool evict_for_codes = false;
+    std::istringstream policy(Config::getInstance().getShedPolicy());
+    std::string action;
+    while (std::getline(policy, action, ',')) {
+        action.erase(0, action.find_first_not_of(" \t"));
+        action.erase(action.find_last_not_of(" \t") + 1);
+        if (action == "coalesce") coalesce = true;
+        else if (action == "spill") spill_enabled = !spill_path.empty();
+        else if (action == "drop_non_otp") evict_for_codes = true;
+        else if (!action.empty()) LOG_WARNING("Unknown shed_policy action: " + action);
+    }
+
+    scheduler.setBudget(
+        static_cast<size_t>(Config::getInstance().getMaxInflightSms()),
+        static_cast<size_t>(Config::getInstance().getMaxQueuedBytes()),
+        Config::getInstance().getMaxPendingRetries(),
+        evict_for_codes
+    );
+
+    const PushTemplate& title = Config::getInstance().getPushTitleTemplate();
+    sms_title = title.empty() ? PushTemplate("New SMS from {sender}") : title;
+    remote_title = title.empty() ? PushTemplate("New SMS from {sender} via {node}") : title;
+    ingest_title = title.empty() ? PushTemplate("Message from {sender}") : title;
+
+    struct stat st;
+    if (spill_enabled && stat(spill_path.c_str(), &st) == 0) {
+        spill_bytes = static_cast<size_t>(st.st_size);
+        spill_inherited = spill_bytes;
+    }
+}
+
+void SmsForwarder::setDeliveryHook(DeliveryHook hook) {
+    delivery_hook = std::move(hook);
+}
+
+void SmsForwarder::setArchive(SmsArchive* sms_archive) {
+    archive = sms_archive;
+}
+
+void SmsForwarder::routeVerificationCodes(size_t recipients) {
+    code_recipients = recipients;
+}
+
+void SmsForwarder::routeSender(const std::string& prefix, size_t recipients) {
+    sender_routes.emplace_back(prefix, recipients);
+}
+
+void SmsForwarder::routeUndeliveredCodes(size_t recipients) {
+    undelivered_code_recipients = recipients;
+}
+
+size_t SmsForwarder::recipientsFor(const Group& group) const {
+    for (const auto& route : sender_routes) {
+        if (group.sender.compare(0, route.first.size(), route.first) == 0) return route.second;
+    }
+    return group.lane == PushScheduler::Lane::VerificationCode ? code_recipients : 0;
+}
+
+size_t SmsForwarder::groupKey(const Group& group) {
+    // Accepted messages are never coalesced into a push that can be shed
+    return std::hash<std::string>()(group.sender + '\x1f' + group.content + (sheddable(group) ? "" : "\x1e"));
+}
+
+bool SmsForwarder::sheddable(const Group& group) {
+    // Only local SMS stay on the modem when their push is spilled or dropped
+    return group.node.empty() && !group.copies.front().sms_path.empty();
+}
+
+PushMessage SmsForwarder::pushMessage(const Group& group) const {
+    PushMessage message{std::string(), group.sender, group.content, std::string(), group.modem, group.time, group.node};
+    if (group.lane == PushScheduler::Lane::VerificationCode) {
+        message.code = extractVerificationCode(group.content);
+    }
+    const PushTemplate& title = !group.node.empty() ? remote_title
+                              : group.copies.front().sms_path.empty() ? ingest_title : sms_title;
+    title.render(message, message.title, false);
+    return message;
+}
+
+void SmsForwarder::onSms(SmsRecord record) {
+    try {
+        std::string sender(record.number);
+        std::string content(record.text);
+        LOG_DEBUG("Callback invoked with sender=" + sender + ", content=" + content);
+
+        uint32_t archive_entry = SmsArchive::kNoEntry;
+        if (archive) {
+            archive_entry = archive->append(record.number, record.text, record.modem_path, record.timestamp);
+        }
+
+        bool is_verification = false;
+        try {
+            is_verification = isVerificationCode(content);
+            LOG_DEBUG("Verification code check: " + std::string(is_verification ? "true" : "false"));
+        } catch (const std::exception& e) {
+            LOG_ERROR("Exception in verification code check: " + std::string(e.what()));
+            // Default to forwarding the message if verification check fails
+            is_verification = true;
+        }
+
+        // Skip non-verification code messages if configured to do so
+        if (Config::getInstance().getOnlyForwardVerificationCodes() && !is_verification) {
+            SMS_PROBE3(filter_decision, record.trace_id, content.size(), -1);
+            LOG_INFO("Skipping non-verification code SMS from " + sender);
+            if (archive) archive->setStatus(archive_entry, SmsArchive::Status::Filtered);
+            return;
+        }
+
+        // Verification codes jump the queue; messages found at startup go last
+        PushScheduler::Lane lane = PushScheduler::Lane::Normal;
+        if (is_verification) {
+            lane = PushScheduler::Lane::VerificationCode;
+        } else if (monitor.isReplayingBacklog()) {
+            lane = PushScheduler::Lane::Backlog;
+        }
+
+        SMS_PROBE3(filter_decision, record.trace_id, content.size(), static_cast<int>(lane));
+
+        auto group = std::make_shared<Group>(
+            Group{lane, std::move(sender), std::move(content), {Copy{std::string(record.path), archive_entry, std::string(record.timestamp), nullptr}},
+                  std::string(), modemIndex(record.modem_path), std::string(record.timestamp)});
+        if (!admit(group)) {
+            shed(group);
+        }
+        drainSpill();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Exception in SMS callback: " + std::string(e.what()));
+    } catch (...) {
+        LOG_ERROR("Unknown exception in SMS callback");
+    }
+
+}
+
+SmsForwarder::IngestResult SmsForwarder::onIngest(const std::string& source, const std::string& content) {
+    if (!scheduler.hasRoom(kIngestQueueShare)) {
+        return IngestResult::Busy;
+    }
+
+    bool is_verification = isVerificationCode(content);
+    if (Config::getInstance().getOnlyForwardVerificationCodes() && !is_verification) {
+        LOG_DEBUG("Skipping non-verification code message from " + source);
+        return IngestResult::Filtered;
+    }
+
+    PushScheduler::Lane lane = is_verification ? PushScheduler::Lane::VerificationCode : PushScheduler::Lane::Normal;
+    auto group = std::make_shared<Group>(
+        Group{lane, source, content, {Copy{std::string(), SmsArchive::kNoEntry, std::string(), nullptr}}, std::string(), std::string(),
+              std::string()});
+    if (!admit(group)) {
+        return IngestResult::Busy;
+    }
+    LOG_DEBUG("Queued message from " + source);
+    return IngestResult::Accepted;
+}
+
+SmsForwarder::IngestResult SmsForwarder::onRemote(const std::string& node, const SmsRecord& record, bool backlog,
+                                                  std::function<void(bool)> done) {
+    if (!scheduler.hasRoom(kIngestQueueShare)) {
+        return IngestResult::Busy;
+    }
+
+    std::string sender(record.number);
+    std::string content(record.text);
+    uint32_t archive_entry = SmsArchive::kNoEntry;
+    if (archive) {
+        archive_entry = archive->append(record.number, record.text, node + ":" + std::string(record.modem_path),
+                                        record.timestamp);
+    }
+
+    bool is_verification = isVerificationCode(content);
+    if (Config::getInstance().getOnlyForwardVerificationCodes() && !is_verification) {
+        LOG_INFO("Skipping non-verification code SMS from " + sender + " via " + node);
+        if (archive) archive->setStatus(archive_entry, SmsArchive::Status::Filtered);
+        return IngestResult::Filtered;
+    }
+
+    PushScheduler::Lane lane = is_verification ? PushScheduler::Lane::VerificationCode
+                             : backlog ? PushScheduler::Lane::Backlog : PushScheduler::Lane::Normal;
+    SMS_PROBE3(filter_decision, record.trace_id, content.size(), static_cast<int>(lane));
+
+    // No SMS path: the node deletes its own copy once it hears the push went out
+    auto group = std::make_shared<Group>(
+        Group{lane, std::move(sender), std::move(content), {Copy{std::string(), archive_entry, std::string(record.timestamp), std::move(done)}},
+              node, modemIndex(record.modem_path), std::string(record.timestamp)});
+    if (!admit(group)) {
+        if (archive) archive->setStatus(archive_entry, SmsArchive::Status::Dropped);
+        return IngestResult::Busy;
+    }
+    return IngestResult::Accepted;
+}
+
+bool SmsForwarder::admit(const GroupPtr& group) {
+    size_t key = groupKey(*group);
+    if (coalesce) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = waiting.find(key);
+        if (it != waiting.end()) {
+            // The queued push delivers this one too
+            auto& copies = it->second->copies;
+            copies.insert(copies.end(), group->copies.begin(), group->copies.end());
+            Metrics::getInstance().increment("sms_forward_shed_total{action=\"coalesced\"}",
+                                             static_cast<double>(group->copies.size()));
+            LOG_INFO("Coalesced duplicate SMS from " + group->sender + " into its queued push");
+            return true;
+        }
+        waiting[key] = group;
+    }
+
+    PushScheduler::Shed on_shed;
+    if (sheddable(*group)) on_shed = [this, group]() { shed(group); };
+    if (scheduler.submit(group->lane, pushMessage(*group),
+                         [this, group](bool success) { complete(group, success); },
+                         std::move(on_shed),
+                         smsTraceId(group->copies.front().sms_path), recipientsFor(*group),
+                         [this, group](DeliveryTracker::State state) { settle(group, state, true); })) {
+        return true;
+    }
+
+    release(group);
+    return false;
+}
+
+std::vector<SmsForwarder::Copy> SmsForwarder::release(const GroupPtr& group) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = waiting.find(groupKey(*group));
+    if (it != waiting.end() && it->second == group) {
+        waiting.erase(it);
+    }
+    // No copies can be added once the group is out of the map
+    return group->copies;
+}
+
+void SmsForwarder::complete(const GroupPtr& group, bool forwarding_success) {
+    LOG_DEBUG("WxPusher sendMessage result: " + std::string(forwarding_success ? "success" : "failure"));
+
+    std::vector<Copy> copies = release(group);
+
+    // Still queued at shutdown. SMS stay on their modem or fleet node and
+    // come back after the restart, but an ingested message was already
+    // accepted, so it is kept for the next run
+    if (!forwarding_success && !scheduler.isRunning() && group->node.empty() &&
+        group->copies.front().sms_path.empty()) {
+        if (spill_enabled && spill(*group)) {
+            LOG_INFO("Spilled message from " + group->sender + " still queued at shutdown");
+        } else {
+            LOG_ERROR("Lost message from " + group->sender + " still queued at shutdown");
+        }
+    }
+
+    for (const auto& copy : copies) {
+        // Copies coalesced into one push may differ in their timestamps
+        if (forwarding_success && !copy.sms_path.empty()) {
+            monitor.markForwarded(group->sender, group->content, copy.timestamp);
+        }
+        if (archive) {
+            archive->setStatus(copy.archive_entry, forwarding_success ? SmsArchive::Status::Forwarded
+                                                                      : SmsArchive::Status::Failed);
+        }
+
+        // Only delete SMS if forwarding was successful and deletion is enabled
+        if (forwarding_success && Config::getInstance().getDeleteAfterForwarding() && !copy.sms_path.empty()) {
+            // Deletion happens on the deleter thread, this only queues it
+            if (monitor.deleteSms(copy.sms_path)) {
+                LOG_INFO("SMS from " + group->sender + " queued for deletion after successful forwarding");
+            } else {
+                LOG_ERROR("Failed to queue deletion of SMS from " + group->sender + " after forwarding");
+            }
+        }
+
+        if (delivery_hook) {
+            delivery_hook(copy.sms_path, forwarding_success);
+        }
+        if (copy.finished) {
+            copy.finished(forwarding_success);
+        }
+    }
+
+    drainSpill();
+}
+
+void SmsForwarder::settle(const GroupPtr& group, DeliveryTracker::State state, bool first_push) {
+    // WxPusher never answered about the push, which says nothing about
+    // whether it arrived, so the archive keeps it as forwarded
+    if (state == DeliveryTracker::State::Unknown) {
+        LOG_DEBUG("Delivery of push of SMS from " + group->sender + " is unknown");
+        return;
+    }
+
+    // The copies are final once the push completed
+    if (archive) {
+        SmsArchive::Status status = state == DeliveryTracker::State::Delivered ? SmsArchive::Status::Delivered
+                                  : state == DeliveryTracker::State::Failed ? SmsArchive::Status::Undelivered
+                                  : SmsArchive::Status::Expired;
+        for (const auto& copy : group->copies) archive->setStatus(copy.archive_entry, status);
+    }
+    if (state == DeliveryTracker::State::Delivered) {
+        LOG_DEBUG("Push of SMS from " + group->sender + " delivered");
+        return;
+    }
+
+    LOG_WARNING("Push of SMS from " + group->sender + " was not delivered (" +
+                DeliveryTracker::stateName(state) + ")");
+    if (!first_push || group->lane != PushScheduler::Lane::VerificationCode) return;
+
+    // A code is worthless late but worse never, so it goes out once more,
+    // possibly to a fallback recipient; the SMS was already handled
+    size_t recipients = undelivered_code_recipients == SIZE_MAX ? recipientsFor(*group) : undelivered_code_recipients;
+    std::string sender = group->sender;
+    PushMessage message = pushMessage(*group);
+    message.title.insert(0, "Undelivered: ");
+    bool queued = scheduler.submit(
+        PushScheduler::Lane::VerificationCode, std::move(message),
+        [sender](bool success) {
+            if (!success) LOG_ERROR("Re-push of undelivered code from " + sender + " failed");
+        },
+        nullptr, smsTraceId(group->copies.front().sms_path), recipients,
+        [this, group](DeliveryTracker::State final_state) { settle(group, final_state, false); });
+    Metrics::getInstance().increment(std::string("sms_forward_delivery_repush_total{result=\"") +
+                                     (queued ? "queued" : "refused") + "\"}");
+    if (queued) {
+        LOG_INFO("Re-pushing undelivered verification code from " + sender);
+    } else {
+        LOG_ERROR("Cannot re-push undelivered verification code from " + sender + ", push queue full");
+    }
+}
+
+void SmsForwarder::shed(const GroupPtr& group) {
+    std::vector<Copy> copies = release(group);
+    double count = static_cast<double>(copies.size());
+
+    if (spill_enabled && spill(*group)) {
+        Metrics::getInstance().increment("sms_forward_shed_total{action=\"spilled\"}", count);
+        LOG_WARNING("Push queue full, spilled SMS from " + group->sender + " to " + spill_path);
+        return;
+    }
+
+    // Not deleted either, so the SMS stays on the modem
+    Metrics::getInstance().increment("sms_forward_shed_total{action=\"dropped\"}", count);
+    LOG_WARNING("Push queue full, dropped SMS from " + group->sender);
+    for (const auto& copy : copies) {
+        if (archive) archive->setStatus(copy.archive_entry, SmsArchive::Status::Dropped);
+        if (delivery_hook) delivery_hook(copy.sms_path, false);
+    }
+}
+
+bool SmsForwarder::spill(const Group& group) {
+    SpillHeader header{};
+    header.magic = kSpillMagic;
+    header.lane = static_cast<uint32_t>(group.lane);
+    header.sender_length = static_cast<uint32_t>(group.sender.size());
+    header.content_length = static_cast<uint32_t>(group.content.size());
+    header.node_length = static_cast<uint32_t>(group.node.size());
+    header.modem_length = static_cast<uint32_t>(group.modem.size());
+    header.time_length = static_cast<uint32_t>(group.time.size());
+    header.copies = static_cast<uint32_t>(group.copies.size());
+
+    std::string record(sizeof(header), '\0');
+    for (const auto& copy : group.copies) {
+        appendUint32(record, static_cast<uint32_t>(copy.sms_path.size()));
+        appendUint32(record, copy.archive_entry);
+        record += copy.sms_path;
+    }
+    record += group.sender;
+    record += group.content;
+    record += group.node;
+    record += group.modem;
+    record += group.time;
+    header.length = static_cast<uint32_t>(record.size());
+    memcpy(&record[0], &header, sizeof(header));
+
+    std::lock_guard<std::recursive_mutex> lock(spill_mutex);
+    if (spill_max_bytes > 0 && spill_bytes + record.size() > spill_max_bytes) return false;
+
+    std::string dir = spill_path.substr(0, spill_path.find_last_of('/'));
+    if (!dir.empty() && dir != spill_path) mkdir(dir.c_str(), 0700);
+
+    int fd = open(spill_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOG_ERROR("Cannot open spill file " + spill_path + ": " + strerror(errno));
+        return false;
+    }
+    bool written = write(fd, record.data(), record.size()) == static_cast<ssize_t>(record.size());
+    close(fd);
+    if (written) spill_bytes += record.size();
+    Metrics::getInstance().setGauge("sms_forward_spill_bytes", static_cast<double>(spill_bytes));
+    return written;
+}
+
+bool SmsForwarder::readSpill(std::string& data) {
+    data.clear();
+    int fd = open(spill_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) data.append(buffer, static_cast<size_t>(n));
+    close(fd);
+    return n == 0;
+}
+
+void SmsForwarder::drainSpill() {
+    std::lock_guard<std::recursive_mutex> lock(spill_mutex);
+    if (spill_bytes == 0 || !scheduler.isRunning() || !scheduler.hasRoom(0.5)) return;
+
+    std::string data;
+    if (!readSpill(data)) {
+        spill_bytes = 0;
+        spill_inherited = 0;
+        return;
+    }
+
+    // Re-queue from the front until the scheduler refuses
+    size_t pos = 0;
+    size_t requeued = 0;
+    size_t replayed = 0;
+    while (pos + sizeof(SpillHeader) <= data.size()) {
+        SpillHeader header;
+        memcpy(&header, data.data() + pos, sizeof(header));
+        if (header.magic != kSpillMagic || header.length < sizeof(header) || pos + header.length > data.size()) {
+            LOG_ERROR("Corrupt spill file " + spill_path + ", discarding its tail");
+            pos = data.size();
+            break;
+        }
+
+        auto group = std::make_shared<Group>();
+        group->lane = header.lane <= static_cast<uint32_t>(PushScheduler::Lane::Backlog)
+            ? static_cast<PushScheduler::Lane>(header.lane) : PushScheduler::Lane::Normal;
+
+        // Every length is checked against the end of the record before use
+        size_t end = pos + header.length;
+        size_t field = pos + sizeof(header);
+        auto take = [&](size_t length, std::string& out) {
+            if (length > end - field) return false;
+            out.assign(data, field, length);
+            field += length;
+            return true;
+        };
+        auto takeUint32 = [&](uint32_t& out) {
+            if (end - field < 4) return false;
+            memcpy(&out, data.data() + field, 4);
+            field += 4;
+            return true;
+        };
+
+        bool intact = header.copies > 0;
+        for (uint32_t i = 0; intact && i < header.copies; i++) {
+            uint32_t path_length;
+            Copy copy;
+            intact = takeUint32(path_length) && takeUint32(copy.archive_entry) && take(path_length, copy.sms_path);
+            if (intact) group->copies.push_back(std::move(copy));
+        }
+        intact = intact && take(header.sender_length, group->sender) &&
+                 take(header.content_length, group->content) && take(header.node_length, group->node) &&
+                 take(header.modem_length, group->modem) && take(header.time_length, group->time);
+        if (!intact) {
+            LOG_ERROR("Corrupt spill file " + spill_path + ", discarding its tail");
+            pos = data.size();
+            break;
+        }
+        // Only the push's timestamp is spilled; a coalesced copy with another
+        // one is then not marked forwarded and stays on the modem
+        for (auto& copy : group->copies) copy.timestamp = group->time;
+
+        // An SMS spilled by an earlier run is still on the modem, where the
+        // existing SMS replay finds it; its path may name another message
+        // since ModemManager restarted
+        if (pos < spill_inherited && !group->copies.front().sms_path.empty()) {
+            pos += header.length;
+            replayed++;
+            continue;
+        }
+
+        if (!admit(group)) break;
+        pos += header.length;
+        requeued++;
+    }
+    if (pos == 0) return;
+    if (replayed > 0) {
+        LOG_INFO("Dropped " + std::to_string(replayed) + " SMS spilled before the restart, they stay on the modem");
+    }
+
+    // Keep the rest, including anything evictions spilled meanwhile
+    std::string rest;
+    readSpill(rest);
+    rest.erase(0, std::min(pos, rest.size()));
+
+    std::string tmp_path = spill_path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool written = fd >= 0 && write(fd, rest.data(), rest.size()) == static_cast<ssize_t>(rest.size());
+    if (fd >= 0) close(fd);
+    if (!written || rename(tmp_path.c_str(), spill_path.c_str()) != 0) {
+        // Re-queued messages may be queued again later; duplicates beat losses
+        LOG_ERROR("Cannot rewrite spill file " + spill_path + ": " + strerror(errno));
+        return;
+    }
+
+    spill_bytes = rest.size();
+    spill_inherited -= std::min(pos, spill_inherited);
+    Metrics::getInstance().setGauge("sms_forward_spill_bytes", static_cast<double>(spill_bytes));
+    LOG_INFO("Re-queued " + std::to_string(requeued) + " spilled SMS, " +
+             std::to_string(spill_bytes) + " bytes still spilled");
+}
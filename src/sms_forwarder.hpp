@@ -0,0 +1,141 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include "sms_monitor.hpp"
+#include "push_scheduler.hpp"
+#include "sms_archive.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Check if a message contains a verification code
+bool isVerificationCode(const std::string& message);
+
+// The code in a verification code message: the first run of 4 to 8 digits
+// after a keyword such as "code", else the first one. Empty if there is none.
+std::string extractVerificationCode(const std::string& message);
+
+// The SMS callback: filters a received SMS, queues it on the push scheduler
+// and, once delivered, marks it forwarded and queues its deletion. When the
+// scheduler's budget is exhausted, the shed_policy decides what happens:
+// duplicates of a queued SMS are coalesced into its push, verification codes
+// evict other pushes, and whatever does not fit is spilled to disk and
+// re-queued once the queue has drained, or else dropped. When the scheduler
+// tracks delivery, a verification code that never reaches a phone is pushed
+// once more.
+class SmsForwarder {
+public:
+    // Called on the scheduler thread with the SMS path once a push has finished
+    using DeliveryHook = std::function<void(const std::string&, bool)>;
+
+    enum class IngestResult { Accepted, Filtered, Busy };
+
+    SmsForwarder(PushScheduler& scheduler, SmsMonitor& monitor);
+
+    // The record is consumed; sender, text and path are copied into the push once
+    void onSms(SmsRecord record);
+
+    // Forward a message from a local producer through the same filters and
+    // queue. Producers can retry, so instead of shedding, Busy is returned
+    // while the queue is fuller than an SMS flood should find it. Once
+    // accepted, the push is never evicted, spilled or dropped.
+    IngestResult onIngest(const std::string& source, const std::string& content);
+
+    // Forward an SMS received by another node of the fleet, see
+    // AggregatorServer. Like ingested messages it is refused with Busy
+    // rather than shed, since the node keeps it until it is pushed.
+    // backlog marks messages the node found in storage at startup. Once an
+    // accepted message's push has finished, done is called on the
+    // scheduler thread with whether it succeeded.
+    IngestResult onRemote(const std::string& node, const SmsRecord& record, bool backlog,
+                          std::function<void(bool)> done);
+    void setDeliveryHook(DeliveryHook hook);
+
+    // Record every SMS and its forward status in archive, which must outlive the forwarder
+    void setArchive(SmsArchive* archive);
+
+    // Recipient lists registered with WxPusher::addRecipients. A sender
+    // route applies to senders starting with prefix and wins over the code
+    // route; the first matching one is used. Set up before the first SMS.
+    void routeVerificationCodes(size_t recipients);
+    void routeSender(const std::string& prefix, size_t recipients);
+
+    // Where a verification code goes again after its push failed or expired
+    // undelivered; by default to the recipients it was pushed to
+    void routeUndeliveredCodes(size_t recipients);
+
+    // Re-queue spilled messages while the scheduler runs and has room,
+    // including messages ingested in a previous run; SMS spilled by one are
+    // left to the existing SMS replay
+    void drainSpill();
+
+private:
+    // An SMS waiting for a push, possibly one of several identical ones.
+    // Ingested messages have no SMS path.
+    struct Copy {
+        std::string sms_path;
+        uint32_t archive_entry;
+        std::string timestamp;              // Modem timestamp of this SMS, marks it forwarded
+        std::function<void(bool)> finished; // Reports the push of an SMS from a fleet node
+    };
+
+    // One push and every SMS it stands for
+    struct Group {
+        PushScheduler::Lane lane;
+        std::string sender;
+        std::string content;
+        std::vector<Copy> copies;
+        std::string node; // Fleet node that received it, empty for local messages
+        std::string modem; // Modem index, empty for ingested messages
+        std::string time; // Send time reported by the modem
+    };
+    using GroupPtr = std::shared_ptr<Group>;
+
+    bool admit(const GroupPtr& group);
+    void complete(const GroupPtr& group, bool success);
+    void settle(const GroupPtr& group, DeliveryTracker::State state, bool first_push);
+    void shed(const GroupPtr& group);
+    std::vector<Copy> release(const GroupPtr& group);
+    bool spill(const Group& group);
+    bool readSpill(std::string& data);
+    static size_t groupKey(const Group& group);
+    static bool sheddable(const Group& group);
+    PushMessage pushMessage(const Group& group) const;
+    size_t recipientsFor(const Group& group) const;
+
+    PushScheduler& scheduler;
+    SmsMonitor& monitor;
+    DeliveryHook delivery_hook;
+    SmsArchive* archive;
+    size_t code_recipients; // 0 is the default list
+    size_t undelivered_code_recipients; // SIZE_MAX for the list the code was pushed to
+    std::vector<std::pair<std::string, size_t>> sender_routes;
+    PushTemplate sms_title;    // Titles of local SMS, SMS from fleet nodes and ingested messages
+    PushTemplate remote_title;
+    PushTemplate ingest_title;
+
+    bool coalesce;
+    bool spill_enabled;
+    std::mutex mutex;
+    std::unordered_map<size_t, GroupPtr> waiting; // Queued pushes by sender and text, when coalescing
+    std::recursive_mutex spill_mutex; // Evictions while draining spill again
+    std::string spill_path;
+    size_t spill_max_bytes;
+    size_t spill_bytes;
+    size_t spill_inherited; // Leading bytes of the spill file written by an earlier run
+};
@@ -15,16 +15,41 @@
 #include "sms_monitor.hpp"
 #include "logger.hpp"
 #include "config.hpp"
+#include "metrics.hpp"
+#include "mm_async.hpp"
+#include "modem_bus.hpp"
+#include "probes.hpp"
+#include "watchdog.hpp"
+#include <climits>
+#include <cstring>
 #include <stdexcept>
 #include <ModemManager.h>
 #include <libmm-glib.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <gio/gio.h>
-#include <time.h>  // For nanosleep
 
-SmsMonitor::SmsMonitor() : connection(nullptr) {}
+namespace {
+
+// Reads of an SMS whose text or number is still arriving, and the gap between them
+const int kContentAttempts = 5;
+const guint kContentRetryMs = 1000;
+
+} // namespace
+
+SmsMonitor::SmsMonitor()
+    : connection(nullptr), running(false), replaying_backlog(false),
+      deleter(Config::getInstance().getMaxPendingRetries()),
+      storage_watcher(deleter,
+                      Config::getInstance().getStorageCheckInterval(),
+                      Config::getInstance().getStoragePruneThreshold()),
+      modem_outage(false),
+      // Without a startup replay, only messages after startup count as new
+      forward_since(Config::getInstance().getForwardExistingSms() ? 0 : time(nullptr)) {}
 
 SmsMonitor::~SmsMonitor() {
+    storage_watcher.stop();
+    deleter.stop();
     if (connection) {
         dbus_connection_unref(connection);
     }
@@ -34,13 +59,17 @@ bool SmsMonitor::init() {
     DBusError error;
     dbus_error_init(&error);
 
-    connection = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
+    connection = openModemBus(&error);
     if (!connection) {
-        LOG_ERROR("Failed to connect to system bus: " + std::string(error.message));
+        LOG_ERROR("Failed to connect to ModemManager bus: " + std::string(error.message));
         dbus_error_free(&error);
         return false;
     }
 
+    // Bound what libdbus buffers while a flood of signals is worked through;
+    // beyond this the bus daemon holds the backlog instead of us
+    dbus_connection_set_max_received_size(connection, 1024 * 1024);
+
     dbus_bus_add_match(connection,
         "type='signal',interface='org.freedesktop.ModemManager1.Modem.Messaging'",
         &error);
@@ -51,6 +80,38 @@ bool SmsMonitor::init() {
         return false;
     }
 
+    // Modems appearing and disappearing keep the mirror in step
+    dbus_bus_add_match(connection,
+        "type='signal',interface='org.freedesktop.DBus.ObjectManager',"
+        "path='/org/freedesktop/ModemManager1'",
+        &error);
+
+    if (dbus_error_is_set(&error)) {
+        LOG_ERROR("Failed to add match: " + std::string(error.message));
+        dbus_error_free(&error);
+        return false;
+    }
+
+    // ModemManager restarting drops every modem and SMS object at once
+    dbus_bus_add_match(connection,
+        "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+        "member='NameOwnerChanged',arg0='org.freedesktop.ModemManager1'",
+        &error);
+
+    if (dbus_error_is_set(&error)) {
+        LOG_ERROR("Failed to add match: " + std::string(error.message));
+        dbus_error_free(&error);
+        return false;
+    }
+
+    // Seed after subscribing so nothing falls between the two; signals for
+    // already mirrored SMS are ignored as duplicates. The reply is handled
+    // once run() dispatches the main context.
+    seedMirror();
+
+    deleter.start();
+    storage_watcher.start();
+
     LOG_INFO("SMS Monitor initialized successfully");
     return true;
 }
@@ -60,632 +121,642 @@ void SmsMonitor::setCallback(SmsCallback cb) {
 }
 
 void SmsMonitor::run() {
-    while (dbus_connection_read_write_dispatch(connection, -1)) {
-        DBusMessage* msg = dbus_connection_pop_message(connection);
-        if (msg) {
-            handleMessage(msg, this);
-            dbus_message_unref(msg);
-        }
+    // Signals arrive through libdbus, the replies SMS coroutines wait for
+    // through GDBus; both are dispatched from the default main context
+    int fd = -1;
+    if (!dbus_connection_get_unix_fd(connection, &fd)) {
+        LOG_ERROR("Cannot watch the ModemManager bus connection");
+        return;
     }
+    guint bus_watch = g_unix_fd_add(fd, static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+                                    onBusReadable, this);
+    // Wake up at least once per second for periodic housekeeping
+    guint housekeeping = g_timeout_add(1000, onHousekeeping, this);
+
+    running = true;
+    // Signals read while init() waited for its own replies
+    drainSignals();
+    while (running) {
+        g_main_context_iteration(nullptr, TRUE);
+    }
+
+    g_source_remove(housekeeping);
+    g_source_remove(bus_watch);
 }
 
-void SmsMonitor::processSms(MMSms* sms) {
-    LOG_DEBUG("processSms called");
+gboolean SmsMonitor::onBusReadable(gint, GIOCondition, gpointer user_data) {
+    auto* monitor = static_cast<SmsMonitor*>(user_data);
 
-    if (!sms) {
-        LOG_ERROR("processSms: SMS is null");
-        return;
+    // Read whatever arrived without blocking; false once the bus is gone
+    if (!dbus_connection_read_write(monitor->connection, 0)) {
+        LOG_ERROR("Lost the ModemManager bus connection");
+        monitor->running = false;
+        return G_SOURCE_REMOVE;
     }
+    monitor->drainSignals();
+    return G_SOURCE_CONTINUE;
+}
 
-    if (!callback) {
-        LOG_ERROR("processSms: Callback is not set");
-        return;
+gboolean SmsMonitor::onHousekeeping(gpointer user_data) {
+    auto* monitor = static_cast<SmsMonitor*>(user_data);
+    Watchdog::getInstance().beat(WatchedLoop::Monitor);
+    Metrics::getInstance().flush(Config::getInstance().getMetricsFile());
+    Logger::getInstance().flushRepeats();
+    if (!dbus_connection_get_is_connected(monitor->connection)) {
+        LOG_ERROR("Lost the ModemManager bus connection");
+        monitor->running = false;
     }
+    return G_SOURCE_CONTINUE;
+}
 
-    // Get the SMS path for retry identification
-    const char* sms_path = mm_sms_get_path(sms);
-    std::string path_str = sms_path ? std::string(sms_path) : "unknown";
+void SmsMonitor::drainSignals() {
+    bool handled = false;
+    while (DBusMessage* msg = dbus_connection_pop_message(connection)) {
+        Watchdog::getInstance().beat(WatchedLoop::Monitor);
+        Watchdog::Stage stage(WatchedLoop::Monitor, "signal dispatch");
+        handleMessage(msg, this);
+        dbus_message_unref(msg);
+        handled = true;
+    }
+    if (handled) {
+        Metrics::getInstance().flush(Config::getInstance().getMetricsFile());
+    }
+}
 
-    // Check the SMS state to only process received messages
-    MMSmsState state = mm_sms_get_state(sms);
-    LOG_DEBUG("SMS state: " + std::to_string(state));
+void SmsMonitor::markForwarded(const std::string& sender, const std::string& text, const std::string& timestamp) {
+    storage_watcher.markForwarded(sender, text, timestamp);
+}
 
-    // Only process received SMS messages
-    if (state != MM_SMS_STATE_RECEIVED) {
-        LOG_DEBUG("Skipping SMS with state " + std::to_string(state) + " (not received)");
-        return;
+// Parse a ModemManager timestamp such as 2025-03-01T08:15:30+08:00 into
+// seconds since the epoch, or -1 if it is not in that form
+static time_t parseSmsTimestamp(const char* timestamp) {
+    if (!timestamp) return -1;
+
+    struct tm tm = {};
+    int consumed = 0;
+    if (sscanf(timestamp, "%4d-%2d-%2dT%2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed) != 6) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    time_t result = timegm(&tm);
+
+    // Optional fraction, then Z, +HH, +HHMM or +HH:MM
+    const char* zone = timestamp + consumed;
+    if (*zone == '.') {
+        zone++;
+        while (isdigit(static_cast<unsigned char>(*zone))) zone++;
+    }
+    if (*zone == '+' || *zone == '-') {
+        int hours = 0, minutes = 0;
+        const char* format = zone[1] && zone[2] && zone[3] == ':' ? "%2d:%2d" : "%2d%2d";
+        if (sscanf(zone + 1, format, &hours, &minutes) < 1) return -1;
+        int offset = hours * 3600 + minutes * 60;
+        result += *zone == '+' ? -offset : offset;
+    }
+    return result;
+}
+
+// Forwarded messages remembered for recognising them when a modem comes back
+static const size_t kForwardedKeys = 4096;
+
+static size_t messageKey(std::string_view timestamp, std::string_view number, std::string_view text) {
+    std::hash<std::string_view> hash;
+    return (hash(timestamp) * 31 + hash(number)) * 31 + hash(text);
+}
+
+bool SmsMonitor::alreadyForwarded(const SmsRecord& record) const {
+    // Only the very message counts: a later SMS with an older modem
+    // timestamp, delayed by the SMSC or from a skewed clock, is new
+    if (forwarded_keys.count(messageKey(record.timestamp, record.number, record.text)) > 0) return true;
+
+    // Unknown timestamps are treated as new: a duplicate beats a lost message
+    time_t when = parseSmsTimestamp(record.timestamp.data());
+    return when >= 0 && when < forward_since;
+}
+
+void SmsMonitor::dispatch(SmsRecord record) {
+    size_t key = messageKey(record.timestamp, record.number, record.text);
+    if (forwarded_keys.insert(key).second) {
+        forwarded_order.push_back(key);
+        if (forwarded_order.size() > kForwardedKeys) {
+            forwarded_keys.erase(forwarded_order.front());
+            forwarded_order.pop_front();
+        }
     }
 
-    // Check the storage type to avoid duplicate processing
-    MMSmsStorage storage = mm_sms_get_storage(sms);
-    LOG_DEBUG("SMS storage type: " + std::to_string(storage));
+    if (record.modem_path.empty()) {
+        record.modem_path = record.keep(mirror.ownerOf(std::string(record.path)));
+    }
+    callback(std::move(record));
+}
 
-    // Only process SMS messages with storage type MM_SMS_STORAGE_ME (ME = mobile equipment)
-    // Skip MM_SMS_STORAGE_SM (SM = SIM card) to avoid duplicates
-    if (storage != MM_SMS_STORAGE_ME) {
-        LOG_DEBUG("Skipping SMS with storage type " + std::to_string(storage) + " (only processing ME storage)");
+void SmsMonitor::rememberOwner(std::string_view sms_path, std::string_view modem_path) {
+    // Owners are only needed to route deletions
+    if (!Config::getInstance().getDeleteAfterForwarding() || sms_path.empty()) {
         return;
     }
 
-    // Try to get text and number with retries
-    const char* text = nullptr;
-    const char* number = nullptr;
-    int max_retries = 5;
-    int retry_delay_ms = 1000; // 1 second
+    std::lock_guard<std::mutex> lock(owners_mutex);
+    sms_owners[std::string(sms_path)] = std::string(modem_path);
+}
 
-    for (int retry = 0; retry < max_retries; retry++) {
-        text = mm_sms_get_text(sms);
-        number = mm_sms_get_number(sms);
+// Number and text from the output of mmcli --sms, where values are quoted
+// after their labels
+static bool parseMmcliSms(const std::string& output, std::string& number, std::string& text) {
+    auto extract = [&output](const char* label) {
+        size_t pos = output.find(label);
+        if (pos == std::string::npos) return std::string();
+        size_t start = output.find('\'', pos);
+        size_t end = output.find('\'', start + 1);
+        if (start == std::string::npos || end == std::string::npos) return std::string();
+        return output.substr(start + 1, end - start - 1);
+    };
+
+    number = extract("number:");
+    text = extract("text:");
+    return !number.empty() && !text.empty();
+}
 
-        LOG_DEBUG("processSms [" + path_str + "] retry " + std::to_string(retry) + ": text=" +
-                 (text ? std::string(text) : "null") + ", number=" +
-                 (number ? std::string(number) : "null"));
+// Index of a ModemManager object, the last component of its path, or -1
+static int objectIndex(const std::string& path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos || slash + 1 == path.size()) return -1;
+    char* end = nullptr;
+    long index = strtol(path.c_str() + slash + 1, &end, 10);
+    return *end == '\0' && index >= 0 && index <= INT_MAX ? static_cast<int>(index) : -1;
+}
 
-        if (text && number) {
-            break; // We have both text and number, no need to retry
-        }
+AsyncTask SmsMonitor::resolveSms(std::string sms_path, std::string modem_path) {
+    if (!callback) {
+        LOG_ERROR("resolveSms: Callback is not set");
+        co_return;
+    }
 
-        if (retry < max_retries - 1) {
+    // Text and number may still be arriving; other messages and signals are
+    // handled while this one waits for the next read
+    // A batch of one; the arena grows if the text is long
+    SmsRecord record(std::make_shared<SmsArena>(512), sms_path, modem_path);
+    bool complete = false;
+    GDBusConnection* bus = mirror.connection();
+    for (int attempt = 0; bus && attempt < kContentAttempts && !complete; attempt++) {
+        if (attempt > 0) {
             LOG_DEBUG("Waiting for SMS to be fully received, retrying in " +
-                     std::to_string(retry_delay_ms) + "ms...");
+                      std::to_string(kContentRetryMs) + "ms...");
+            co_await sleepFor(kContentRetryMs);
+        }
 
-            // Sleep for retry_delay_ms milliseconds
-            struct timespec ts;
-            ts.tv_sec = retry_delay_ms / 1000;
-            ts.tv_nsec = (retry_delay_ms % 1000) * 1000000;
-            nanosleep(&ts, nullptr);
+        auto reply = co_await callModemManager(bus, sms_path, "org.freedesktop.DBus.Properties", "GetAll",
+                                               g_variant_new("(s)", MM_DBUS_INTERFACE_SMS),
+                                               G_VARIANT_TYPE("(a{sv})"), 5000);
+        if (!reply.value) {
+            LOG_ERROR_LIMITED(reply.message(), "Failed to read SMS " + sms_path + ": " + reply.message());
+            break;
+        }
+        GVariant* properties = g_variant_get_child_value(reply.value, 0);
+        ModemMirror::decodeSms(properties, record);
+        g_variant_unref(properties);
+        g_variant_unref(reply.value);
+
+        LOG_DEBUG("resolveSms [" + sms_path + "] attempt " + std::to_string(attempt) + ": state=" +
+                  std::to_string(record.state) + ", storage=" + std::to_string(record.storage) +
+                  ", text=" + std::string(record.text) + ", number=" + std::string(record.number));
+
+        // Only received messages, and only the ME copy: the SM (SIM) one would be a duplicate
+        if (record.state != MM_SMS_STATE_RECEIVED) {
+            LOG_DEBUG("Skipping SMS with state " + std::to_string(record.state) + " (not received)");
+            co_return;
+        }
+        if (record.storage != MM_SMS_STORAGE_ME) {
+            LOG_DEBUG("Skipping SMS with storage type " + std::to_string(record.storage) +
+                      " (only processing ME storage)");
+            co_return;
         }
-    }
 
-    if (text && number) {
-        LOG_INFO("SMS from: " + std::string(number));
-        LOG_DEBUG("SMS content: " + std::string(text));
-
-        LOG_DEBUG("Calling callback with number=" + std::string(number) + ", text=" + std::string(text));
-        callback(number, text, sms);
-        LOG_DEBUG("Callback completed");
-    } else {
-        LOG_ERROR("processSms: Text or number is still null after " +
-                 std::to_string(max_retries) + " retries");
-
-        // Try to get the SMS directly using mmcli as a last resort
-        if (sms_path) {
-            // Extract the SMS index from the path
-            const char* sms_index_str = strrchr(sms_path, '/');
-            if (sms_index_str) {
-                sms_index_str++; // Skip the '/' character
-                int sms_index = atoi(sms_index_str);
-                LOG_DEBUG("Attempting to get SMS content using mmcli for SMS index " +
-                         std::to_string(sms_index));
-
-                // Get the SMS content using mmcli
-                std::string cmd = "mmcli -m 0 --sms=" + std::to_string(sms_index);
-                FILE* pipe = popen(cmd.c_str(), "r");
-                if (pipe) {
-                    char buffer[1024];
-                    std::string result = "";
-                    while (!feof(pipe)) {
-                        if (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-                            result += buffer;
-                        }
-                    }
-                    pclose(pipe);
-
-                    LOG_DEBUG("mmcli output: " + result);
-
-                    // Parse the output to get the SMS content and number
-                    std::string parsed_number = "";
-                    std::string parsed_text = "";
-
-                    // Extract number
-                    size_t number_pos = result.find("number:");
-                    if (number_pos != std::string::npos) {
-                        size_t start = result.find('\'', number_pos);
-                        size_t end = result.find('\'', start + 1);
-                        if (start != std::string::npos && end != std::string::npos) {
-                            parsed_number = result.substr(start + 1, end - start - 1);
-                        }
-                    }
-
-                    // Extract text
-                    size_t text_pos = result.find("text:");
-                    if (text_pos != std::string::npos) {
-                        size_t start = result.find('\'', text_pos);
-                        size_t end = result.find('\'', start + 1);
-                        if (start != std::string::npos && end != std::string::npos) {
-                            parsed_text = result.substr(start + 1, end - start - 1);
-                        }
-                    }
-
-                    if (!parsed_number.empty() && !parsed_text.empty()) {
-                        LOG_INFO("Successfully extracted SMS content using mmcli");
-                        LOG_INFO("SMS from: " + parsed_number);
-                        LOG_DEBUG("SMS content: " + parsed_text);
-
-                        // Call the callback directly
-                        callback(parsed_number.c_str(), parsed_text.c_str(), nullptr);
-                    }
-                }
-            }
+        complete = !record.text.empty() && !record.number.empty();
+        if (complete) {
+            SMS_PROBE3(content_ready, record.trace_id, record.text.size(), attempt);
         }
     }
-}
 
-void SmsMonitor::checkExistingSms() {
-    if (!callback) {
-        LOG_WARNING("No callback set, skipping existing SMS check");
-        return;
+    // After an outage ModemManager announces its stored messages again
+    if (complete && std::chrono::steady_clock::now() < recovering_until &&
+        alreadyForwarded(record)) {
+        LOG_DEBUG("Skipping SMS " + sms_path + " from " + std::string(record.timestamp) +
+                  ", forwarded before the outage");
+        co_return;
     }
 
-    LOG_INFO("Checking for existing SMS messages...");
+    rememberOwner(sms_path, modem_path);
+
+    if (complete) {
+        LOG_INFO("SMS from: " + std::string(record.number));
+        LOG_DEBUG("SMS content: " + std::string(record.text));
+        dispatch(std::move(record));
+        co_return;
+    }
 
+    // Last resort when the properties cannot be read or stay empty: mmcli,
+    // run in the background, on the modem that owns the SMS
+    LOG_ERROR_LIMITED(modem_path, "resolveSms: Text or number of " + sms_path + " is still missing");
+    if (modem_path.empty()) modem_path = mirror.ownerOf(sms_path);
+    int modem_index = objectIndex(modem_path);
+    int sms_index = objectIndex(sms_path);
+    if (modem_index < 0 || sms_index < 0) co_return;
+
+    LOG_DEBUG("Attempting to get SMS content using mmcli for SMS " + std::to_string(sms_index) +
+              " on modem " + std::to_string(modem_index));
+    std::string modem_arg = "--modem=" + std::to_string(modem_index);
+    std::string sms_arg = "--sms=" + std::to_string(sms_index);
+    const gchar* argv[] = {"mmcli", modem_arg.c_str(), sms_arg.c_str(), nullptr};
     GError* error = nullptr;
-    GDBusConnection* connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
-    if (error) {
-        LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
+    GSubprocess* process = g_subprocess_newv(argv, static_cast<GSubprocessFlags>(G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                                                                G_SUBPROCESS_FLAGS_STDERR_SILENCE),
+                                             &error);
+    if (!process) {
+        LOG_ERROR_LIMITED("mmcli", "Cannot run mmcli: " + std::string(error->message));
         g_error_free(error);
-        return;
+        co_return;
     }
+    auto output = co_await subprocessCommunicate(process);
+    g_object_unref(process);
+    if (!output.value) {
+        LOG_ERROR_LIMITED("mmcli", "mmcli failed for " + sms_path + ": " + output.message());
+        co_return;
+    }
+    std::string result(output.value);
+    g_free(output.value);
+    LOG_DEBUG("mmcli output: " + result);
+
+    std::string number, text;
+    if (parseMmcliSms(result, number, text)) {
+        LOG_INFO("Successfully extracted SMS content using mmcli");
+        LOG_INFO("SMS from: " + number);
+        LOG_DEBUG("SMS content: " + text);
+        record.number = record.keep(number);
+        record.text = record.keep(text);
+        dispatch(std::move(record));
+    }
+}
 
-    // Create ModemManager Manager proxy
-    MMManager* manager = mm_manager_new_sync(
-        connection,
-        G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-        nullptr,  // cancellable
-        &error
-    );
-
-    if (error) {
-        LOG_ERROR("Failed to create ModemManager proxy: " + std::string(error->message));
-        g_error_free(error);
-        g_object_unref(connection);
-        return;
+AsyncTask SmsMonitor::checkExistingSms() {
+    if (!callback) {
+        LOG_WARNING("No callback set, skipping existing SMS check");
+        co_return;
     }
 
-    // Get all modems
-    GList* modems = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
-    if (!modems) {
+    LOG_INFO("Checking for existing SMS messages...");
+
+    // One bulk read of every stored SMS; filtering needs no further bus traffic
+    GDBusConnection* bus = mirror.connection();
+    if (!bus) {
+        LOG_ERROR("Failed to take SMS snapshot");
+        co_return;
+    }
+    auto objects = co_await getManagedObjects(bus);
+    if (!objects.ok()) {
+        LOG_ERROR("Failed to take SMS snapshot: " + objects.message());
+        co_return;
+    }
+    std::vector<SmsRecord> records;
+    GVariant* tree = g_variant_get_child_value(objects.value, 0);
+    auto fetch = mirror.snapshot(tree, records);
+    g_variant_unref(tree);
+    g_variant_unref(objects.value);
+    if (!co_await fetch) {
+        LOG_ERROR("Failed to take SMS snapshot");
+        co_return;
+    }
+    if (mirror.modemPaths().empty()) {
         LOG_WARNING("No modems found");
-        g_object_unref(manager);
-        g_object_unref(connection);
-        return;
+        co_return;
     }
 
+    Watchdog::Stage stage(WatchedLoop::Monitor, "existing SMS replay");
     int processed_count = 0;
+    replaying_backlog = true;
 
-    // Process each modem
-    for (GList* m = modems; m; m = g_list_next(m)) {
-        MMObject* modem_obj = MM_OBJECT(m->data);
-        MMModemMessaging* messaging = mm_object_get_modem_messaging(modem_obj);
+    for (auto& record : records) {
+        // Only process received messages
+        if (record.state != MM_SMS_STATE_RECEIVED) continue;
+        processed_count++;
 
-        if (!messaging) {
-            LOG_DEBUG("Modem does not support messaging");
+        // Only ME storage, the SM copy would be a duplicate
+        if (record.storage != MM_SMS_STORAGE_ME) {
+            LOG_DEBUG("Skipping SMS " + std::string(record.path) + " with storage type " +
+                      std::to_string(record.storage));
             continue;
         }
 
-        // List SMS messages
-        GList* sms_list = mm_modem_messaging_list_sync(messaging, nullptr, &error);
-        if (error) {
-            LOG_ERROR("Failed to get SMS list: " + std::string(error->message));
-            g_error_free(error);
-            error = nullptr;
-            g_object_unref(messaging);
+        // Content still arriving: resolve it in the background
+        if (record.number.empty() || record.text.empty()) {
+            resolveSms(std::string(record.path), std::string(record.modem_path));
             continue;
         }
 
-        // Process each SMS
-        for (GList* l = sms_list; l; l = g_list_next(l)) {
-            MMSms* sms = MM_SMS(l->data);
-            MMSmsState state = mm_sms_get_state(sms);
-
-            // Only process received messages
-            if (state == MM_SMS_STATE_RECEIVED) {
-                processSms(sms);
-                processed_count++;
-            }
-        }
-
-        // Cleanup
-        g_list_free_full(sms_list, g_object_unref);
-        g_object_unref(messaging);
+        rememberOwner(record.path, record.modem_path);
+        LOG_INFO("SMS from: " + std::string(record.number));
+        LOG_DEBUG("SMS content: " + std::string(record.text));
+        dispatch(std::move(record));
     }
 
+    replaying_backlog = false;
     LOG_INFO("Processed " + std::to_string(processed_count) + " existing SMS messages");
-
-    // Cleanup
-    g_list_free_full(modems, g_object_unref);
-    g_object_unref(manager);
-    g_object_unref(connection);
 }
 
-bool SmsMonitor::deleteSms(MMSms* sms) {
-    if (!sms) {
-        LOG_ERROR("deleteSms: SMS is null");
+bool SmsMonitor::deleteSms(const std::string& sms_path) {
+    if (sms_path.empty() || sms_path == "unknown") {
+        LOG_ERROR("deleteSms: SMS path is empty");
         return false;
     }
 
-    // Get the SMS path for logging
-    const char* sms_path = mm_sms_get_path(sms);
-    if (!sms_path) {
-        LOG_ERROR("deleteSms: SMS path is null");
-        return false;
+    std::string modem_path;
+    {
+        std::lock_guard<std::mutex> lock(owners_mutex);
+        auto it = sms_owners.find(sms_path);
+        if (it != sms_owners.end()) {
+            modem_path = it->second;
+            sms_owners.erase(it);
+        }
     }
 
-    std::string path_str = std::string(sms_path);
-    LOG_DEBUG("Attempting to delete SMS at path: " + path_str);
+    // The deleter resolves the owner itself if we never saw it
+    deleter.enqueue(modem_path, sms_path);
+    return true;
+}
+
+// Collect the object paths of an "ao" value
+static std::vector<std::string> readPathArray(DBusMessageIter* iter) {
+    std::vector<std::string> paths;
+    if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY) return paths;
 
-    // Try to get the modem messaging interface
-    GError* error = nullptr;
-    GDBusConnection* connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
-    if (error) {
-        LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
-        g_error_free(error);
-        return false;
+    DBusMessageIter items;
+    dbus_message_iter_recurse(iter, &items);
+    while (dbus_message_iter_get_arg_type(&items) == DBUS_TYPE_OBJECT_PATH) {
+        const char* path = nullptr;
+        dbus_message_iter_get_basic(&items, &path);
+        if (path) paths.push_back(path);
+        dbus_message_iter_next(&items);
     }
+    return paths;
+}
 
-    // Create ModemManager Manager proxy
-    MMManager* manager = mm_manager_new_sync(
-        connection,
-        G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-        nullptr,  // cancellable
-        &error
-    );
+void SmsMonitor::onSmsAdded(const std::string& modem_path, const std::string& path) {
+    // A new message occupies storage; let the watcher re-check soon
+    storage_watcher.notifyChanged();
 
-    if (error) {
-        LOG_ERROR("Failed to create ModemManager proxy: " + std::string(error->message));
-        g_error_free(error);
-        g_object_unref(connection);
-        return false;
+    LOG_DEBUG("Received SMS signal with path: " + path);
+
+    // Some ModemManager versions signal the modem instead of the SMS; only
+    // the messages the mirror has not seen yet are new
+    if (path.find("/SMS/") == std::string::npos) {
+        reconcileMessages(path);
+        return;
     }
 
-    // Get all modems
-    GList* modems = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
-    if (!modems) {
-        LOG_WARNING("No modems found");
-        g_object_unref(manager);
-        g_object_unref(connection);
-        return false;
+    if (!mirror.addSms(modem_path, path)) {
+        LOG_DEBUG("SMS " + path + " already mirrored, ignoring duplicate signal");
+        return;
     }
+    resolveSms(path, modem_path);
+}
 
-    bool success = false;
+AsyncTask SmsMonitor::reconcileMessages(std::string modem_path) {
+    GDBusConnection* bus = mirror.connection();
+    if (!bus) co_return;
 
-    // Process each modem
-    for (GList* m = modems; m && !success; m = g_list_next(m)) {
-        MMObject* modem_obj = MM_OBJECT(m->data);
-        MMModemMessaging* messaging = mm_object_get_modem_messaging(modem_obj);
+    auto reply = co_await callModemManager(bus, modem_path, "org.freedesktop.DBus.Properties", "Get",
+                                           g_variant_new("(ss)", MM_DBUS_INTERFACE_MODEM_MESSAGING, "Messages"),
+                                           G_VARIANT_TYPE("(v)"), 5000);
+    if (!reply.ok()) {
+        LOG_ERROR_LIMITED(modem_path, "Failed to list messages on " + modem_path + ": " + reply.message());
+        co_return;
+    }
 
-        if (!messaging) {
-            LOG_DEBUG("Modem does not support messaging");
-            continue;
+    GVariant* messages = nullptr;
+    g_variant_get(reply.value, "(v)", &messages);
+    g_variant_unref(reply.value);
+    if (g_variant_is_of_type(messages, G_VARIANT_TYPE_OBJECT_PATH_ARRAY)) {
+        for (const auto& sms_path : mirror.reconcileModem(modem_path, messages)) {
+            resolveSms(sms_path, modem_path);
         }
+    }
+    g_variant_unref(messages);
+}
+
+void SmsMonitor::onModemAdded(DBusMessage* message) {
+    // InterfacesAdded (o object, a{sa{sv}} interfaces)
+    DBusMessageIter args;
+    if (!dbus_message_iter_init(message, &args)) return;
+
+    const char* object_path = nullptr;
+    dbus_message_iter_get_basic(&args, &object_path);
+    if (!object_path || !dbus_message_iter_next(&args)) return;
+
+    DBusMessageIter interfaces;
+    dbus_message_iter_recurse(&args, &interfaces);
+    while (dbus_message_iter_get_arg_type(&interfaces) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entry;
+        dbus_message_iter_recurse(&interfaces, &entry);
+        const char* interface = nullptr;
+        dbus_message_iter_get_basic(&entry, &interface);
+
+        if (interface && strcmp(interface, "org.freedesktop.ModemManager1.Modem.Messaging") == 0 &&
+            dbus_message_iter_next(&entry)) {
+            std::vector<std::string> messages;
+            DBusMessageIter properties;
+            dbus_message_iter_recurse(&entry, &properties);
+            while (dbus_message_iter_get_arg_type(&properties) == DBUS_TYPE_DICT_ENTRY) {
+                DBusMessageIter property;
+                dbus_message_iter_recurse(&properties, &property);
+                const char* name = nullptr;
+                dbus_message_iter_get_basic(&property, &name);
+                if (name && strcmp(name, "Messages") == 0 && dbus_message_iter_next(&property)) {
+                    DBusMessageIter value;
+                    dbus_message_iter_recurse(&property, &value);
+                    messages = readPathArray(&value);
+                }
+                dbus_message_iter_next(&properties);
+            }
 
-        // Try to delete the SMS using ModemManager API
-        success = mm_modem_messaging_delete_sync(messaging, sms_path, nullptr, &error);
-        if (error) {
-            LOG_ERROR("Failed to delete SMS: " + std::string(error->message));
-            g_error_free(error);
-            error = nullptr;
+            LOG_INFO("Modem " + std::string(object_path) + " appeared with " +
+                     std::to_string(messages.size()) + " stored SMS");
+            mirror.addModem(object_path, messages);
+            catchUp(object_path, messages);
+            return;
         }
+        dbus_message_iter_next(&interfaces);
+    }
+}
 
-        if (success) {
-            LOG_INFO("Successfully deleted SMS using ModemManager API");
+void SmsMonitor::onModemRemoved(DBusMessage* message) {
+    // InterfacesRemoved (o object, as interfaces)
+    DBusMessageIter args;
+    if (!dbus_message_iter_init(message, &args)) return;
+
+    const char* object_path = nullptr;
+    dbus_message_iter_get_basic(&args, &object_path);
+    if (!object_path || !dbus_message_iter_next(&args)) return;
+
+    DBusMessageIter interfaces;
+    dbus_message_iter_recurse(&args, &interfaces);
+    while (dbus_message_iter_get_arg_type(&interfaces) == DBUS_TYPE_STRING) {
+        const char* interface = nullptr;
+        dbus_message_iter_get_basic(&interfaces, &interface);
+        if (interface && strcmp(interface, "org.freedesktop.ModemManager1.Modem.Messaging") == 0) {
+            LOG_INFO("Modem " + std::string(object_path) + " disappeared");
+            mirror.removeModem(object_path);
+            if (mirror.modemPaths().empty()) {
+                beginOutage("last modem disappeared");
+            }
+            return;
         }
+        dbus_message_iter_next(&interfaces);
+    }
+}
 
-        g_object_unref(messaging);
+void SmsMonitor::beginOutage(const std::string& reason) {
+    if (modem_outage) return;
 
-        if (success) {
-            break;
-        }
+    LOG_WARNING("Modem outage started: " + reason);
+    modem_outage = true;
+    outage_started = std::chrono::steady_clock::now();
+    Metrics::getInstance().setGauge("sms_forward_modem_available", 0);
+}
+
+AsyncTask SmsMonitor::catchUp(std::string modem_path, std::vector<std::string> messages) {
+    // Only a modem coming back after an outage has anything to catch up on
+    if (!modem_outage) co_return;
+    modem_outage = false;
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - outage_started).count();
+    Metrics::getInstance().setGauge("sms_forward_modem_available", 1);
+    Metrics::getInstance().setGauge("sms_forward_modem_last_outage_seconds", seconds);
+    Metrics::getInstance().increment("sms_forward_modem_outage_seconds_total", seconds);
+    Metrics::getInstance().increment("sms_forward_modem_outages_total");
+
+    // Stored messages may still be announced one by one for a while
+    recovering_until = now + std::chrono::seconds(60);
+
+    LOG_INFO("Modem " + modem_path + " back after " + std::to_string(static_cast<long>(seconds)) +
+             " s, catching up on " + std::to_string(messages.size()) + " stored SMS");
+    if (!callback || messages.empty()) co_return;
+
+    // Read only this modem's messages and forward the ones not forwarded
+    // yet, instead of replaying everything. Signals are handled while the
+    // reads are answered.
+    std::vector<SmsRecord> records;
+    if (!co_await mirror.fetchRecords(modem_path, messages, records)) {
+        LOG_ERROR("Failed to read stored SMS of " + modem_path);
+        co_return;
     }
 
-    // Cleanup
-    g_list_free_full(modems, g_object_unref);
-    g_object_unref(manager);
-    g_object_unref(connection);
+    Watchdog::Stage stage(WatchedLoop::Monitor, "outage catch-up");
+    int caught_up = 0;
+    replaying_backlog = true;
 
-    // If ModemManager API failed, try using mmcli as a fallback
-    if (!success) {
-        // Extract the SMS index from the path
-        const char* sms_index_str = strrchr(sms_path, '/');
-        if (!sms_index_str) {
-            LOG_ERROR("deleteSms: Failed to extract SMS index from path");
-            return false;
+    for (auto& record : records) {
+        if (record.state != MM_SMS_STATE_RECEIVED || record.storage != MM_SMS_STORAGE_ME) continue;
+        if (record.number.empty() || record.text.empty()) {
+            resolveSms(std::string(record.path), std::string(record.modem_path));
+            continue;
         }
+        if (alreadyForwarded(record)) continue;
+
+        caught_up++;
+        rememberOwner(record.path, record.modem_path);
+        LOG_INFO("SMS from: " + std::string(record.number) + " (received during outage)");
+        LOG_DEBUG("SMS content: " + std::string(record.text));
+        dispatch(std::move(record));
+    }
+
+    replaying_backlog = false;
+    Metrics::getInstance().increment("sms_forward_catchup_sms_total", caught_up);
+    LOG_INFO("Caught up on " + std::to_string(caught_up) + " SMS received during the outage");
+}
+
+void SmsMonitor::onNameOwnerChanged(DBusMessage* message) {
+    const char* name = nullptr;
+    const char* old_owner = nullptr;
+    const char* new_owner = nullptr;
+    if (!dbus_message_get_args(message, nullptr,
+                               DBUS_TYPE_STRING, &name,
+                               DBUS_TYPE_STRING, &old_owner,
+                               DBUS_TYPE_STRING, &new_owner,
+                               DBUS_TYPE_INVALID)) {
+        return;
+    }
+
+    if (!new_owner || !*new_owner) {
+        // Every modem and SMS object went with it
+        mirror.clear();
+        beginOutage("ModemManager left the bus");
+        return;
+    }
+
+    LOG_INFO("ModemManager is on the bus as " + std::string(new_owner) + ", waiting for modems");
 
-        sms_index_str++; // Skip the '/' character
-        int sms_index = atoi(sms_index_str);
-        LOG_DEBUG("Attempting to delete SMS using mmcli for SMS index " + std::to_string(sms_index));
+    // Modems are normally announced with InterfacesAdded later; pick up any
+    // that were exported before this signal was handled
+    seedMirror();
+}
 
-        // Delete the SMS using mmcli
-        std::string cmd = "mmcli -m 0 --messaging-delete-sms=" + std::to_string(sms_index);
-        int result = system(cmd.c_str());
-        if (result == 0) {
-            LOG_INFO("Successfully deleted SMS using mmcli");
-            return true;
+AsyncTask SmsMonitor::seedMirror() {
+    GDBusConnection* bus = mirror.connection();
+    if (bus) {
+        auto objects = co_await getManagedObjects(bus);
+        if (objects.ok()) {
+            GVariant* tree = g_variant_get_child_value(objects.value, 0);
+            mirror.seed(tree);
+            g_variant_unref(tree);
+            g_variant_unref(objects.value);
         } else {
-            LOG_ERROR("Failed to delete SMS using mmcli, return code: " + std::to_string(result));
-            return false;
+            LOG_WARNING("Could not seed the modem mirror, new SMS are still handled as they arrive: " +
+                        objects.message());
         }
     }
 
-    return success;
+    if (mirror.modemPaths().empty()) {
+        beginOutage("no modem available");
+        co_return;
+    }
+    if (!modem_outage) Metrics::getInstance().setGauge("sms_forward_modem_available", 1);
+    for (const auto& modem_path : mirror.modemPaths()) {
+        catchUp(modem_path, mirror.messagesOf(modem_path));
+    }
 }
 
 void SmsMonitor::handleMessage(DBusMessage* message, void* user_data) {
     auto* monitor = static_cast<SmsMonitor*>(user_data);
 
-    if (dbus_message_is_signal(message,
-        "org.freedesktop.ModemManager1.Modem.Messaging", "Added")) {
+    bool added = dbus_message_is_signal(message, "org.freedesktop.ModemManager1.Modem.Messaging", "Added");
+    bool deleted = dbus_message_is_signal(message, "org.freedesktop.ModemManager1.Modem.Messaging", "Deleted");
 
+    if (added || deleted) {
         DBusMessageIter args;
-        if (!dbus_message_iter_init(message, &args)) {
+        if (!dbus_message_iter_init(message, &args) ||
+            dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_OBJECT_PATH) {
             return;
         }
 
         const char* path = nullptr;
         dbus_message_iter_get_basic(&args, &path);
-        if (!path) return;
-
-        GError* error = nullptr;
-        GDBusConnection* connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
-        if (error) {
-            LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
-            g_error_free(error);
-            return;
-        }
-
-        // Create ModemManager Manager proxy
-        MMManager* manager = mm_manager_new_sync(
-            connection,
-            G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-            nullptr,  // cancellable
-            &error
-        );
-
-        if (error) {
-            LOG_ERROR("Failed to create ModemManager proxy: " + std::string(error->message));
-            g_error_free(error);
-            g_object_unref(connection);
-            return;
-        }
-
-        // The path in the signal could be either the SMS path or the modem path
-        LOG_DEBUG("Received SMS signal with path: " + std::string(path));
-
-        // Check if the path is an SMS path
-        bool is_sms_path = strstr(path, "/SMS/") != nullptr;
-
-        if (is_sms_path) {
-            // This is an SMS path, we need to find the modem that owns this SMS
-            // Get all modems
-            GList* objects = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
-            if (!objects) {
-                LOG_ERROR("Failed to get modem objects");
-                g_object_unref(manager);
-                g_object_unref(connection);
-                return;
-            }
-
-            LOG_DEBUG("Found " + std::to_string(g_list_length(objects)) + " modem objects");
-
-            // Process each modem to find the SMS
-            bool found_sms = false;
-            int modem_count = 0;
-
-            for (GList* l = objects; l && !found_sms; l = g_list_next(l)) {
-                modem_count++;
-                MMObject* modem = MM_OBJECT(l->data);
-                const char* modem_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(modem));
-                LOG_DEBUG("Checking modem " + std::to_string(modem_count) + ": " + std::string(modem_path));
-
-                MMModemMessaging* messaging = mm_object_get_modem_messaging(modem);
-                if (!messaging) {
-                    LOG_DEBUG("Modem does not support messaging");
-                    continue;
-                }
-
-                // List SMS messages
-                GList* sms_list = mm_modem_messaging_list_sync(messaging, nullptr, &error);
-                if (error) {
-                    LOG_ERROR("Failed to get SMS list: " + std::string(error->message));
-                    g_error_free(error);
-                    error = nullptr;
-                    g_object_unref(messaging);
-                    continue;
-                }
+        const char* modem_path = dbus_message_get_path(message);
+        if (!path || !modem_path) return;
+        SMS_PROBE2(signal_received, smsTraceId(path), added ? 1 : 0);
 
-                LOG_DEBUG("Found " + std::to_string(g_list_length(sms_list)) + " SMS messages");
-
-                // Find the SMS with the matching path
-                int sms_count = 0;
-                for (GList* s = sms_list; s && !found_sms; s = g_list_next(s)) {
-                    sms_count++;
-                    MMSms* sms = MM_SMS(s->data);
-                    const char* sms_path = mm_sms_get_path(sms);
-
-                    if (sms_path) {
-                        LOG_DEBUG("SMS " + std::to_string(sms_count) + " path: " + std::string(sms_path));
-
-                        if (strcmp(sms_path, path) == 0) {
-                            LOG_DEBUG("Found matching SMS path");
-                            // Found the SMS, process it
-                            MMSmsState state = mm_sms_get_state(sms);
-                            LOG_DEBUG("SMS state: " + std::to_string(state));
-
-                            // Only process received SMS messages
-                            if (state == MM_SMS_STATE_RECEIVED) {
-                                monitor->processSms(sms);
-                                found_sms = true;
-                            } else {
-                                LOG_DEBUG("Skipping SMS with state " + std::to_string(state) + " (not received)");
-                            }
-                        }
-                    } else {
-                        LOG_DEBUG("SMS " + std::to_string(sms_count) + " has no path");
-                    }
-                }
-
-                // Cleanup
-                g_list_free_full(sms_list, g_object_unref);
-                g_object_unref(messaging);
-            }
-
-            // Cleanup
-            g_list_free_full(objects, g_object_unref);
-
-            if (!found_sms) {
-                LOG_ERROR("Failed to find SMS with path: " + std::string(path));
-
-                // Try a different approach - get the SMS directly from the path
-                LOG_DEBUG("Trying alternative approach to get SMS");
-
-                // Extract the modem index and SMS index from the path
-                // Format: /org/freedesktop/ModemManager1/SMS/22
-                const char* sms_index_str = strrchr(path, '/');
-                if (sms_index_str) {
-                    sms_index_str++; // Skip the '/' character
-                    int sms_index = atoi(sms_index_str);
-                    LOG_DEBUG("SMS index: " + std::to_string(sms_index));
-
-                    // Get the first modem
-                    objects = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
-                    if (objects && objects->data) {
-                        MMObject* modem = MM_OBJECT(objects->data);
-                        const char* modem_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(modem));
-                        LOG_DEBUG("Using first modem: " + std::string(modem_path));
-
-                        // Try to get the SMS directly using mmcli command
-                        LOG_DEBUG("Attempting to process SMS using mmcli command");
-
-                        // Get the SMS content using mmcli
-                        std::string cmd = "mmcli -m 0 --sms=" + std::to_string(sms_index);
-                        FILE* pipe = popen(cmd.c_str(), "r");
-                        if (pipe) {
-                            char buffer[1024];
-                            std::string result = "";
-                            while (!feof(pipe)) {
-                                if (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-                                    result += buffer;
-                                }
-                            }
-                            pclose(pipe);
-
-                            LOG_DEBUG("mmcli output: " + result);
-
-                            // Parse the output to get the SMS content and number
-                            std::string number = "";
-                            std::string text = "";
-
-                            // Extract number
-                            size_t number_pos = result.find("number:");
-                            if (number_pos != std::string::npos) {
-                                size_t start = result.find('\'', number_pos);
-                                size_t end = result.find('\'', start + 1);
-                                if (start != std::string::npos && end != std::string::npos) {
-                                    number = result.substr(start + 1, end - start - 1);
-                                }
-                            }
-
-                            // Extract text
-                            size_t text_pos = result.find("text:");
-                            if (text_pos != std::string::npos) {
-                                size_t start = result.find('\'', text_pos);
-                                size_t end = result.find('\'', start + 1);
-                                if (start != std::string::npos && end != std::string::npos) {
-                                    text = result.substr(start + 1, end - start - 1);
-                                }
-                            }
-
-                            if (!number.empty() && !text.empty()) {
-                                LOG_INFO("Successfully extracted SMS content using mmcli");
-                                LOG_INFO("SMS from: " + number);
-                                LOG_DEBUG("SMS content: " + text);
-
-                                // Call the callback directly
-                                if (monitor->callback) {
-                                    monitor->callback(number, text, nullptr);
-                                }
-
-                                found_sms = true;
-                            }
-                        }
-
-                        g_list_free_full(objects, g_object_unref);
-                    }
-                }
-            }
+        if (added) {
+            monitor->onSmsAdded(modem_path, path);
         } else {
-            // This is a modem path, get all SMS messages from this modem
-            // Get all modems
-            GList* objects = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
-            if (!objects) {
-                LOG_ERROR("Failed to get modem objects");
-                g_object_unref(manager);
-                g_object_unref(connection);
-                return;
-            }
-
-            // Find the modem that sent the signal
-            MMObject* modem = nullptr;
-            for (GList* l = objects; l; l = g_list_next(l)) {
-                MMObject* obj = MM_OBJECT(l->data);
-                const char* obj_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(obj));
-
-                if (strcmp(obj_path, path) == 0) {
-                    modem = obj;
-                    break;
-                }
-            }
-
-            if (!modem) {
-                LOG_ERROR("Failed to find modem with path: " + std::string(path));
-                g_list_free_full(objects, g_object_unref);
-                g_object_unref(manager);
-                g_object_unref(connection);
-                return;
-            }
-
-            // Get the messaging interface
-            MMModemMessaging* messaging = mm_object_get_modem_messaging(modem);
-            if (!messaging) {
-                LOG_ERROR("Failed to get messaging interface");
-                g_list_free_full(objects, g_object_unref);
-                g_object_unref(manager);
-                g_object_unref(connection);
-                return;
-            }
-
-            // List SMS messages
-            GList* sms_list = mm_modem_messaging_list_sync(messaging, nullptr, &error);
-            if (error) {
-                LOG_ERROR("Failed to get SMS list: " + std::string(error->message));
-                g_error_free(error);
-                g_object_unref(messaging);
-                g_list_free_full(objects, g_object_unref);
-                g_object_unref(manager);
-                g_object_unref(connection);
-                return;
-            }
-
-            // Process all SMS messages
-            for (GList* l = sms_list; l; l = g_list_next(l)) {
-                MMSms* sms = MM_SMS(l->data);
-                MMSmsState state = mm_sms_get_state(sms);
-
-                // Only process received messages
-                if (state == MM_SMS_STATE_RECEIVED) {
-                    monitor->processSms(sms);
-                }
-            }
-
-            // Cleanup
-            g_list_free_full(sms_list, g_object_unref);
-            g_object_unref(messaging);
-            g_list_free_full(objects, g_object_unref);
+            monitor->mirror.removeSms(path);
         }
-
-        // Cleanup
-        g_object_unref(manager);
-        g_object_unref(connection);
+    } else if (dbus_message_is_signal(message, "org.freedesktop.DBus.ObjectManager", "InterfacesAdded")) {
+        monitor->onModemAdded(message);
+    } else if (dbus_message_is_signal(message, "org.freedesktop.DBus.ObjectManager", "InterfacesRemoved")) {
+        monitor->onModemRemoved(message);
+    } else if (dbus_message_is_signal(message, "org.freedesktop.DBus", "NameOwnerChanged")) {
+        monitor->onNameOwnerChanged(message);
     }
 }
@@ -13,14 +13,27 @@
  */
 
 #pragma once
+#include "mm_async.hpp"
+#include "modem_mirror.hpp"
+#include "sms_deleter.hpp"
+#include "storage_watcher.hpp"
 #include <dbus/dbus.h>
+#include <chrono>
+#include <ctime>
+#include <deque>
 #include <string>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <libmm-glib.h>
 
 class SmsMonitor {
 public:
-    using SmsCallback = std::function<void(const std::string&, const std::string&, MMSms*)>;
+    // Receives each new SMS. The record owns its data and may be kept,
+    // queued or handed to another thread; its path can be used for
+    // deferred deletion.
+    using SmsCallback = std::function<void(SmsRecord)>;
 
     SmsMonitor();
     ~SmsMonitor();
@@ -28,12 +41,52 @@ public:
     bool init();
     void setCallback(SmsCallback callback);
     void run();
-    void checkExistingSms();
-    bool deleteSms(MMSms* sms);
+    // Replays the stored SMS once their properties were read, from run()
+    AsyncTask checkExistingSms();
+
+    // Queue an SMS for asynchronous deletion on the modem that owns it.
+    // Returns false only if the request is invalid.
+    bool deleteSms(const std::string& sms_path);
+
+    // Record a successfully forwarded message so storage pruning may remove it
+    void markForwarded(const std::string& sender, const std::string& text, const std::string& timestamp);
+
+    // True while checkExistingSms is replaying messages stored before startup
+    bool isReplayingBacklog() const { return replaying_backlog; }
 
 private:
     DBusConnection* connection;
+    bool running;
     SmsCallback callback;
+    bool replaying_backlog;
+    ModemMirror mirror;
+    SmsDeleter deleter;
+    StorageWatcher storage_watcher;
+    std::mutex owners_mutex;
+    std::unordered_map<std::string, std::string> sms_owners; // SMS path -> modem path
+    bool modem_outage;                                         // ModemManager or every modem gone
+    std::chrono::steady_clock::time_point outage_started;
+    std::chrono::steady_clock::time_point recovering_until;    // Replayed Added signals are filtered until then
+    time_t forward_since;                                      // Older messages were stored before startup and not replayed
+    std::unordered_set<size_t> forwarded_keys;                 // Timestamp, sender and text of recently forwarded SMS
+    std::deque<size_t> forwarded_order;                        // The same keys, oldest first
+    static gboolean onBusReadable(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean onHousekeeping(gpointer user_data);
+    void drainSignals();
     static void handleMessage(DBusMessage* message, void* user_data);
-    void processSms(MMSms* sms);
+    void onNameOwnerChanged(DBusMessage* message);
+    void beginOutage(const std::string& reason);
+    // Load the mirror from ModemManager without blocking the loop, then
+    // catch up on any modem that is back after an outage
+    AsyncTask seedMirror();
+    // Re-read the message list of a modem that was signalled as a whole
+    AsyncTask reconcileMessages(std::string modem_path);
+    AsyncTask catchUp(std::string modem_path, std::vector<std::string> messages);
+    bool alreadyForwarded(const SmsRecord& record) const;
+    void dispatch(SmsRecord record);
+    void onSmsAdded(const std::string& modem_path, const std::string& path);
+    void onModemAdded(DBusMessage* message);
+    void onModemRemoved(DBusMessage* message);
+    AsyncTask resolveSms(std::string sms_path, std::string modem_path);
+    void rememberOwner(std::string_view sms_path, std::string_view modem_path);
 };
@@ -0,0 +1,38 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "sms_record.hpp"
+#include <cstring>
+
+std::string_view SmsArena::store(std::string_view value) {
+    size_t needed = value.size() + 1;
+    char* data;
+    if (needed > block_bytes) {
+        // Long texts get their own allocation, the current block stays open
+        large.emplace_back(new char[needed]);
+        data = large.back().get();
+    } else {
+        if (capacity - used < needed) {
+            blocks.emplace_back(new char[block_bytes]);
+            capacity = block_bytes;
+            used = 0;
+        }
+        data = blocks.back().get() + used;
+        used += needed;
+    }
+
+    memcpy(data, value.data(), value.size());
+    data[value.size()] = '\0';
+    return std::string_view(data, value.size());
+}
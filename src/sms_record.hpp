@@ -0,0 +1,81 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include "probes.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <ModemManager.h>
+
+// Bump allocator for the strings of one batch of SmsRecords, e.g. a storage
+// snapshot or a single resolved SMS. Its blocks are freed together when the
+// last record of the batch is destroyed. Strings are only added while the
+// batch is being built, on one thread; afterwards they are read only, so the
+// records may be handed to other threads.
+class SmsArena {
+public:
+    explicit SmsArena(size_t block_bytes = 4096) : block_bytes(block_bytes), used(0), capacity(0) {}
+    SmsArena(const SmsArena&) = delete;
+    SmsArena& operator=(const SmsArena&) = delete;
+
+    // Copy value into the arena. The copy is NUL terminated, so data() of
+    // the returned view may be passed to C functions.
+    std::string_view store(std::string_view value);
+
+private:
+    size_t block_bytes;
+    size_t used;     // Bytes taken from the last block
+    size_t capacity; // Size of the last block
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large; // Strings longer than a block, one each
+};
+
+// One received SMS as it travels from the monitor to the forwarder. Text
+// fields point into an arena shared with the other records of its batch,
+// which the record keeps alive, so it can be queued or moved to another
+// thread without copying and without referring to any GLib object. It is
+// move-only: exactly one owner deals with each SMS.
+struct SmsRecord {
+    std::string_view path;       // D-Bus object path of the SMS, empty if it has none
+    std::string_view modem_path;
+    std::string_view number;     // Sender
+    std::string_view text;
+    std::string_view timestamp;  // As reported by ModemManager, e.g. 2025-03-01T08:15:30+08:00
+    std::string_view smsc;
+    MMSmsState state = MM_SMS_STATE_UNKNOWN;
+    MMSmsStorage storage = MM_SMS_STORAGE_UNKNOWN;
+    int sms_class = -1;          // Message class 0-3, -1 if none
+    uint64_t trace_id = 0;       // Tags the SMS in the USDT probes
+
+    SmsRecord() = default;
+    SmsRecord(std::shared_ptr<SmsArena> batch, std::string_view sms_path, std::string_view modem)
+        : arena(std::move(batch)) {
+        path = keep(sms_path);
+        modem_path = keep(modem);
+        trace_id = smsTraceId(path);
+    }
+    SmsRecord(SmsRecord&&) noexcept = default;
+    SmsRecord& operator=(SmsRecord&&) noexcept = default;
+    SmsRecord(const SmsRecord&) = delete;
+    SmsRecord& operator=(const SmsRecord&) = delete;
+
+    // Copy value into the record's arena, for assigning to a field
+    std::string_view keep(std::string_view value) { return arena ? arena->store(value) : std::string_view(); }
+
+private:
+    std::shared_ptr<SmsArena> arena;
+};
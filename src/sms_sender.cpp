@@ -0,0 +1,340 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "sms_sender.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "modem_bus.hpp"
+#include <algorithm>
+#include <gio/gio.h>
+
+namespace {
+
+const int kMaxAttempts = 3;
+const int kMaxBackoffShift = 4;
+const auto kRetryBaseDelay = std::chrono::seconds(5);
+const auto kNoModemDelay = std::chrono::seconds(5);
+
+gboolean onWakeTimer(gpointer) {
+    return G_SOURCE_REMOVE;
+}
+
+void onSentDeleted(GObject* source, GAsyncResult* res, gpointer) {
+    GError* error = nullptr;
+    if (!mm_modem_messaging_delete_finish(MM_MODEM_MESSAGING(source), res, &error) && error) {
+        LOG_DEBUG("Failed to delete sent SMS from modem storage: " + std::string(error->message));
+    }
+    if (error) g_error_free(error);
+}
+
+long long millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+SmsSender::SmsSender(int interval_ms, int max_queued)
+    : interval(interval_ms), max_queued(static_cast<size_t>(std::max(0, max_queued))),
+      running(false), inflight(0), modems_missing(false),
+      context(g_main_context_new()), bus(nullptr), manager(nullptr) {}
+
+SmsSender::~SmsSender() {
+    stop();
+    g_main_context_unref(context);
+}
+
+void SmsSender::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    running = true;
+    worker = std::thread(&SmsSender::workerLoop, this);
+}
+
+void SmsSender::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    g_main_context_wakeup(context);
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool SmsSender::submit(const std::string& number, const std::string& text, Completion done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return false;
+        if (max_queued > 0 && queue.size() + inflight >= max_queued) {
+            Metrics::getInstance().increment("sms_forward_outbound_sms_total{result=\"rejected\"}");
+            LOG_WARNING("Outbound SMS queue full, rejecting SMS to " + number);
+            return false;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        queue.push_back(OutboundSms{number, text, std::move(done), 0, std::string(), now, now});
+        publishLoad();
+    }
+    LOG_DEBUG("Queued outbound SMS to " + number);
+    g_main_context_wakeup(context);
+    return true;
+}
+
+void SmsSender::workerLoop() {
+    // The modem proxies and their async replies live on this thread only
+    g_main_context_push_thread_default(context);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running || inflight > 0) {
+        bool starting = running;
+        lock.unlock();
+
+        // Sleep until a reply, a submission or the next pacing deadline
+        auto wake = starting ? startDue() : std::chrono::steady_clock::time_point::max();
+        GSource* timer = nullptr;
+        if (wake != std::chrono::steady_clock::time_point::max()) {
+            auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(wake - std::chrono::steady_clock::now());
+            timer = g_timeout_source_new(static_cast<guint>(std::max<long long>(0, delay.count() + 1)));
+            g_source_set_callback(timer, onWakeTimer, nullptr, nullptr);
+            g_source_attach(timer, context);
+        }
+        g_main_context_iteration(context, TRUE);
+        if (timer) {
+            g_source_destroy(timer);
+            g_source_unref(timer);
+        }
+
+        lock.lock();
+    }
+
+    std::deque<OutboundSms> abandoned;
+    abandoned.swap(queue);
+    publishLoad();
+    lock.unlock();
+
+    if (!abandoned.empty()) {
+        LOG_WARNING("SMS sender stopped with " + std::to_string(abandoned.size()) + " unsent SMS");
+    }
+    for (auto& sms : abandoned) {
+        if (sms.done) sms.done(false, "sender stopped");
+    }
+
+    // Let deletions of sent copies go out before the proxies are dropped
+    while (g_main_context_iteration(context, FALSE)) {}
+    resetManager();
+    g_main_context_pop_thread_default(context);
+}
+
+std::chrono::steady_clock::time_point SmsSender::startDue() {
+    auto now = std::chrono::steady_clock::now();
+    auto wake = std::chrono::steady_clock::time_point::max();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty()) return wake;
+    }
+
+    if (!ensureManager()) {
+        return now + kNoModemDelay;
+    }
+
+    // Modems that can take a send right now
+    std::vector<std::string> available;
+    bool any_modem = false;
+    GList* objects = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
+    for (GList* o = objects; o; o = g_list_next(o)) {
+        if (!mm_object_peek_modem_messaging(MM_OBJECT(o->data))) continue;
+        any_modem = true;
+
+        std::string path = g_dbus_object_get_object_path(G_DBUS_OBJECT(o->data));
+        ModemSlot& slot = modems[path];
+        if (slot.busy) continue;
+        if (slot.next_send > now) {
+            wake = std::min(wake, slot.next_send);
+            continue;
+        }
+        available.push_back(path);
+    }
+    g_list_free_full(objects, g_object_unref);
+
+    if (!any_modem) {
+        if (!modems_missing) {
+            LOG_WARNING("No modem with messaging support, holding outbound SMS");
+            modems_missing = true;
+        }
+        return now + kNoModemDelay;
+    }
+    modems_missing = false;
+
+    std::vector<std::pair<OutboundSms, std::string>> starting;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = queue.begin(); it != queue.end() && !available.empty();) {
+            if (it->not_before > now) {
+                wake = std::min(wake, it->not_before);
+                ++it;
+                continue;
+            }
+            std::string modem_path = pickModem(available, *it);
+            available.erase(std::find(available.begin(), available.end(), modem_path));
+            starting.emplace_back(std::move(*it), modem_path);
+            it = queue.erase(it);
+            inflight++;
+        }
+        publishLoad();
+    }
+
+    for (auto& entry : starting) {
+        sendOne(std::move(entry.first), entry.second);
+    }
+    return wake;
+}
+
+std::string SmsSender::pickModem(const std::vector<std::string>& available, const OutboundSms& sms) {
+    // Least recently used first, avoiding the modem that just failed this SMS
+    const std::string* best = nullptr;
+    for (const auto& path : available) {
+        if (best) {
+            bool best_failed = *best == sms.failed_modem;
+            bool failed = path == sms.failed_modem;
+            if (failed && !best_failed) continue;
+            if (failed == best_failed && modems[path].next_send >= modems[*best].next_send) continue;
+        }
+        best = &path;
+    }
+    return *best;
+}
+
+AsyncTask SmsSender::sendOne(OutboundSms sms, std::string modem_path) {
+    modems[modem_path].busy = true;
+    auto started = std::chrono::steady_clock::now();
+
+    GDBusObject* modem_obj = g_dbus_object_manager_get_object(G_DBUS_OBJECT_MANAGER(manager), modem_path.c_str());
+    MMModemMessaging* messaging = modem_obj ? mm_object_get_modem_messaging(MM_OBJECT(modem_obj)) : nullptr;
+    if (modem_obj) g_object_unref(modem_obj);
+    if (!messaging) {
+        finishSend(sms, modem_path, started, false, "modem has no messaging interface", false);
+        co_return;
+    }
+
+    LOG_DEBUG("Sending SMS to " + sms.number + " via " + modem_path);
+    MMSmsProperties* properties = mm_sms_properties_new();
+    mm_sms_properties_set_number(properties, sms.number.c_str());
+    mm_sms_properties_set_text(properties, sms.text.c_str());
+    auto created = co_await messagingCreate(messaging, properties);
+    g_object_unref(properties);
+
+    if (!created.value) {
+        // A malformed number or text fails the same way on every modem
+        bool permanent = created.error && g_error_matches(created.error, MM_CORE_ERROR, MM_CORE_ERROR_INVALID_ARGS);
+        finishSend(sms, modem_path, started, false, "create failed: " + created.message(), permanent);
+        g_object_unref(messaging);
+        co_return;
+    }
+
+    auto sent = co_await smsSend(created.value);
+
+    // Sent copies would fill the modem storage, and a retry creates a new SMS
+    mm_modem_messaging_delete(messaging, mm_sms_get_path(created.value), nullptr, onSentDeleted, nullptr);
+    finishSend(sms, modem_path, started, sent.value, sent.value ? "" : "send failed: " + sent.message(), false);
+    g_object_unref(created.value);
+    g_object_unref(messaging);
+}
+
+void SmsSender::finishSend(OutboundSms& sms, const std::string& modem_path,
+                           std::chrono::steady_clock::time_point started,
+                           bool success, const std::string& error, bool permanent) {
+    auto now = std::chrono::steady_clock::now();
+
+    ModemSlot& slot = modems[modem_path];
+    slot.busy = false;
+    slot.failures = success ? 0 : std::min(slot.failures + 1, kMaxBackoffShift);
+    slot.next_send = now + interval * (1 << slot.failures);
+
+    bool retry = false;
+    if (success) {
+        Metrics::getInstance().increment("sms_forward_outbound_sms_total{result=\"sent\"}");
+        Metrics::getInstance().setGauge("sms_forward_outbound_last_send_seconds",
+                                        std::chrono::duration<double>(now - started).count());
+        LOG_INFO("Sent SMS to " + sms.number + " via " + modem_path + " in " +
+                 std::to_string(millisecondsSince(sms.queued_at)) + " ms");
+    } else if (!permanent && ++sms.attempts < kMaxAttempts) {
+        retry = true;
+        Metrics::getInstance().increment("sms_forward_outbound_retries_total");
+        LOG_WARNING("Sending SMS to " + sms.number + " via " + modem_path + " failed (attempt " +
+                    std::to_string(sms.attempts) + "): " + error);
+        sms.failed_modem = modem_path;
+        sms.not_before = now + kRetryBaseDelay * (1 << (sms.attempts - 1));
+    } else {
+        Metrics::getInstance().increment("sms_forward_outbound_sms_total{result=\"failed\"}");
+        LOG_ERROR("Giving up sending SMS to " + sms.number + ": " + error);
+    }
+
+    Completion done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inflight--;
+        if (retry) {
+            // Keep its place ahead of later submissions
+            queue.push_front(std::move(sms));
+        } else {
+            done = std::move(sms.done);
+        }
+        publishLoad();
+    }
+    if (done) done(success, success ? modem_path : error);
+}
+
+bool SmsSender::ensureManager() {
+    if (manager) {
+        // Apply any pending object manager updates before we look up modems
+        while (g_main_context_iteration(context, FALSE)) {}
+        return true;
+    }
+
+    GError* error = nullptr;
+    bus = openModemBusGio(&error);
+    if (error) {
+        LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
+        g_error_free(error);
+        return false;
+    }
+
+    manager = mm_manager_new_sync(bus, G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE, nullptr, &error);
+    if (error) {
+        LOG_ERROR("Failed to create ModemManager proxy: " + std::string(error->message));
+        g_error_free(error);
+        resetManager();
+        return false;
+    }
+
+    return true;
+}
+
+void SmsSender::resetManager() {
+    if (manager) {
+        g_object_unref(manager);
+        manager = nullptr;
+    }
+    if (bus) {
+        g_object_unref(bus);
+        bus = nullptr;
+    }
+}
+
+void SmsSender::publishLoad() {
+    Metrics::getInstance().setGauge("sms_forward_outbound_queue_sms", static_cast<double>(queue.size() + inflight));
+}
@@ -0,0 +1,92 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include "mm_async.hpp"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libmm-glib.h>
+
+// Sends outbound SMS through ModemManager on a background thread. Each SMS
+// is created with Messaging.Create and sent with Sms.Send by one coroutine.
+// A modem handles one send at a time and waits a pacing interval before
+// the next, so a burst is spread over all modems with a messaging
+// interface. Failed sends are retried, preferably on another modem.
+class SmsSender {
+public:
+    // Called on the sender thread. detail is the modem on success and the
+    // error otherwise.
+    using Completion = std::function<void(bool success, const std::string& detail)>;
+
+    // interval_ms is the minimum gap between sends on one modem;
+    // max_queued bounds waiting and in-flight SMS, 0 means unlimited
+    SmsSender(int interval_ms, int max_queued);
+    ~SmsSender();
+
+    void start();
+    void stop();
+
+    // Returns false, without calling done, if the queue is full or stopped
+    bool submit(const std::string& number, const std::string& text, Completion done);
+
+private:
+    struct OutboundSms {
+        std::string number;
+        std::string text;
+        Completion done;
+        int attempts;
+        std::string failed_modem; // Modem of the last failed attempt
+        std::chrono::steady_clock::time_point queued_at;
+        std::chrono::steady_clock::time_point not_before;
+    };
+
+    struct ModemSlot {
+        bool busy = false;
+        int failures = 0; // Consecutive failed sends, widens the pacing interval
+        std::chrono::steady_clock::time_point next_send;
+    };
+
+    void workerLoop();
+    std::chrono::steady_clock::time_point startDue();
+    std::string pickModem(const std::vector<std::string>& available, const OutboundSms& sms);
+    AsyncTask sendOne(OutboundSms sms, std::string modem_path);
+    void finishSend(OutboundSms& sms, const std::string& modem_path, std::chrono::steady_clock::time_point started,
+                    bool success, const std::string& error, bool permanent);
+    bool ensureManager();
+    void resetManager();
+    void publishLoad();
+
+    std::chrono::milliseconds interval;
+    size_t max_queued;
+
+    std::mutex mutex;
+    std::deque<OutboundSms> queue;
+    std::thread worker;
+    bool running;
+    size_t inflight;
+
+    // Only touched by the worker thread
+    std::map<std::string, ModemSlot> modems;
+    bool modems_missing;
+    GMainContext* context;
+    GDBusConnection* bus;
+    MMManager* manager;
+};
@@ -0,0 +1,253 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#include "storage_watcher.hpp"
+#include "logger.hpp"
+#include "modem_bus.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <vector>
+#include <gio/gio.h>
+
+namespace {
+
+// Minimum spacing between checks triggered by notifyChanged
+const std::chrono::seconds kChangeDebounce(5);
+
+const char* storageName(MMSmsStorage storage) {
+    switch (storage) {
+        case MM_SMS_STORAGE_SM: return "sm";
+        case MM_SMS_STORAGE_ME: return "me";
+        case MM_SMS_STORAGE_MT: return "mt";
+        case MM_SMS_STORAGE_SR: return "sr";
+        case MM_SMS_STORAGE_BM: return "bm";
+        case MM_SMS_STORAGE_TA: return "ta";
+        default:                return "unknown";
+    }
+}
+
+struct StoredSms {
+    std::string path;
+    std::string timestamp;
+    bool forwarded;
+};
+
+} // namespace
+
+StorageWatcher::StorageWatcher(SmsDeleter& deleter, int interval_seconds, int prune_threshold)
+    : deleter(deleter), interval(interval_seconds), prune_threshold(prune_threshold),
+      running(false), changed(false), context(nullptr), bus(nullptr), manager(nullptr) {}
+
+StorageWatcher::~StorageWatcher() {
+    stop();
+}
+
+void StorageWatcher::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    running = true;
+    worker = std::thread(&StorageWatcher::workerLoop, this);
+}
+
+void StorageWatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void StorageWatcher::notifyChanged() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed = true;
+    }
+    cv.notify_one();
+}
+
+size_t StorageWatcher::forwardedKey(const std::string& sender, const std::string& text, const std::string& timestamp) {
+    return std::hash<std::string>()(sender + '\x1f' + text + '\x1f' + timestamp);
+}
+
+void StorageWatcher::markForwarded(const std::string& sender, const std::string& text, const std::string& timestamp) {
+    size_t key = forwardedKey(sender, text, timestamp);
+
+    std::lock_guard<std::mutex> lock(forwarded_mutex);
+    if (!forwarded.insert(key).second) return;
+
+    forwarded_order.push_back(key);
+    if (forwarded_order.size() > kMaxForwardedKeys) {
+        forwarded.erase(forwarded_order.front());
+        forwarded_order.pop_front();
+    }
+}
+
+bool StorageWatcher::isForwarded(size_t key) {
+    std::lock_guard<std::mutex> lock(forwarded_mutex);
+    return forwarded.count(key) > 0;
+}
+
+void StorageWatcher::workerLoop() {
+    context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    auto last_check = std::chrono::steady_clock::time_point();
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        auto now = std::chrono::steady_clock::now();
+        auto next_check = last_check + (changed ? kChangeDebounce : interval);
+        if (now < next_check) {
+            cv.wait_until(lock, next_check);
+            continue;
+        }
+
+        changed = false;
+        last_check = now;
+
+        lock.unlock();
+        checkStorage();
+        lock.lock();
+    }
+    lock.unlock();
+
+    resetManager();
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+    context = nullptr;
+}
+
+bool StorageWatcher::ensureManager() {
+    if (manager) {
+        while (g_main_context_iteration(context, FALSE)) {}
+        return true;
+    }
+
+    GError* error = nullptr;
+    bus = openModemBusGio(&error);
+    if (error) {
+        LOG_ERROR("Failed to get GDBus connection: " + std::string(error->message));
+        g_error_free(error);
+        return false;
+    }
+
+    manager = mm_manager_new_sync(bus, G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE, nullptr, &error);
+    if (error) {
+        LOG_ERROR("Failed to create ModemManager proxy: " + std::string(error->message));
+        g_error_free(error);
+        resetManager();
+        return false;
+    }
+
+    return true;
+}
+
+void StorageWatcher::resetManager() {
+    if (manager) {
+        g_object_unref(manager);
+        manager = nullptr;
+    }
+    if (bus) {
+        g_object_unref(bus);
+        bus = nullptr;
+    }
+}
+
+void StorageWatcher::checkStorage() {
+    if (!ensureManager()) return;
+
+    GList* modems = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(manager));
+    std::set<std::string> still_present;
+
+    for (GList* m = modems; m; m = g_list_next(m)) {
+        MMObject* modem_obj = MM_OBJECT(m->data);
+        const char* modem_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(modem_obj));
+        MMModemMessaging* messaging = mm_object_get_modem_messaging(modem_obj);
+        if (!messaging) continue;
+
+        GError* error = nullptr;
+        GList* sms_list = mm_modem_messaging_list_sync(messaging, nullptr, &error);
+        if (error) {
+            LOG_ERROR_LIMITED(error->message, "Storage check failed to get SMS list: " + std::string(error->message));
+            g_error_free(error);
+            g_object_unref(messaging);
+            continue;
+        }
+
+        // Bucket the messages of this modem by storage. ME and SM are always
+        // reported so their gauges drop back to zero once emptied.
+        std::map<MMSmsStorage, std::vector<StoredSms>> by_storage;
+        by_storage[MM_SMS_STORAGE_ME];
+        by_storage[MM_SMS_STORAGE_SM];
+        for (GList* l = sms_list; l; l = g_list_next(l)) {
+            MMSms* sms = MM_SMS(l->data);
+            const char* path = mm_sms_get_path(sms);
+            const char* timestamp = mm_sms_get_timestamp(sms);
+            const char* number = mm_sms_get_number(sms);
+            const char* text = mm_sms_get_text(sms);
+            if (!path) continue;
+
+            bool forwarded = mm_sms_get_state(sms) == MM_SMS_STATE_RECEIVED && number && text &&
+                             isForwarded(forwardedKey(number, text, timestamp ? timestamp : ""));
+            by_storage[mm_sms_get_storage(sms)].push_back(
+                StoredSms{path, timestamp ? timestamp : "", forwarded});
+            still_present.insert(path);
+        }
+        g_list_free_full(sms_list, g_object_unref);
+        g_object_unref(messaging);
+
+        for (auto& bucket : by_storage) {
+            std::vector<StoredSms>& messages = bucket.second;
+            int count = static_cast<int>(messages.size());
+            std::string labels = std::string("{modem=\"") + modem_path + "\",storage=\"" + storageName(bucket.first) + "\"}";
+            Metrics::getInstance().setGauge("sms_forward_storage_messages" + labels, count);
+            LOG_DEBUG("Storage " + std::string(storageName(bucket.first)) + " on " + modem_path +
+                      " holds " + std::to_string(count) + " messages");
+
+            if (prune_threshold <= 0 || count < prune_threshold) continue;
+
+            // Prune down to three quarters of the threshold, oldest first
+            int excess = count - prune_threshold * 3 / 4;
+            std::sort(messages.begin(), messages.end(), [](const StoredSms& a, const StoredSms& b) {
+                return a.timestamp < b.timestamp;
+            });
+
+            int queued = 0;
+            for (const auto& sms : messages) {
+                if (queued >= excess) break;
+                if (!sms.forwarded || pruning.count(sms.path)) continue;
+                pruning.insert(sms.path);
+                deleter.enqueue(modem_path, sms.path);
+                queued++;
+            }
+
+            LOG_WARNING("Storage " + std::string(storageName(bucket.first)) + " on " + modem_path + " holds " +
+                        std::to_string(count) + " messages (threshold " + std::to_string(prune_threshold) +
+                        "), pruning " + std::to_string(queued) + " forwarded messages");
+            Metrics::getInstance().increment("sms_forward_storage_pruned_total" + labels, queued);
+        }
+    }
+    g_list_free_full(modems, g_object_unref);
+
+    // Forget prune requests for messages that are gone
+    for (auto it = pruning.begin(); it != pruning.end();) {
+        it = still_present.count(*it) ? std::next(it) : pruning.erase(it);
+    }
+}
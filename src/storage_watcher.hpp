@@ -0,0 +1,76 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+#pragma once
+#include "sms_deleter.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <libmm-glib.h>
+
+// Tracks how many messages each modem holds per storage (ME/SM/...) and
+// prunes already forwarded messages, oldest first, once a storage reaches
+// the configured threshold. A full SIM silently drops new SMS, so this runs
+// ahead of the modem filling up rather than reacting to lost messages.
+class StorageWatcher {
+public:
+    StorageWatcher(SmsDeleter& deleter, int interval_seconds, int prune_threshold);
+    ~StorageWatcher();
+
+    void start();
+    void stop();
+
+    // Request an early check, e.g. after a new SMS was stored
+    void notifyChanged();
+
+    // Record that the message with this sender, text and modem timestamp
+    // reached WxPusher. The ME and SM copies of one SMS share those but not
+    // their path; a repeated message with the same text has its own timestamp.
+    void markForwarded(const std::string& sender, const std::string& text, const std::string& timestamp);
+
+private:
+    static const size_t kMaxForwardedKeys = 1024;
+
+    void workerLoop();
+    void checkStorage();
+    bool ensureManager();
+    void resetManager();
+    static size_t forwardedKey(const std::string& sender, const std::string& text, const std::string& timestamp);
+    bool isForwarded(size_t key);
+
+    SmsDeleter& deleter;
+    std::chrono::seconds interval;
+    int prune_threshold;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker;
+    bool running;
+    bool changed;
+
+    // Bounded set of forwarded message keys, oldest evicted first
+    std::mutex forwarded_mutex;
+    std::set<size_t> forwarded;
+    std::deque<size_t> forwarded_order;
+
+    // Only touched by the worker thread
+    std::set<std::string> pruning; // SMS paths already handed to the deleter
+    GMainContext* context;
+    GDBusConnection* bus;
+    MMManager* manager;
+};
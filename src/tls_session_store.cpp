@@ -0,0 +1,148 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "tls_session_store.hpp"
+#include "logger.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+
+namespace {
+
+// One session per line: valid_until session_key shmac sdata, binary fields in hex
+std::string toHex(const unsigned char* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(length * 2);
+    for (size_t i = 0; i < length; i++) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0x0f];
+    }
+    return hex;
+}
+
+bool fromHex(const std::string& hex, std::vector<unsigned char>& data) {
+    if (hex.size() % 2 != 0) return false;
+    data.clear();
+    data.reserve(hex.size() / 2);
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        unsigned int byte;
+        if (sscanf(hex.c_str() + i, "%2x", &byte) != 1) return false;
+        data.push_back(static_cast<unsigned char>(byte));
+    }
+    return true;
+}
+
+CURLcode exportSession(CURL*, void* userptr, const char* session_key,
+                       const unsigned char* shmac, size_t shmac_len,
+                       const unsigned char* sdata, size_t sdata_len,
+                       curl_off_t valid_until, int, const char*, size_t) {
+    std::string& out = *static_cast<std::string*>(userptr);
+    out += std::to_string(static_cast<long long>(valid_until)) + " " +
+           toHex(reinterpret_cast<const unsigned char*>(session_key), strlen(session_key)) + " " +
+           toHex(shmac, shmac_len) + " " + toHex(sdata, sdata_len) + "\n";
+    return CURLE_OK;
+}
+
+} // namespace
+
+int TlsSessionStore::load(CURL* curl, const std::string& path) {
+    if (!curl || path.empty()) return 0;
+
+    std::ifstream in(path);
+    if (!in.is_open()) return 0;
+
+    int imported = 0;
+    long long now = static_cast<long long>(time(nullptr));
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        long long valid_until;
+        std::string key_hex, shmac_hex, sdata_hex;
+        if (!(fields >> valid_until >> key_hex >> shmac_hex >> sdata_hex)) continue;
+        if (valid_until <= now) continue;
+
+        std::vector<unsigned char> key, shmac, sdata;
+        if (!fromHex(key_hex, key) || !fromHex(shmac_hex, shmac) || !fromHex(sdata_hex, sdata)) continue;
+        key.push_back('\0');
+
+        CURLcode res = curl_easy_ssls_import(curl, reinterpret_cast<const char*>(key.data()),
+                                             shmac.data(), shmac.size(), sdata.data(), sdata.size());
+        if (res == CURLE_NOT_BUILT_IN) {
+            LOG_INFO("libcurl lacks TLS session export, sessions are not kept across restarts");
+            return 0;
+        }
+        if (res == CURLE_OK) imported++;
+    }
+
+    LOG_DEBUG("Imported " + std::to_string(imported) + " TLS sessions from " + path);
+    return imported;
+}
+
+bool TlsSessionStore::save(CURL* curl, const std::string& path) {
+    if (!curl || path.empty()) return false;
+
+    std::string contents;
+    CURLcode res = curl_easy_ssls_export(curl, exportSession, &contents);
+    if (res != CURLE_OK) {
+        if (res != CURLE_NOT_BUILT_IN) {
+            LOG_WARNING("Failed to export TLS sessions: " + std::string(curl_easy_strerror(res)));
+        }
+        return false;
+    }
+
+    // Session tickets are secrets: keep the file private and replace it atomically
+    std::string dir = path.substr(0, path.find_last_of('/'));
+    if (!dir.empty() && dir != path) mkdir(dir.c_str(), 0700);
+
+    std::string tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        LOG_WARNING("Cannot write TLS session store " + tmp_path);
+        return false;
+    }
+    bool written = write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+    close(fd);
+
+    if (!written || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        LOG_WARNING("Failed to update TLS session store " + path);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+int TlsSessionStore::load(CURL*, const std::string& path) {
+    if (!path.empty()) {
+        LOG_INFO("libcurl is older than 8.12, TLS sessions are not kept across restarts");
+    }
+    return 0;
+}
+
+bool TlsSessionStore::save(CURL*, const std::string&) {
+    return false;
+}
+
+#endif
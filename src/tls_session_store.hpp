@@ -0,0 +1,33 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <string>
+#include <curl/curl.h>
+
+// Persists the TLS sessions in a curl handle's session cache to a file so
+// that the first connection after a restart can resume instead of doing a
+// full handshake. Needs libcurl 8.12 or newer built with SSLS-EXPORT; with
+// older versions both calls are no-ops and sessions are only resumed within
+// the process.
+namespace TlsSessionStore {
+
+// Import unexpired sessions from path into the handle's cache
+int load(CURL* curl, const std::string& path);
+
+// Export the handle's cached sessions to path, replacing its contents
+bool save(CURL* curl, const std::string& path);
+
+} // namespace TlsSessionStore
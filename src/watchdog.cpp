@@ -0,0 +1,228 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#include "watchdog.hpp"
+#include "config.hpp"
+#include "flight_recorder.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <csignal>
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const kLoopNames[] = {"monitor", "push"};
+
+// Stack sample taken by the stalled thread itself in a signal handler
+const int kMaxSampleFrames = 64;
+void* g_sample_frames[kMaxSampleFrames];
+std::atomic<int> g_sample_depth(0);
+std::atomic<bool> g_sample_ready(false);
+
+void sampleHandler(int) {
+    g_sample_depth.store(backtrace(g_sample_frames, kMaxSampleFrames));
+    g_sample_ready.store(true);
+}
+
+} // namespace
+
+Watchdog& Watchdog::getInstance() {
+    static Watchdog instance;
+    return instance;
+}
+
+int64_t Watchdog::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool Watchdog::notify(const char* state) {
+    const char* socket_path = getenv("NOTIFY_SOCKET");
+    if (!socket_path || !*socket_path) return false;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    size_t length = strlen(socket_path);
+    if (length >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, socket_path, length);
+    if (addr.sun_path[0] == '@') addr.sun_path[0] = '\0'; // Abstract namespace
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    ssize_t sent = sendto(fd, state, strlen(state), MSG_NOSIGNAL, reinterpret_cast<sockaddr*>(&addr),
+                          static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length));
+    close(fd);
+    return sent >= 0;
+}
+
+void Watchdog::start(int stall_seconds, int restart_seconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    stall_after = static_cast<int64_t>(stall_seconds) * 1000000000;
+    restart_after = static_cast<int64_t>(restart_seconds) * 1000000000;
+
+    // SIGURG is ignored by default, so a stray sample request is harmless
+    struct sigaction action{};
+    action.sa_handler = sampleHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGURG, &action, nullptr);
+
+    // The first backtrace() may load the unwinder; do that outside a handler
+    void* frame;
+    backtrace(&frame, 1);
+
+    running = true;
+    worker = std::thread(&Watchdog::watchLoop, this);
+}
+
+void Watchdog::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+void Watchdog::bindThread(Slot& slot) {
+    // Each loop runs on one thread for its whole life
+    if (!slot.has_thread.load(std::memory_order_acquire)) {
+        slot.thread = pthread_self();
+        slot.has_thread.store(true, std::memory_order_release);
+    }
+}
+
+void Watchdog::beat(WatchedLoop loop) {
+    Slot& slot = slots[static_cast<int>(loop)];
+    bindThread(slot);
+    slot.last_beat.store(nowNs());
+}
+
+Watchdog::Stage::Stage(WatchedLoop loop, const char* name) : loop(loop) {
+    Slot& slot = getInstance().slots[static_cast<int>(loop)];
+    getInstance().bindThread(slot);
+    previous = slot.stage.load();
+    if (!previous) slot.since.store(nowNs());
+    slot.stage.store(name);
+}
+
+Watchdog::Stage::~Stage() {
+    Slot& slot = getInstance().slots[static_cast<int>(loop)];
+    slot.stage.store(previous);
+    // A long stage is not a quiet period of a beating loop
+    if (!previous && slot.last_beat.load() != 0) slot.last_beat.store(nowNs());
+}
+
+std::string Watchdog::sampleStack(const Slot& slot) {
+    if (!slot.has_thread.load(std::memory_order_acquire)) return "<no thread>";
+
+    // The signal interrupts the stuck call once; SA_RESTART resumes most of
+    // them, sleeps return early
+    g_sample_ready.store(false);
+    if (pthread_kill(slot.thread, SIGURG) != 0) return "<thread gone>";
+
+    for (int i = 0; i < 20 && !g_sample_ready.load(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!g_sample_ready.load()) return "<no sample, thread did not respond>";
+
+    // Skip the handler's own frame
+    int depth = g_sample_depth.load();
+    return depth > 1 ? Logger::getInstance().formatStackTrace(g_sample_frames + 1, depth - 1) : "<empty>";
+}
+
+bool Watchdog::check(int index, int64_t now) {
+    Slot& slot = slots[index];
+    const char* stage = slot.stage.load();
+    int64_t started = stage ? slot.since.load() : slot.last_beat.load();
+    int64_t lag = started != 0 ? now - started : 0;
+    std::string loop_label = std::string("{loop=\"") + kLoopNames[index] + "\"}";
+
+    if (stall_after == 0 || lag < stall_after) {
+        if (slot.reported) {
+            LOG_INFO(std::string("Loop ") + kLoopNames[index] + " recovered from stall");
+            slot.reported = false;
+        }
+        return true;
+    }
+
+    std::string where = stage ? std::string("in stage '") + stage + "'" : std::string("outside any stage");
+    long seconds = static_cast<long>(lag / 1000000000);
+
+    if (!slot.reported) {
+        slot.reported = true;
+        Metrics::getInstance().increment("sms_forward_loop_stalls_total" + loop_label);
+        LOG_WARNING(std::string("Loop ") + kLoopNames[index] + " stalled for " + std::to_string(seconds) +
+                    " s " + where + ", stack sample:\n" + sampleStack(slot));
+        if (FlightRecorder::getInstance().dump("stall")) {
+            LOG_INFO("Recent events written to " + Config::getInstance().getFlightRecorderFile());
+        }
+    }
+
+    if (!supervised && restart_after > 0 && lag >= restart_after) {
+        LOG_ERROR(std::string("Loop ") + kLoopNames[index] + " stalled for " + std::to_string(seconds) +
+                  " s " + where + ", aborting so the service gets restarted");
+        abort();
+    }
+    return false;
+}
+
+void Watchdog::watchLoop() {
+    // systemd passes the expected ping interval; ping at half of it
+    int64_t ping_interval = 0;
+    const char* usec = getenv("WATCHDOG_USEC");
+    const char* pid = getenv("WATCHDOG_PID");
+    if (usec && (!pid || atol(pid) == static_cast<long>(getpid()))) {
+        ping_interval = atoll(usec) * 1000 / 2;
+    }
+    supervised = ping_interval > 0;
+    if (supervised) {
+        LOG_INFO("Service manager watchdog enabled, pinging every " +
+                 std::to_string(ping_interval / 1000000) + " ms while healthy");
+    }
+
+    int64_t tick = supervised ? std::min<int64_t>(ping_interval, 1000000000) : 1000000000;
+    int64_t last_ping = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        lock.unlock();
+
+        int64_t now = nowNs();
+        bool healthy = true;
+        for (int i = 0; i < kLoopCount; i++) {
+            if (!check(i, now)) healthy = false;
+        }
+
+        // A stalled loop stops the pings, so the service manager restarts us
+        if (healthy && supervised && now - last_ping >= ping_interval) {
+            notify("WATCHDOG=1");
+            last_ping = now;
+        }
+
+        lock.lock();
+        cv.wait_for(lock, std::chrono::nanoseconds(tick), [this] { return !running; });
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+
+// Event loops supervised by the watchdog
+enum class WatchedLoop { Monitor = 0, Push = 1 };
+
+// Detects stalled event loops. Loops name the potentially blocking stage they
+// are in; a stage running past the stall threshold is logged once, with a
+// stack sample of the stuck thread. While every loop is healthy the service
+// manager is pinged (sd_notify WATCHDOG=1), so a wedged daemon stops pinging
+// and gets restarted. Without such a supervisor, a stall lasting past the
+// restart threshold aborts the process for the respawning init script.
+class Watchdog {
+public:
+    static Watchdog& getInstance();
+
+    // Thresholds in seconds, 0 disables stall detection or the abort
+    void start(int stall_seconds, int restart_seconds);
+    void stop();
+
+    // Loops that wake up periodically call this every iteration, so going
+    // quiet outside any stage counts as a stall too
+    void beat(WatchedLoop loop);
+
+    // Marks the loop as busy for the lifetime of the object. Nested stages
+    // report the innermost name but keep the outer start time.
+    class Stage {
+    public:
+        Stage(WatchedLoop loop, const char* name);
+        ~Stage();
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+
+    private:
+        WatchedLoop loop;
+        const char* previous;
+    };
+
+    // Send a state such as READY=1 to the service manager if it asked for it
+    static bool notify(const char* state);
+
+private:
+    static constexpr int kLoopCount = 2;
+
+    struct Slot {
+        std::atomic<const char*> stage{nullptr};
+        std::atomic<int64_t> since{0};     // Stage entry, steady clock ns
+        std::atomic<int64_t> last_beat{0}; // 0 while the loop does not beat
+        std::atomic<bool> has_thread{false};
+        pthread_t thread;
+        bool reported = false;             // Current stall already logged
+    };
+
+    Watchdog() : running(false), supervised(false), stall_after(0), restart_after(0) {}
+    void watchLoop();
+    bool check(int index, int64_t now);
+    void bindThread(Slot& slot);
+    std::string sampleStack(const Slot& slot);
+    static int64_t nowNs();
+
+    Slot slots[kLoopCount];
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker;
+    bool running;
+    bool supervised;       // The service manager expects pings
+    int64_t stall_after;   // ns
+    int64_t restart_after; // ns
+};
@@ -13,11 +13,64 @@
  */
 
 #include "wx_pusher.hpp"
+#include "dns_resolver.hpp"
+#include "json_reader.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "probes.hpp"
+#include "tls_session_store.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <sstream>
+#include <arpa/inet.h>
 #include <curl/curl.h>
 
+// Bounds for the DNS cache lifetime, whatever the record TTL says
+static const int kMinDnsTtl = 30;
+static const int kMaxDnsTtl = 3600;
+
+// Hedge delay and request timeout follow the durations of recent requests
+// once there are enough of them; until then the defaults apply
+static const size_t kMinRttSamples = 8;
+static const long kDefaultHedgeMs = 2000;
+static const long kMinHedgeMs = 250;
+static const long kMaxHedgeMs = 5000;
+static const long kMinTimeoutMs = 3000;
+static const long kMaxTimeoutMs = 10000;
+
+// Replace problematic characters in JSON
+static std::string escapeJson(const std::string& str) {
+    std::string result;
+    appendJsonEscaped(result, str);
+    return result;
+}
+
+// The "uids" and "topicIds" members for a recipient list, empty if it names nobody
+static std::string recipientMembers(const std::string& list) {
+    std::string uids, topic_ids;
+    std::stringstream entries(list);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        entry.erase(0, entry.find_first_not_of(" \t"));
+        entry.erase(entry.find_last_not_of(" \t") + 1);
+        if (entry.empty()) continue;
+
+        // Topic IDs are numbers, UIDs start with UID_
+        if (entry.find_first_not_of("0123456789") == std::string::npos) {
+            topic_ids += (topic_ids.empty() ? "" : ",") + entry;
+        } else {
+            uids += (uids.empty() ? "\"" : ",\"") + escapeJson(entry) + "\"";
+        }
+    }
+
+    std::string members;
+    if (!uids.empty()) members = "\"uids\":[" + uids + "]";
+    if (!topic_ids.empty()) members += (members.empty() ? "" : ",") + std::string("\"topicIds\":[") + topic_ids + "]";
+    return members;
+}
+
 // Callback function to capture response data
 static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
     size_t realsize = size * nmemb;
@@ -26,96 +79,543 @@ static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* use
     return realsize;
 }
 
-WxPusher::WxPusher(const std::string& token, const std::string& uid)
-    : token(token), uid(uid) {
+WxPusher::WxPusher(const std::string& token, const std::string& recipients, const std::string& endpoint,
+                   const std::string& ca_file, const std::string& session_file)
+    : token(token), summary_template(PushTemplate::kDefaultSummary),
+      code_summary_template(PushTemplate::kDefaultCodeSummary), content_template(PushTemplate::kDefaultContent),
+      endpoint(endpoint), session_file(session_file), port(0),
+      dns_refresh_at(std::chrono::steady_clock::now()), resolve_list(nullptr), multi(nullptr),
+      curl(nullptr), hedge_curl(nullptr), ca_file(ca_file), rtt_ms(), rtt_count(0), throttled(false),
+      interrupted(false), suspended(false) {
+    // Split scheme://host[:port]/path; the host is cached and pinned below
+    size_t scheme_end = endpoint.find("://");
+    size_t host_start = scheme_end == std::string::npos ? 0 : scheme_end + 3;
+    size_t host_end = endpoint.find('/', host_start);
+    std::string scheme = scheme_end == std::string::npos ? "https" : endpoint.substr(0, scheme_end);
+    std::string authority = endpoint.substr(host_start, host_end == std::string::npos ? std::string::npos : host_end - host_start);
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+        host = authority.substr(0, colon);
+        port = atoi(authority.c_str() + colon + 1);
+    } else {
+        host = authority;
+        port = scheme == "http" ? 80 : 443;
+    }
+    origin = scheme + "://" + authority + "/";
+    query_url = origin + "api/send/query/";
+    recipient_sets.push_back(recipientMembers(recipients));
+
+    // Address literals need no resolving
+    unsigned char buf[sizeof(struct in6_addr)];
+    if (host.empty() || host[0] == '[' || inet_pton(AF_INET, host.c_str(), buf) == 1) {
+        host.clear();
+    }
+
+    multi = curl_multi_init();
     curl = curl_easy_init();
+    if (!multi || !curl) return;
+
+    configureHandle(curl, ca_file);
+    TlsSessionStore::load(curl, session_file);
+}
+
+void WxPusher::configureHandle(CURL* handle, const std::string& ca_file) {
+    // Verify the server certificate. The CA store is parsed on the first
+    // handshake and kept for the lifetime of the handle, so later handshakes
+    // do not reload the bundle.
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 2L);
+    if (!ca_file.empty()) {
+        curl_easy_setopt(handle, CURLOPT_CAINFO, ca_file.c_str());
+    }
+#if LIBCURL_VERSION_NUM >= 0x075700
+    curl_easy_setopt(handle, CURLOPT_CA_CACHE_TIMEOUT, -1L);
+#endif
+
+    // Sessions are cached per handle; the primary one is seeded from the last run
+    curl_easy_setopt(handle, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_NODELAY, 1L);
+    if (resolve_list) curl_easy_setopt(handle, CURLOPT_RESOLVE, resolve_list);
 }
 
 WxPusher::~WxPusher() {
-    if (curl) curl_easy_cleanup(curl);
+    if (hedge_curl) curl_easy_cleanup(hedge_curl);
+    if (curl) {
+        TlsSessionStore::save(curl, session_file);
+        curl_easy_cleanup(curl);
+    }
+    if (multi) curl_multi_cleanup(multi);
+    if (resolve_list) curl_slist_free_all(resolve_list);
 }
 
-bool WxPusher::sendMessage(const std::string& title, const std::string& content) {
-    if (!curl) {
-        LOG_ERROR("CURL not initialized");
+void WxPusher::enableHedging(const std::string& secondary) {
+    if (!multi || hedge_curl) return;
+
+    hedge_curl = curl_easy_init();
+    if (!hedge_curl) return;
+    configureHandle(hedge_curl, ca_file);
+
+    secondary_endpoint = secondary;
+    if (!secondary.empty()) {
+        size_t scheme_end = secondary.find("://");
+        size_t path = secondary.find('/', scheme_end == std::string::npos ? 0 : scheme_end + 3);
+        secondary_origin = path == std::string::npos ? secondary + "/" : secondary.substr(0, path + 1);
+    }
+    LOG_INFO(secondary.empty() ? "Pushes that fail to connect are resent on a new connection"
+                               : "Slow or failed pushes are hedged to " + secondary);
+}
+
+void WxPusher::setTemplates(const PushTemplate& summary, const PushTemplate& code_summary,
+                            const PushTemplate& content) {
+    summary_template = summary;
+    code_summary_template = code_summary;
+    content_template = content;
+}
+
+size_t WxPusher::addRecipients(const std::string& list) {
+    std::string members = recipientMembers(list);
+    if (members.empty()) {
+        LOG_WARNING("No recipients in \"" + list + "\", using the default recipients");
+        return 0;
+    }
+
+    recipient_sets.push_back(members);
+    return recipient_sets.size() - 1;
+}
+
+bool WxPusher::refreshDns() {
+    auto now = std::chrono::steady_clock::now();
+    if (host.empty()) {
+        dns_refresh_at = now + std::chrono::seconds(kMaxDnsTtl);
         return false;
     }
 
-    // Create a properly escaped JSON string
-    std::string jsonContent = title + "\n" + content;
-
-    // Replace problematic characters in JSON
-    auto escapeJson = [](std::string str) {
-        std::string result;
-        for (char c : str) {
-            switch (c) {
-                case '"': result += "\\\""; break;
-                case '\\': result += "\\\\"; break;
-                case '\n': result += "\\n"; break;
-                case '\r': result += "\\r"; break;
-                case '\t': result += "\\t"; break;
-                case '\b': result += "\\b"; break;
-                case '\f': result += "\\f"; break;
-                default: result += c;
+    std::vector<std::string> resolved;
+    int ttl = 0;
+    if (!resolveWithTtl(host, resolved, ttl)) {
+        // Keep serving the previous addresses and try again shortly
+        LOG_WARNING("DNS refresh for " + host + " failed, keeping " +
+                    std::to_string(addresses.size()) + " cached addresses");
+        dns_refresh_at = now + std::chrono::seconds(kMinDnsTtl);
+        return false;
+    }
+
+    // Refresh ahead of expiry so the send path never waits on a lookup
+    ttl = std::max(kMinDnsTtl, std::min(kMaxDnsTtl, ttl));
+    dns_refresh_at = now + std::chrono::seconds(ttl * 4 / 5);
+
+    std::sort(resolved.begin(), resolved.end());
+    if (resolved == addresses) return false;
+
+    std::string pair = host + ":" + std::to_string(port);
+    std::string entry = pair + ":";
+    for (size_t i = 0; i < resolved.size(); i++) {
+        entry += (i ? "," : "") + resolved[i];
+    }
+
+    // Drop the previously pinned entry before adding the new one
+    struct curl_slist* list = nullptr;
+    if (!addresses.empty()) list = curl_slist_append(list, ("-" + pair).c_str());
+    list = curl_slist_append(list, entry.c_str());
+    if (curl) curl_easy_setopt(curl, CURLOPT_RESOLVE, list);
+    if (hedge_curl) curl_easy_setopt(hedge_curl, CURLOPT_RESOLVE, list);
+    if (resolve_list) curl_slist_free_all(resolve_list);
+    resolve_list = list;
+
+    LOG_INFO("Resolved " + host + " to " + entry.substr(pair.size() + 1) + " (TTL " + std::to_string(ttl) + "s)");
+    bool changed = !addresses.empty();
+    addresses = resolved;
+    return changed;
+}
+
+void WxPusher::reconnect() {
+    if (!curl || !multi) return;
+
+    // Pooled connections are bound to a source address that may be gone.
+    // The handles are only attached during a transfer, so the pool can go.
+    curl_multi_cleanup(multi);
+    multi = curl_multi_init();
+    if (!multi) {
+        LOG_ERROR("Failed to recreate the WxPusher connection pool");
+        return;
+    }
+
+    dns_refresh_at = std::chrono::steady_clock::now();
+    refreshDns();
+    warmUp();
+}
+
+void WxPusher::maintain() {
+    if (std::chrono::steady_clock::now() < dns_refresh_at) return;
+
+    if (refreshDns()) {
+        LOG_INFO("Addresses of " + host + " changed, reconnecting ahead of the next push");
+        warmUp();
+    }
+}
+
+CURLcode WxPusher::perform(CURL* handle) {
+    curl_multi_add_handle(multi, handle);
+
+    CURLcode result = CURLE_OK;
+    bool done = false;
+    while (!done) {
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg == CURLMSG_DONE && msg->easy_handle == handle) {
+                result = msg->data.result;
+                done = true;
             }
         }
-        return result;
+        if (!done) curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+
+    curl_multi_remove_handle(multi, handle);
+    return result;
+}
+
+void WxPusher::warmUp() {
+    if (!curl || !multi) return;
+    if (addresses.empty()) refreshDns();
+
+    // A HEAD request on the origin leaves a verified keep-alive connection
+    // in the multi handle's pool for the next POST to reuse
+    auto warm = [this](CURL* handle, const std::string& url) {
+        std::string response;
+        curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, nullptr);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L);
+        curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT, 0L);
+
+        CURLcode res = perform(handle);
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 0L);
+
+        if (res != CURLE_OK) {
+            LOG_WARNING("Connection warm-up to " + url + " failed: " + std::string(curl_easy_strerror(res)));
+            return;
+        }
+        afterTransfer(handle);
     };
 
-    std::string escapedToken = escapeJson(token);
-    std::string escapedContent = escapeJson(jsonContent);
-    std::string escapedUid = escapeJson(uid);
-    std::string escapedSummary = escapeJson(title);
+    warm(curl, origin);
+    // Failing over should not wait for a handshake either
+    if (hedge_curl && !secondary_origin.empty()) warm(hedge_curl, secondary_origin);
+}
+
+void WxPusher::afterTransfer(CURL* handle) {
+    long new_connections = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &new_connections);
+    if (new_connections == 0) return;
+
+    char* url = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+    curl_off_t dns = 0, connect = 0, tls = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+    LOG_DEBUG("New connection for " + std::string(url ? url : origin.c_str()) +
+              ": dns " + std::to_string(static_cast<long long>(dns / 1000)) +
+              "ms, connect " + std::to_string(static_cast<long long>(connect / 1000)) +
+              "ms, tls " + std::to_string(static_cast<long long>(tls / 1000)) + "ms");
+
+    // A new connection may carry a new session ticket
+    if (handle == curl) TlsSessionStore::save(curl, session_file);
+}
+
+void WxPusher::recordRtt(std::chrono::steady_clock::duration rtt) {
+    rtt_ms[rtt_count++ % kRttSamples] = std::chrono::duration_cast<std::chrono::milliseconds>(rtt).count();
+}
 
-    // Build the JSON payload properly
-    std::stringstream json;
-    json << "{";
-    json << "\"appToken\":\"" << escapedToken << "\"";
-    json << ",\"content\":\"" << escapedContent << "\"";
-    json << ",\"uids\":[\"" << escapedUid << "\"]";
-    json << ",\"summary\":\"" << escapedSummary << "\"";
-    json << "}";
+long WxPusher::rttPercentile(double p) const {
+    size_t count = std::min(rtt_count, kRttSamples);
+    if (count < kMinRttSamples) return -1;
+
+    std::vector<long> sorted(rtt_ms, rtt_ms + count);
+    size_t index = std::min(count - 1, static_cast<size_t>(p * count));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
 
-    std::string jsonStr = json.str();
-    LOG_DEBUG("Sending to WxPusher: " + jsonStr);
+void WxPusher::startAttempt(Attempt& attempt, const std::string& url, const std::string& payload,
+                            struct curl_slist* headers, bool fresh_connection) {
+    long p99 = rttPercentile(0.99);
+    long timeout_ms = p99 < 0 ? kMaxTimeoutMs : std::max(kMinTimeoutMs, std::min(kMaxTimeoutMs, p99 * 4));
+
+    curl_easy_setopt(attempt.handle, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(attempt.handle, CURLOPT_POST, 1L);
+    curl_easy_setopt(attempt.handle, CURLOPT_POSTFIELDS, payload.c_str());
+    curl_easy_setopt(attempt.handle, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(attempt.handle, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(attempt.handle, CURLOPT_WRITEDATA, &attempt.response);
+    curl_easy_setopt(attempt.handle, CURLOPT_TIMEOUT_MS, timeout_ms);
+    // A duplicate stuck behind the same connection problem would not help
+    curl_easy_setopt(attempt.handle, CURLOPT_FRESH_CONNECT, fresh_connection ? 1L : 0L);
+
+    attempt.started = std::chrono::steady_clock::now();
+    attempt.active = true;
+    curl_multi_add_handle(multi, attempt.handle);
+}
+
+void WxPusher::finishAttempt(Attempt& attempt) {
+    if (!attempt.active) return;
+    curl_easy_getinfo(attempt.handle, CURLINFO_RESPONSE_CODE, &attempt.http_code);
+    // Zero until the connection was up and the request about to be sent
+    curl_off_t pretransfer = 0;
+    curl_easy_getinfo(attempt.handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    attempt.sent = pretransfer > 0 || attempt.http_code != 0;
+    // Removing a transfer that is still running aborts it
+    curl_multi_remove_handle(multi, attempt.handle);
+    attempt.active = false;
+}
+
+bool WxPusher::sendMessage(const PushMessage& message, uint64_t trace_id,
+                           size_t recipients, uint64_t push_id) {
+    throttled = false;
+    receipts.clear();
+    interrupted = suspended;
+    if (interrupted) return false;
+
+    if (!curl || !multi) {
+        LOG_ERROR("CURL not initialized");
+        return false;
+    }
+
+    const std::string& members = recipient_sets[recipients < recipient_sets.size() ? recipients : 0];
+    if (members.empty()) {
+        LOG_ERROR("No WxPusher recipients configured");
+        return false;
+    }
+
+    // The templates render straight into the payload. The summary is what
+    // the lock screen shows, so a code found in the text goes there.
+    const PushTemplate& summary = message.code.empty() ? summary_template : code_summary_template;
+    std::string jsonStr;
+    jsonStr.reserve(64 + token.size() + members.size() + 2 * message.bytes());
+    jsonStr += "{\"appToken\":\"";
+    appendJsonEscaped(jsonStr, token);
+    size_t token_end = jsonStr.size();
+    jsonStr += "\",\"content\":\"";
+    content_template.render(message, jsonStr, true);
+    jsonStr += "\",";
+    jsonStr += members;
+    if (!summary.empty()) {
+        jsonStr += ",\"summary\":\"";
+        summary.render(message, jsonStr, true);
+        jsonStr += "\"";
+    }
+    jsonStr += "}";
+    // The token stays out of the log and the flight recorder
+    LOG_DEBUG("Sending to WxPusher: {\"appToken\":\"***" + jsonStr.substr(token_end));
 
     struct curl_slist* headers = NULL;
     headers = curl_slist_append(headers, "Content-Type: application/json");
+    if (push_id) {
+        char key[48];
+        snprintf(key, sizeof(key), "Idempotency-Key: %016llx", static_cast<unsigned long long>(push_id));
+        headers = curl_slist_append(headers, key);
+    }
 
-    // Use HTTPS instead of HTTP
-    curl_easy_setopt(curl, CURLOPT_URL, "https://wxpusher.zjiecode.com/api/send/message");
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    // Capture the response
-    std::string response;
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    long p95 = rttPercentile(0.95);
+    long hedge_ms = p95 < 0 ? kDefaultHedgeMs : std::max(kMinHedgeMs, std::min(kMaxHedgeMs, p95));
+    Metrics::getInstance().setGauge("sms_forward_push_hedge_delay_seconds", hedge_ms / 1000.0);
+
+    SMS_PROBE2(http_send_begin, trace_id, jsonStr.size());
+    Attempt primary{curl, std::string(), {}, false, CURLE_OK, 0, false};
+    Attempt hedge{hedge_curl, std::string(), {}, false, CURLE_OK, 0, false};
+    startAttempt(primary, endpoint, jsonStr, headers, false);
+    // WxPusher does not deduplicate, so only a relay that does gets slow requests twice
+    auto hedge_at = secondary_endpoint.empty() ? std::chrono::steady_clock::time_point::max()
+                                               : primary.started + std::chrono::milliseconds(hedge_ms);
+    bool hedged = false;
+    Attempt* winner = nullptr;
 
-    // Set SSL verification options
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    while (true) {
+        if (suspended) {
+            interrupted = true;
+            break;
+        }
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Attempt& attempt = msg->easy_handle == curl ? primary : hedge;
+            attempt.result = msg->data.result;
+            finishAttempt(attempt);
+
+            // A server error is worth waiting for the other copy
+            if (attempt.result == CURLE_OK && attempt.http_code < 500) {
+                if (!winner) winner = &attempt;
+            } else if (&attempt == &primary) {
+                LOG_WARNING_LIMITED(std::to_string(attempt.result) + "/" + std::to_string(attempt.http_code),
+                                    "WxPusher request failed: " + (attempt.result == CURLE_OK
+                                        ? "HTTP " + std::to_string(attempt.http_code)
+                                        : std::string(curl_easy_strerror(attempt.result))));
+                if (!attempt.sent || !secondary_endpoint.empty()) hedge_at = std::chrono::steady_clock::now();
+            }
+        }
+        if (winner) break;
 
-    // Set timeout
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+        auto now = std::chrono::steady_clock::now();
+        if (hedge_curl && !hedged && now >= hedge_at) {
+            hedged = true;
+            const std::string& url = secondary_endpoint.empty() ? endpoint : secondary_endpoint;
+            LOG_INFO(std::string(primary.active ? "WxPusher request slower than " + std::to_string(hedge_ms) + " ms"
+                                                : "Retrying failed WxPusher request") + ", sending it to " + url);
+            startAttempt(hedge, url, jsonStr, headers, secondary_endpoint.empty());
+            continue;
+        }
+        if (!primary.active && !hedge.active) break;
 
-    CURLcode res = curl_easy_perform(curl);
+        long wait_ms = 1000;
+        if (hedge_curl && !hedged) {
+            wait_ms = std::min(wait_ms, static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                            hedge_at - now).count()) + 1);
+        }
+        curl_multi_poll(multi, nullptr, 0, static_cast<int>(wait_ms), nullptr);
+    }
+
+    // Whichever copy lost is cancelled
+    finishAttempt(primary);
+    finishAttempt(hedge);
     curl_slist_free_all(headers);
 
+    if (interrupted) {
+        SMS_PROBE3(http_send_end, trace_id, -static_cast<long>(CURLE_ABORTED_BY_CALLBACK), 0);
+        LOG_WARNING("WxPusher request abandoned, the network went down");
+        return false;
+    }
+
+    if (hedged) {
+        const char* outcome = winner == &hedge ? "hedge" : winner ? "primary" : "none";
+        Metrics::getInstance().increment("sms_forward_push_hedges_total{winner=\"" + std::string(outcome) + "\"}");
+        LOG_INFO("Hedged WxPusher request answered by " + std::string(outcome));
+    }
+
+    // Without a winner, report the most telling failure
+    const Attempt& answer = winner ? *winner
+                          : hedged && primary.result != CURLE_OK && hedge.result == CURLE_OK ? hedge : primary;
+    CURLcode res = answer.result;
+    long http_code = answer.http_code;
+    const std::string& response = answer.response;
+    if (winner) recordRtt(std::chrono::steady_clock::now() - winner->started);
+
+    // Transport errors are reported as negative curl codes
+    SMS_PROBE3(http_send_end, trace_id, res == CURLE_OK ? http_code : -static_cast<long>(res), response.size());
+
     if (res != CURLE_OK) {
-        LOG_ERROR("Failed to send message to WxPusher: " + std::string(curl_easy_strerror(res)));
+        LOG_ERROR_LIMITED(curl_easy_strerror(res),
+                          "Failed to send message to WxPusher: " + std::string(curl_easy_strerror(res)));
         return false;
     }
 
+    afterTransfer(answer.handle);
+
     // Log the response
-    LOG_DEBUG("WxPusher API response: " + response);
+    LOG_DEBUG("WxPusher API response (HTTP " + std::to_string(http_code) + "): " + response);
+
+    JsonValue reply;
+    if (!parseJson(response, reply)) {
+        // Typically an error page from a proxy in between
+        throttled = http_code == 429;
+        LOG_ERROR_LIMITED(std::to_string(http_code), "Unreadable WxPusher response (HTTP " +
+                          std::to_string(http_code) + "): " + response.substr(0, 200));
+        return false;
+    }
 
-    // Check if the response contains success
-    if (response.find("\"success\":true") != std::string::npos) {
+    const JsonValue* success = reply.find("success");
+    if (success && success->isTrue()) {
+        // One send record per recipient; a recipient that cannot be reached,
+        // e.g. an unsubscribed UID, is refused on its own
+        size_t refused = 0;
+        const JsonValue* data = reply.find("data");
+        for (const JsonValue& item : data ? data->items : std::vector<JsonValue>()) {
+            const JsonValue* uid = item.find("uid");
+            const JsonValue* topic_id = item.find("topicId");
+            std::string recipient = uid && uid->type == JsonValue::Type::String ? uid->string
+                                  : topic_id && topic_id->type == JsonValue::Type::Number
+                                  ? std::to_string(topic_id->integer) : std::string("?");
+            const JsonValue* code = item.find("code");
+            const JsonValue* record_id = item.find("sendRecordId");
+            if ((code && code->asInteger() != 1000) || !record_id) {
+                const JsonValue* status = item.find("status");
+                refused++;
+                LOG_WARNING_LIMITED(recipient, "WxPusher did not send to " + recipient + ": " +
+                                    (status ? status->string : std::string("no send record")));
+                continue;
+            }
+            const JsonValue* message_id = item.find("messageId");
+            receipts.push_back(Receipt{record_id->asInteger(), message_id ? message_id->asInteger() : 0, recipient});
+        }
+        if (refused > 0 && receipts.empty()) {
+            LOG_ERROR("WxPusher accepted the message but none of its recipients");
+            return false;
+        }
         LOG_INFO("Message sent to WxPusher successfully");
         return true;
+    }
+
+    // Only HTTP 429 means rate limiting. Other errors, whatever their
+    // message says, fail the push instead of slowing every later one down.
+    if (http_code == 429) {
+        throttled = true;
+        LOG_WARNING("WxPusher API throttled the request: " + response);
     } else {
-        LOG_ERROR("WxPusher API returned error: " + response);
+        LOG_ERROR_LIMITED(response, "WxPusher API returned error: " + response);
+    }
+    return false;
+}
+
+bool WxPusher::queryDelivery(int64_t send_record_id, Delivery& state) {
+    state = Delivery::Pending;
+    if (suspended || !curl || !multi) return false;
+
+    std::string url = query_url + std::to_string(send_record_id);
+    std::string response;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, kMaxTimeoutMs);
+    curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 0L);
+
+    CURLcode res = perform(curl);
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (res != CURLE_OK) {
+        LOG_WARNING_LIMITED(curl_easy_strerror(res),
+                            "Delivery status query failed: " + std::string(curl_easy_strerror(res)));
+        return false;
+    }
+    afterTransfer(curl);
+
+    JsonValue reply;
+    const JsonValue* success = nullptr;
+    const JsonValue* data = nullptr;
+    if (!parseJson(response, reply) || !(success = reply.find("success")) || !success->isTrue() ||
+        !(data = reply.find("data"))) {
+        LOG_WARNING_LIMITED(std::to_string(http_code), "Delivery status query refused (HTTP " +
+                            std::to_string(http_code) + "): " + response.substr(0, 200));
         return false;
     }
+
+    // The record's status is worded like the send response's, e.g. 发送成功
+    // once sent to the phone or 发送失败; 创建发送任务成功 only means queued
+    const JsonValue* status = data->find("status");
+    if (status && status->type == JsonValue::Type::String) {
+        if (status->string.find("失败") != std::string::npos) {
+            state = Delivery::Failed;
+        } else if (status->string.find("发送成功") != std::string::npos) {
+            state = Delivery::Delivered;
+        }
+    }
+    return true;
 }
@@ -13,19 +13,136 @@
  */
 
 #pragma once
+#include "push_template.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <curl/curl.h>
 
 class WxPusher {
 public:
-    WxPusher(const std::string& token, const std::string& uid);
+    // One recipient's copy of a sent message, as listed in the response
+    struct Receipt {
+        int64_t send_record_id;
+        int64_t message_id;
+        std::string recipient; // UID, or topic ID for topic pushes
+    };
+
+    enum class Delivery { Pending, Delivered, Failed };
+
+    // recipients is the default recipient list, see addRecipients.
+    // ca_file overrides the libcurl default CA bundle when not empty;
+    // session_file keeps TLS sessions across restarts, empty disables it
+    WxPusher(const std::string& token, const std::string& recipients, const std::string& endpoint,
+             const std::string& ca_file, const std::string& session_file);
     ~WxPusher();
 
-    // Send a message to WxPusher
-    bool sendMessage(const std::string& title, const std::string& content);
+    // Register a comma separated list of UIDs and topic IDs (digits only)
+    // and return its index for sendMessage. Index 0 is the default list.
+    // Call before the first sendMessage.
+    size_t addRecipients(const std::string& list);
+
+    // Resend at once, on a new connection, a request that failed before its
+    // body was sent. With a secondary_endpoint, which must deduplicate on
+    // Idempotency-Key, slow requests are also sent there once they take
+    // longer than the p95 of recent requests, and so are requests that
+    // failed after reaching the endpoint; whichever answers first wins and
+    // the other is cancelled. Call before the first sendMessage.
+    void enableHedging(const std::string& secondary_endpoint);
+
+    // How messages are laid out: the summary, shown in notifications, with
+    // and without a verification code, and the content. An empty summary
+    // leaves it to WxPusher. Call before the first sendMessage.
+    void setTemplates(const PushTemplate& summary, const PushTemplate& code_summary, const PushTemplate& content);
+
+    // Send a message to every recipient of one list in a single request.
+    // trace_id only tags the request in the USDT probes. A non-zero push_id
+    // is sent as Idempotency-Key, the same for a hedged duplicate and for
+    // retries of the push, so a relay can deliver it only once.
+    bool sendMessage(const PushMessage& message, uint64_t trace_id = 0,
+                     size_t recipients = 0, uint64_t push_id = 0);
+
+    // Whether the last sendMessage call was rejected by the API rate limit
+    bool wasThrottled() const { return throttled; }
+
+    // The recipients the last successful sendMessage reached, empty if the
+    // response listed none
+    const std::vector<Receipt>& lastReceipts() const { return receipts; }
+
+    // Ask for the delivery state of one send record. False if the query got
+    // no answer about it, which says nothing about the record; a state the
+    // answer does not spell out is Pending. Call from the thread that sends.
+    bool queryDelivery(int64_t send_record_id, Delivery& state);
+
+    // While suspended, e.g. without a route to the internet, sendMessage
+    // returns false at once and a call in progress on another thread gives
+    // up within a second. wasInterrupted() tells such calls from failures.
+    void suspend(bool on) { suspended = on; }
+    bool wasInterrupted() const { return interrupted; }
+
+    // Resolve the endpoint and open a connection ahead of the first push, so
+    // the push itself does not pay for DNS, TCP and the TLS handshake
+    void warmUp();
+
+    // Refresh the DNS cache once due and warm up again if the addresses
+    // changed. Call from the thread that sends, no later than nextMaintenance().
+    void maintain();
+    std::chrono::steady_clock::time_point nextMaintenance() const { return dns_refresh_at; }
+
+    // Close every pooled connection, resolve the host again and warm up,
+    // after the local addresses changed. Call from the thread that sends.
+    void reconnect();
 
 private:
+    // One POST in flight on the multi handle
+    struct Attempt {
+        CURL* handle;
+        std::string response;
+        std::chrono::steady_clock::time_point started;
+        bool active;
+        CURLcode result;
+        long http_code;
+        bool sent; // Whether the transfer got past connecting, so the endpoint may have the request
+    };
+
+    static constexpr size_t kRttSamples = 64;
+
+    bool refreshDns();
+    void afterTransfer(CURL* handle);
+    void configureHandle(CURL* handle, const std::string& ca_file);
+    CURLcode perform(CURL* handle);
+    void startAttempt(Attempt& attempt, const std::string& url, const std::string& payload,
+                      struct curl_slist* headers, bool fresh_connection);
+    void finishAttempt(Attempt& attempt);
+    void recordRtt(std::chrono::steady_clock::duration rtt);
+    long rttPercentile(double p) const;
+
     std::string token;
-    std::string uid;
+    std::vector<std::string> recipient_sets; // Prebuilt "uids" and "topicIds" JSON members
+    PushTemplate summary_template;
+    PushTemplate code_summary_template;
+    PushTemplate content_template;
+    std::string endpoint;
+    std::string query_url;          // Send record query, on the endpoint's origin, without the ID
+    std::string session_file;
+    std::string host;               // Endpoint host, empty when it is an address literal
+    std::string origin;             // scheme://host:port/ used for warm-up requests
+    int port;
+    std::vector<std::string> addresses; // Addresses pinned with CURLOPT_RESOLVE
+    std::chrono::steady_clock::time_point dns_refresh_at;
+    struct curl_slist* resolve_list;
+    CURLM* multi;                   // Runs every transfer, so both handles share its connection pool
     CURL* curl;
+    CURL* hedge_curl;               // Hedged duplicates, nullptr while hedging is off
+    std::string secondary_endpoint;
+    std::string secondary_origin;
+    std::string ca_file;
+    long rtt_ms[kRttSamples];       // Recent request durations, a ring
+    size_t rtt_count;
+    std::vector<Receipt> receipts;
+    bool throttled;
+    bool interrupted;
+    std::atomic<bool> suspended;    // Set from other threads
 };
@@ -0,0 +1,199 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+// Ingest socket benchmark. Writes synthetic messages to the sms_forward
+// ingest socket in batches, one write per batch, resends those refused as
+// busy after the advertised delay, and reports how fast they were accepted.
+// Run it against sms_forward with wx_pusher_endpoint pointing at
+// tools/wxpusher_stub to measure the whole pipeline.
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string socket_path;
+    std::string source = "ingest_bench";
+    long count = 10000;
+    long batch = 100;
+    double otp_ratio = 0.5;
+    int timeout_s = 120;
+};
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " --socket PATH [options]\n"
+              << "  --count N        messages to ingest (default 10000)\n"
+              << "  --batch N        messages per write (default 100)\n"
+              << "  --otp-ratio F    fraction of verification code messages (default 0.5)\n"
+              << "  --source NAME    producer name shown in the push title (default ingest_bench)\n"
+              << "  --timeout S      give up after S seconds (default 120)" << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+
+        if (arg == "--socket") options.socket_path = value;
+        else if (arg == "--source") options.source = value;
+        else if (arg == "--count") options.count = std::max(1L, atol(value.c_str()));
+        else if (arg == "--batch") options.batch = std::max(1L, atol(value.c_str()));
+        else if (arg == "--otp-ratio") options.otp_ratio = atof(value.c_str());
+        else if (arg == "--timeout") options.timeout_s = atoi(value.c_str());
+        else return false;
+    }
+    return !options.socket_path.empty();
+}
+
+void appendUint32(std::string& buffer, uint32_t value) {
+    value = htonl(value);
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendMessage(std::string& buffer, uint32_t id, const std::string& source, const std::string& text) {
+    appendUint32(buffer, static_cast<uint32_t>(8 + source.size() + text.size()));
+    buffer += static_cast<char>(1);
+    buffer += static_cast<char>(0);
+    uint16_t source_length = htons(static_cast<uint16_t>(source.size()));
+    buffer.append(reinterpret_cast<const char*>(&source_length), sizeof(source_length));
+    appendUint32(buffer, id);
+    buffer += source;
+    buffer += text;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recvAll(int fd, char* data, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t n = recv(fd, data + received, size - received, 0);
+        if (n <= 0) return false;
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, options.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Cannot connect to " << options.socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::vector<uint32_t> pending;
+    for (long seq = options.count - 1; seq >= 0; seq--) pending.push_back(static_cast<uint32_t>(seq));
+
+    long accepted = 0, filtered = 0, busy = 0, invalid = 0, writes = 0;
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::seconds(options.timeout_s);
+    std::vector<uint32_t> refused;
+
+    while ((!pending.empty() || !refused.empty()) && Clock::now() < deadline) {
+        if (pending.empty()) {
+            // Resend refused messages oldest first
+            pending.assign(refused.rbegin(), refused.rend());
+            refused.clear();
+        }
+
+        std::string buffer;
+        std::vector<uint32_t> batch;
+        while (!pending.empty() && static_cast<long>(batch.size()) < options.batch) {
+            uint32_t seq = pending.back();
+            pending.pop_back();
+            std::string text = (seq * 2654435761u) % 1000 < options.otp_ratio * 1000
+                ? "Your verification code is " + std::to_string(100000 + seq % 900000) + " [seq " + std::to_string(seq) + "]"
+                : "Benchmark message body [seq " + std::to_string(seq) + "]";
+            appendMessage(buffer, seq, options.source, text);
+            batch.push_back(seq);
+        }
+        if (!sendAll(fd, buffer)) {
+            std::cerr << "Connection closed by sms_forward" << std::endl;
+            break;
+        }
+        writes++;
+
+        uint32_t retry_ms = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            char ack[16];
+            if (!recvAll(fd, ack, sizeof(ack))) {
+                std::cerr << "Connection closed by sms_forward" << std::endl;
+                return 2;
+            }
+            uint32_t id, retry;
+            memcpy(&id, ack + 8, 4);
+            memcpy(&retry, ack + 12, 4);
+            switch (ack[5]) {
+                case 0: accepted++; break;
+                case 1: filtered++; break;
+                case 2:
+                    busy++;
+                    refused.push_back(ntohl(id));
+                    retry_ms = std::max(retry_ms, ntohl(retry));
+                    break;
+                default: invalid++; break;
+            }
+        }
+        if (retry_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(retry_ms));
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    close(fd);
+
+    long unfinished = static_cast<long>(pending.size() + refused.size());
+    std::cout << "messages:    " << options.count << "\n"
+              << "accepted:    " << accepted << "\n"
+              << "filtered:    " << filtered << "\n"
+              << "busy acks:   " << busy << "\n"
+              << "invalid:     " << invalid << "\n"
+              << "unfinished:  " << unfinished << "\n"
+              << "writes:      " << writes << "\n"
+              << "elapsed:     " << elapsed << " s\n"
+              << "throughput:  " << (accepted + filtered) / elapsed << " msgs/s" << std::endl;
+    return unfinished == 0 && invalid == 0 ? 0 : 2;
+}
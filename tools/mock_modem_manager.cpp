@@ -0,0 +1,668 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+// Test-only stand-in for ModemManager. It implements the subset of
+// org.freedesktop.ModemManager1 that sms_forward uses (ObjectManager,
+// Modem.Messaging with Added/List/Delete/Create, Sms properties and Send) on
+// the session bus and injects received SMS at a configurable rate, so
+// SmsMonitor can be load-tested on a machine without modems. Sends are
+// serialised per modem like AT commands. See tools/run_mock_modem.sh.
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* kServiceName = "org.freedesktop.ModemManager1";
+const char* kManagerPath = "/org/freedesktop/ModemManager1";
+const char* kManagerInterface = "org.freedesktop.ModemManager1";
+const char* kModemInterface = "org.freedesktop.ModemManager1.Modem";
+const char* kMessagingInterface = "org.freedesktop.ModemManager1.Modem.Messaging";
+const char* kSmsInterface = "org.freedesktop.ModemManager1.Sms";
+
+// Values from ModemManager-enums.h
+const guint32 kSmsStateUnknown = 0;
+const guint32 kSmsStateReceived = 3;
+const guint32 kSmsStateSending = 4;
+const guint32 kSmsStateSent = 5;
+const guint32 kSmsPduTypeDeliver = 1;
+const guint32 kSmsPduTypeSubmit = 2;
+const guint32 kSmsStorageSm = 1;
+const guint32 kSmsStorageMe = 2;
+const gint32 kModemStateEnabled = 6;
+
+const char* kIntrospectionXml =
+    "<node>"
+    "  <interface name='org.freedesktop.DBus.ObjectManager'>"
+    "    <method name='GetManagedObjects'>"
+    "      <arg type='a{oa{sa{sv}}}' name='objects' direction='out'/>"
+    "    </method>"
+    "    <signal name='InterfacesAdded'>"
+    "      <arg type='o' name='object_path'/>"
+    "      <arg type='a{sa{sv}}' name='interfaces_and_properties'/>"
+    "    </signal>"
+    "    <signal name='InterfacesRemoved'>"
+    "      <arg type='o' name='object_path'/>"
+    "      <arg type='as' name='interfaces'/>"
+    "    </signal>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.ModemManager1'>"
+    "    <method name='ScanDevices'/>"
+    "    <method name='SetLogging'>"
+    "      <arg type='s' name='level' direction='in'/>"
+    "    </method>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.ModemManager1.Modem'>"
+    "    <property type='i' name='State' access='read'/>"
+    "    <property type='s' name='Manufacturer' access='read'/>"
+    "    <property type='s' name='Model' access='read'/>"
+    "    <property type='s' name='EquipmentIdentifier' access='read'/>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.ModemManager1.Modem.Messaging'>"
+    "    <method name='List'>"
+    "      <arg type='ao' name='result' direction='out'/>"
+    "    </method>"
+    "    <method name='Delete'>"
+    "      <arg type='o' name='path' direction='in'/>"
+    "    </method>"
+    "    <method name='Create'>"
+    "      <arg type='a{sv}' name='properties' direction='in'/>"
+    "      <arg type='o' name='path' direction='out'/>"
+    "    </method>"
+    "    <signal name='Added'>"
+    "      <arg type='o' name='path'/>"
+    "      <arg type='b' name='received'/>"
+    "    </signal>"
+    "    <signal name='Deleted'>"
+    "      <arg type='o' name='path'/>"
+    "    </signal>"
+    "    <property type='ao' name='Messages' access='read'/>"
+    "    <property type='au' name='SupportedStorages' access='read'/>"
+    "    <property type='u' name='DefaultStorage' access='read'/>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.ModemManager1.Sms'>"
+    "    <method name='Send'/>"
+    "    <method name='Store'>"
+    "      <arg type='u' name='storage' direction='in'/>"
+    "    </method>"
+    "    <property type='u' name='State' access='read'/>"
+    "    <property type='u' name='PduType' access='read'/>"
+    "    <property type='s' name='Number' access='read'/>"
+    "    <property type='s' name='Text' access='read'/>"
+    "    <property type='s' name='SMSC' access='read'/>"
+    "    <property type='s' name='Timestamp' access='read'/>"
+    "    <property type='u' name='Storage' access='read'/>"
+    "    <property type='i' name='Class' access='read'/>"
+    "    <property type='u' name='MessageReference' access='read'/>"
+    "    <property type='b' name='DeliveryReportRequest' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+struct Options {
+    int modems = 1;
+    double rate = 1.0;          // Injected SMS per second
+    long count = 10;            // Total SMS to inject, 0 for unlimited
+    double delayed_ratio = 0.0; // Fraction of SMS whose text arrives late
+    int text_delay_ms = 1500;
+    double otp_ratio = 0.5;     // Fraction of SMS that look like verification codes
+    std::string storage = "me"; // me, sm or both (duplicate ME+SM copies)
+    int send_latency_ms = 500;  // Time a modem spends on one Send
+    double send_failure_rate = 0.0;
+    std::string record_path;
+};
+
+struct MockSms {
+    std::string path;
+    int modem;
+    std::string number;
+    std::string text;
+    std::string pending_text; // Text published after the delay for delayed SMS
+    std::string timestamp;
+    guint32 storage;
+    guint32 state;
+    guint32 pdu_type;
+    guint registration;
+};
+
+struct MockModem {
+    std::string path;
+    std::vector<std::string> messages;
+    guint modem_registration;
+    guint messaging_registration;
+    gint64 busy_until = 0; // Monotonic time the modem finishes its queued sends
+};
+
+struct MockState {
+    Options options;
+    GDBusConnection* bus = nullptr;
+    GDBusNodeInfo* introspection = nullptr;
+    GMainLoop* loop = nullptr;
+    std::vector<MockModem> modems;
+    std::map<std::string, MockSms> sms;
+    unsigned next_sms_index = 0;
+    long injected = 0;
+    long deleted = 0;
+    long list_calls = 0;
+    long created = 0;
+    long sent = 0;
+    long send_failures = 0;
+    gint64 start_time = 0;
+    FILE* record = nullptr;
+};
+
+MockState g_state;
+
+GDBusInterfaceInfo* interfaceInfo(const char* name) {
+    return g_dbus_node_info_lookup_interface(g_state.introspection, name);
+}
+
+void record(const char* event, const std::string& path, const std::string& detail = "") {
+    if (!g_state.record) return;
+    // Wall clock so the timestamps line up with other processes' records
+    fprintf(g_state.record, "%s,%s,%lld,%s\n", event, path.c_str(),
+            static_cast<long long>(g_get_real_time()), detail.c_str());
+}
+
+GVariant* objectPathArray(const std::vector<std::string>& paths) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("ao"));
+    for (const auto& path : paths) {
+        g_variant_builder_add(&builder, "o", path.c_str());
+    }
+    return g_variant_builder_end(&builder);
+}
+
+GVariant* modemProperty(const MockModem& modem, const char* interface_name, const char* name) {
+    if (strcmp(interface_name, kModemInterface) == 0) {
+        if (strcmp(name, "State") == 0) return g_variant_new_int32(kModemStateEnabled);
+        if (strcmp(name, "Manufacturer") == 0) return g_variant_new_string("sms_forward");
+        if (strcmp(name, "Model") == 0) return g_variant_new_string("Mock Modem");
+        if (strcmp(name, "EquipmentIdentifier") == 0) return g_variant_new_string(modem.path.c_str());
+    } else if (strcmp(interface_name, kMessagingInterface) == 0) {
+        if (strcmp(name, "Messages") == 0) return objectPathArray(modem.messages);
+        if (strcmp(name, "SupportedStorages") == 0) return g_variant_new_parsed("[@u 1, @u 2]");
+        if (strcmp(name, "DefaultStorage") == 0) return g_variant_new_uint32(kSmsStorageMe);
+    }
+    return nullptr;
+}
+
+GVariant* smsProperty(const MockSms& sms, const char* name) {
+    if (strcmp(name, "State") == 0) return g_variant_new_uint32(sms.state);
+    if (strcmp(name, "PduType") == 0) return g_variant_new_uint32(sms.pdu_type);
+    if (strcmp(name, "Number") == 0) return g_variant_new_string(sms.number.c_str());
+    if (strcmp(name, "Text") == 0) return g_variant_new_string(sms.text.c_str());
+    if (strcmp(name, "SMSC") == 0) return g_variant_new_string("+8613800000000");
+    if (strcmp(name, "Timestamp") == 0) return g_variant_new_string(sms.timestamp.c_str());
+    if (strcmp(name, "Storage") == 0) return g_variant_new_uint32(sms.storage);
+    if (strcmp(name, "Class") == 0) return g_variant_new_int32(-1);
+    if (strcmp(name, "MessageReference") == 0) return g_variant_new_uint32(0);
+    if (strcmp(name, "DeliveryReportRequest") == 0) return g_variant_new_boolean(FALSE);
+    return nullptr;
+}
+
+GVariant* interfaceProperties(const MockModem& modem, const char* interface_name) {
+    GDBusInterfaceInfo* info = interfaceInfo(interface_name);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    for (int i = 0; info->properties && info->properties[i]; i++) {
+        GVariant* value = modemProperty(modem, interface_name, info->properties[i]->name);
+        if (value) {
+            g_variant_builder_add(&builder, "{sv}", info->properties[i]->name, value);
+        }
+    }
+    return g_variant_builder_end(&builder);
+}
+
+void emitPropertyChanged(const std::string& path, const char* interface_name, const char* name, GVariant* value) {
+    GVariantBuilder changed;
+    g_variant_builder_init(&changed, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&changed, "{sv}", name, value);
+    g_dbus_connection_emit_signal(g_state.bus, nullptr, path.c_str(),
+                                  "org.freedesktop.DBus.Properties", "PropertiesChanged",
+                                  g_variant_new("(sa{sv}as)", interface_name, &changed, nullptr),
+                                  nullptr);
+}
+
+std::string exportSms(int modem_index, const std::string& number, const std::string& text,
+                      const std::string& timestamp, guint32 storage, bool delayed);
+
+// --- Method and property handlers ---------------------------------------
+
+void handleManagerCall(GDBusConnection*, const gchar*, const gchar*, const gchar* interface_name,
+                       const gchar* method_name, GVariant*, GDBusMethodInvocation* invocation, gpointer) {
+    if (strcmp(method_name, "GetManagedObjects") == 0) {
+        GVariantBuilder objects;
+        g_variant_builder_init(&objects, G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+        for (const auto& modem : g_state.modems) {
+            GVariantBuilder interfaces;
+            g_variant_builder_init(&interfaces, G_VARIANT_TYPE("a{sa{sv}}"));
+            g_variant_builder_add(&interfaces, "{s@a{sv}}", kModemInterface,
+                                  interfaceProperties(modem, kModemInterface));
+            g_variant_builder_add(&interfaces, "{s@a{sv}}", kMessagingInterface,
+                                  interfaceProperties(modem, kMessagingInterface));
+            g_variant_builder_add(&objects, "{o@a{sa{sv}}}", modem.path.c_str(),
+                                  g_variant_builder_end(&interfaces));
+        }
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a{oa{sa{sv}}})",
+                                              g_variant_builder_end(&objects)));
+        return;
+    }
+
+    // ScanDevices and SetLogging are accepted and ignored
+    (void)interface_name;
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+}
+
+MockModem* findModem(const gchar* object_path) {
+    for (auto& modem : g_state.modems) {
+        if (modem.path == object_path) return &modem;
+    }
+    return nullptr;
+}
+
+void deleteSms(MockModem& modem, const std::string& path) {
+    auto it = g_state.sms.find(path);
+    if (it == g_state.sms.end()) return;
+
+    g_dbus_connection_unregister_object(g_state.bus, it->second.registration);
+    g_state.sms.erase(it);
+
+    for (auto m = modem.messages.begin(); m != modem.messages.end(); ++m) {
+        if (*m == path) {
+            modem.messages.erase(m);
+            break;
+        }
+    }
+
+    g_dbus_connection_emit_signal(g_state.bus, nullptr, modem.path.c_str(), kMessagingInterface,
+                                  "Deleted", g_variant_new("(o)", path.c_str()), nullptr);
+    emitPropertyChanged(modem.path, kMessagingInterface, "Messages", objectPathArray(modem.messages));
+    g_state.deleted++;
+    record("delete", path);
+}
+
+void handleModemCall(GDBusConnection*, const gchar*, const gchar* object_path, const gchar*,
+                     const gchar* method_name, GVariant* parameters, GDBusMethodInvocation* invocation, gpointer) {
+    MockModem* modem = findModem(object_path);
+    if (!modem) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+            "org.freedesktop.ModemManager1.Error.Core.NotFound", "No such modem");
+        return;
+    }
+
+    if (strcmp(method_name, "List") == 0) {
+        g_state.list_calls++;
+        g_dbus_method_invocation_return_value(invocation,
+            g_variant_new("(@ao)", objectPathArray(modem->messages)));
+    } else if (strcmp(method_name, "Delete") == 0) {
+        const gchar* path = nullptr;
+        g_variant_get(parameters, "(&o)", &path);
+        if (!g_state.sms.count(path)) {
+            g_dbus_method_invocation_return_dbus_error(invocation,
+                "org.freedesktop.ModemManager1.Error.Core.NotFound", "No SMS found with this path");
+            return;
+        }
+        deleteSms(*modem, path);
+        g_dbus_method_invocation_return_value(invocation, nullptr);
+    } else if (strcmp(method_name, "Create") == 0) {
+        GVariant* properties = g_variant_get_child_value(parameters, 0);
+        const gchar* number = nullptr;
+        const gchar* text = nullptr;
+        g_variant_lookup(properties, "number", "&s", &number);
+        g_variant_lookup(properties, "text", "&s", &text);
+        if (!number || !*number || !text) {
+            g_variant_unref(properties);
+            g_dbus_method_invocation_return_dbus_error(invocation,
+                "org.freedesktop.ModemManager1.Error.Core.InvalidArgs", "Missing number or text");
+            return;
+        }
+
+        int modem_index = static_cast<int>(modem - g_state.modems.data());
+        std::string path = exportSms(modem_index, number, text, "", kSmsStorageMe, false);
+        g_variant_unref(properties);
+        if (path.empty()) {
+            g_dbus_method_invocation_return_dbus_error(invocation,
+                "org.freedesktop.ModemManager1.Error.Core.Failed", "Cannot export SMS");
+            return;
+        }
+        MockSms& sms = g_state.sms[path];
+        sms.state = kSmsStateUnknown;
+        sms.pdu_type = kSmsPduTypeSubmit;
+        g_state.created++;
+        record("create", path, number);
+
+        emitPropertyChanged(modem->path, kMessagingInterface, "Messages", objectPathArray(modem->messages));
+        g_dbus_connection_emit_signal(g_state.bus, nullptr, modem->path.c_str(), kMessagingInterface,
+                                      "Added", g_variant_new("(ob)", path.c_str(), FALSE), nullptr);
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(o)", path.c_str()));
+    } else {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+            "org.freedesktop.ModemManager1.Error.Core.Unsupported", "Not implemented by the mock");
+    }
+}
+
+GVariant* getModemProperty(GDBusConnection*, const gchar*, const gchar* object_path, const gchar* interface_name,
+                           const gchar* property_name, GError** error, gpointer) {
+    MockModem* modem = findModem(object_path);
+    GVariant* value = modem ? modemProperty(*modem, interface_name, property_name) : nullptr;
+    if (!value) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property %s", property_name);
+    }
+    return value;
+}
+
+struct PendingSend {
+    std::string path;
+    GDBusMethodInvocation* invocation;
+};
+
+gboolean completeSend(gpointer user_data) {
+    auto* pending = static_cast<PendingSend*>(user_data);
+    auto it = g_state.sms.find(pending->path);
+    if (it == g_state.sms.end()) {
+        g_dbus_method_invocation_return_dbus_error(pending->invocation,
+            "org.freedesktop.ModemManager1.Error.Core.NotFound", "SMS deleted while sending");
+    } else if (g_random_double() < g_state.options.send_failure_rate) {
+        g_state.send_failures++;
+        it->second.state = kSmsStateUnknown;
+        emitPropertyChanged(pending->path, kSmsInterface, "State", g_variant_new_uint32(kSmsStateUnknown));
+        record("send_failed", pending->path, it->second.number);
+        g_dbus_method_invocation_return_dbus_error(pending->invocation,
+            "org.freedesktop.ModemManager1.Error.Core.Failed", "Injected send failure");
+    } else {
+        g_state.sent++;
+        it->second.state = kSmsStateSent;
+        emitPropertyChanged(pending->path, kSmsInterface, "State", g_variant_new_uint32(kSmsStateSent));
+        record("send", pending->path, it->second.number);
+        g_dbus_method_invocation_return_value(pending->invocation, nullptr);
+    }
+    delete pending;
+    return G_SOURCE_REMOVE;
+}
+
+void handleSmsCall(GDBusConnection*, const gchar*, const gchar* object_path, const gchar*,
+                   const gchar* method_name, GVariant*, GDBusMethodInvocation* invocation, gpointer) {
+    auto it = g_state.sms.find(object_path);
+    if (strcmp(method_name, "Send") != 0 || it == g_state.sms.end() || it->second.pdu_type != kSmsPduTypeSubmit) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+            "org.freedesktop.ModemManager1.Error.Core.Unsupported", "Received messages cannot be sent or stored");
+        return;
+    }
+
+    // The modem works through sends one at a time
+    MockModem& modem = g_state.modems[it->second.modem];
+    gint64 now = g_get_monotonic_time();
+    modem.busy_until = std::max(now, modem.busy_until) + g_state.options.send_latency_ms * 1000LL;
+
+    it->second.state = kSmsStateSending;
+    emitPropertyChanged(object_path, kSmsInterface, "State", g_variant_new_uint32(kSmsStateSending));
+    g_timeout_add(static_cast<guint>((modem.busy_until - now) / 1000), completeSend,
+                  new PendingSend{object_path, invocation});
+}
+
+GVariant* getSmsProperty(GDBusConnection*, const gchar*, const gchar* object_path, const gchar*,
+                         const gchar* property_name, GError** error, gpointer) {
+    auto it = g_state.sms.find(object_path);
+    GVariant* value = it != g_state.sms.end() ? smsProperty(it->second, property_name) : nullptr;
+    if (!value) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property %s", property_name);
+    }
+    return value;
+}
+
+const GDBusInterfaceVTable kManagerVTable = { handleManagerCall, nullptr, nullptr, { nullptr } };
+const GDBusInterfaceVTable kModemVTable = { handleModemCall, getModemProperty, nullptr, { nullptr } };
+const GDBusInterfaceVTable kSmsVTable = { handleSmsCall, getSmsProperty, nullptr, { nullptr } };
+
+// --- Injection --------------------------------------------------------------
+
+std::string nowTimestamp() {
+    GDateTime* now = g_date_time_new_now_local();
+    gchar* formatted = g_date_time_format(now, "%Y-%m-%dT%H:%M:%S%:z");
+    std::string result = formatted;
+    g_free(formatted);
+    g_date_time_unref(now);
+    return result;
+}
+
+gboolean publishDelayedText(gpointer user_data) {
+    std::string* path = static_cast<std::string*>(user_data);
+    auto it = g_state.sms.find(*path);
+    if (it != g_state.sms.end()) {
+        it->second.text = it->second.pending_text;
+        emitPropertyChanged(*path, kSmsInterface, "Text", g_variant_new_string(it->second.text.c_str()));
+        record("text", *path);
+    }
+    delete path;
+    return G_SOURCE_REMOVE;
+}
+
+std::string exportSms(int modem_index, const std::string& number, const std::string& text,
+                      const std::string& timestamp, guint32 storage, bool delayed) {
+    MockSms sms;
+    sms.path = std::string(kManagerPath) + "/SMS/" + std::to_string(g_state.next_sms_index++);
+    sms.modem = modem_index;
+    sms.number = number;
+    sms.text = delayed ? "" : text;
+    sms.pending_text = text;
+    sms.timestamp = timestamp;
+    sms.storage = storage;
+    sms.state = kSmsStateReceived;
+    sms.pdu_type = kSmsPduTypeDeliver;
+
+    GError* error = nullptr;
+    sms.registration = g_dbus_connection_register_object(g_state.bus, sms.path.c_str(),
+                                                         interfaceInfo(kSmsInterface), &kSmsVTable,
+                                                         nullptr, nullptr, &error);
+    if (error) {
+        std::cerr << "Failed to export " << sms.path << ": " << error->message << std::endl;
+        g_error_free(error);
+        return "";
+    }
+
+    std::string path = sms.path;
+    g_state.sms[path] = sms;
+    g_state.modems[modem_index].messages.push_back(path);
+
+    if (delayed) {
+        g_timeout_add(g_state.options.text_delay_ms, publishDelayedText, new std::string(path));
+    }
+    return path;
+}
+
+void injectOne() {
+    long seq = g_state.injected++;
+    int modem_index = static_cast<int>(seq % g_state.modems.size());
+    MockModem& modem = g_state.modems[modem_index];
+
+    bool otp = g_random_double() < g_state.options.otp_ratio;
+    bool delayed = g_random_double() < g_state.options.delayed_ratio;
+    std::string number = "+86138" + std::to_string(10000000 + seq % 1000);
+    // The sequence number lets downstream stubs correlate arrivals with injections
+    std::string text = otp
+        ? "Your verification code is " + std::to_string(100000 + g_random_int_range(0, 900000)) + " [seq " + std::to_string(seq) + "]"
+        : "Mock message body for load testing [seq " + std::to_string(seq) + "]";
+    std::string timestamp = nowTimestamp();
+
+    // ModemManager reports some SMS in both ME and SM storage; emulate that on request
+    const std::string& storage = g_state.options.storage;
+    std::vector<std::string> added;
+    if (storage == "me" || storage == "both") {
+        added.push_back(exportSms(modem_index, number, text, timestamp, kSmsStorageMe, delayed));
+    }
+    if (storage == "sm" || storage == "both") {
+        added.push_back(exportSms(modem_index, number, text, timestamp, kSmsStorageSm, delayed));
+    }
+
+    emitPropertyChanged(modem.path, kMessagingInterface, "Messages", objectPathArray(modem.messages));
+    for (const auto& path : added) {
+        if (path.empty()) continue;
+        record("inject", path, std::to_string(seq));
+        g_dbus_connection_emit_signal(g_state.bus, nullptr, modem.path.c_str(), kMessagingInterface,
+                                      "Added", g_variant_new("(ob)", path.c_str(), TRUE), nullptr);
+    }
+}
+
+gboolean injectTick(gpointer) {
+    const Options& options = g_state.options;
+    double elapsed = (g_get_monotonic_time() - g_state.start_time) / 1e6;
+    long due = static_cast<long>(elapsed * options.rate) + 1;
+    if (options.count > 0 && due > options.count) {
+        due = options.count;
+    }
+
+    while (g_state.injected < due) {
+        injectOne();
+    }
+
+    if (options.count > 0 && g_state.injected >= options.count) {
+        std::cerr << "Injected " << g_state.injected << " SMS" << std::endl;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean reportStats(gpointer) {
+    std::cerr << "injected=" << g_state.injected << " deleted=" << g_state.deleted
+              << " stored=" << g_state.sms.size() << " list_calls=" << g_state.list_calls
+              << " created=" << g_state.created << " sent=" << g_state.sent
+              << " send_failures=" << g_state.send_failures << std::endl;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean onTerminate(gpointer) {
+    g_main_loop_quit(g_state.loop);
+    return G_SOURCE_REMOVE;
+}
+
+void onNameAcquired(GDBusConnection*, const gchar* name, gpointer) {
+    std::cerr << "Acquired " << name << ", injecting at " << g_state.options.rate << " SMS/s" << std::endl;
+    g_state.start_time = g_get_monotonic_time();
+
+    // Tick often enough to keep up with the configured rate
+    guint interval_ms = g_state.options.rate >= 1000.0 ? 1 : static_cast<guint>(1000.0 / g_state.options.rate);
+    g_timeout_add(interval_ms > 0 ? interval_ms : 1, injectTick, nullptr);
+}
+
+void onNameLost(GDBusConnection*, const gchar* name, gpointer) {
+    std::cerr << "Could not own " << name << " (is another ModemManager on this bus?)" << std::endl;
+    g_main_loop_quit(g_state.loop);
+}
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --modems N            number of mock modems (default 1)\n"
+              << "  --rate R              SMS injected per second (default 1)\n"
+              << "  --count N             SMS to inject, 0 for unlimited (default 10)\n"
+              << "  --delayed-ratio F     fraction of SMS whose text arrives late (default 0)\n"
+              << "  --text-delay-ms MS    delay before late text is published (default 1500)\n"
+              << "  --otp-ratio F         fraction of SMS containing a verification code (default 0.5)\n"
+              << "  --storage me|sm|both  storage the SMS are reported in (default me)\n"
+              << "  --send-latency-ms MS  time each modem spends on one Send (default 500)\n"
+              << "  --send-failure-rate F fraction of Send calls that fail (default 0)\n"
+              << "  --record FILE         append inject/text/delete events as CSV\n"
+              << "The service is published on the session bus (DBUS_SESSION_BUS_ADDRESS)." << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+
+        if (arg == "--modems") options.modems = std::max(1, atoi(value.c_str()));
+        else if (arg == "--rate") options.rate = std::max(0.001, atof(value.c_str()));
+        else if (arg == "--count") options.count = atol(value.c_str());
+        else if (arg == "--delayed-ratio") options.delayed_ratio = atof(value.c_str());
+        else if (arg == "--text-delay-ms") options.text_delay_ms = atoi(value.c_str());
+        else if (arg == "--otp-ratio") options.otp_ratio = atof(value.c_str());
+        else if (arg == "--storage") options.storage = value;
+        else if (arg == "--send-latency-ms") options.send_latency_ms = std::max(0, atoi(value.c_str()));
+        else if (arg == "--send-failure-rate") options.send_failure_rate = atof(value.c_str());
+        else if (arg == "--record") options.record_path = value;
+        else return false;
+    }
+    return options.storage == "me" || options.storage == "sm" || options.storage == "both";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv, g_state.options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!g_state.options.record_path.empty()) {
+        g_state.record = fopen(g_state.options.record_path.c_str(), "a");
+        if (!g_state.record) {
+            std::cerr << "Cannot open " << g_state.options.record_path << std::endl;
+            return 1;
+        }
+    }
+
+    GError* error = nullptr;
+    g_state.introspection = g_dbus_node_info_new_for_xml(kIntrospectionXml, &error);
+    if (error) {
+        std::cerr << "Bad introspection data: " << error->message << std::endl;
+        return 1;
+    }
+
+    g_state.bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+    if (error) {
+        std::cerr << "Failed to connect to the session bus: " << error->message << std::endl;
+        return 1;
+    }
+
+    g_dbus_connection_register_object(g_state.bus, kManagerPath,
+                                      interfaceInfo("org.freedesktop.DBus.ObjectManager"),
+                                      &kManagerVTable, nullptr, nullptr, nullptr);
+    g_dbus_connection_register_object(g_state.bus, kManagerPath, interfaceInfo(kManagerInterface),
+                                      &kManagerVTable, nullptr, nullptr, nullptr);
+
+    for (int i = 0; i < g_state.options.modems; i++) {
+        MockModem modem;
+        modem.path = std::string(kManagerPath) + "/Modem/" + std::to_string(i);
+        modem.modem_registration = g_dbus_connection_register_object(
+            g_state.bus, modem.path.c_str(), interfaceInfo(kModemInterface), &kModemVTable, nullptr, nullptr, nullptr);
+        modem.messaging_registration = g_dbus_connection_register_object(
+            g_state.bus, modem.path.c_str(), interfaceInfo(kMessagingInterface), &kModemVTable, nullptr, nullptr, nullptr);
+        g_state.modems.push_back(modem);
+    }
+
+    g_state.loop = g_main_loop_new(nullptr, FALSE);
+    g_bus_own_name_on_connection(g_state.bus, kServiceName, G_BUS_NAME_OWNER_FLAGS_NONE,
+                                 onNameAcquired, onNameLost, nullptr, nullptr);
+    g_timeout_add_seconds(1, reportStats, nullptr);
+    g_unix_signal_add(SIGINT, onTerminate, nullptr);
+    g_unix_signal_add(SIGTERM, onTerminate, nullptr);
+
+    g_main_loop_run(g_state.loop);
+
+    reportStats(nullptr);
+    if (g_state.record) fclose(g_state.record);
+    g_main_loop_unref(g_state.loop);
+    g_object_unref(g_state.bus);
+    g_dbus_node_info_unref(g_state.introspection);
+    return 0;
+}
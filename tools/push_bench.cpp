@@ -0,0 +1,200 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+// End-to-end push benchmark. Feeds synthetic SMS through the real
+// SmsForwarder callback, scheduler and WxPusher client, normally against
+// tools/wxpusher_stub, and reports throughput and latency percentiles
+// measured from callback entry to push completion.
+
+#include "config.hpp"
+#include "logger.hpp"
+#include "push_scheduler.hpp"
+#include "sms_forwarder.hpp"
+#include "sms_monitor.hpp"
+#include "wx_pusher.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string config_path;
+    std::string log_path = "/tmp/push_bench.log";
+    long count = 1000;
+    double rate = 0.0; // SMS per second, 0 submits everything at once
+    double otp_ratio = 0.5;
+    int timeout_s = 120;
+};
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " --config FILE [options]\n"
+              << "  --count N        synthetic SMS to push (default 1000)\n"
+              << "  --rate R         SMS per second, 0 for all at once (default 0)\n"
+              << "  --otp-ratio F    fraction of verification code SMS (default 0.5)\n"
+              << "  --timeout S      give up waiting after S seconds (default 120)\n"
+              << "  --log FILE       sms_forward log file (default /tmp/push_bench.log)\n"
+              << "Set wx_pusher_endpoint in the config to the stub, and raise push_rate_per_minute\n"
+              << "and push_burst unless the rate limiter itself is being measured. Raise or zero\n"
+              << "max_inflight_sms and max_queued_bytes unless load shedding is being measured." << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+
+        if (arg == "--config") options.config_path = value;
+        else if (arg == "--log") options.log_path = value;
+        else if (arg == "--count") options.count = std::max(1L, atol(value.c_str()));
+        else if (arg == "--rate") options.rate = atof(value.c_str());
+        else if (arg == "--otp-ratio") options.otp_ratio = atof(value.c_str());
+        else if (arg == "--timeout") options.timeout_s = atoi(value.c_str());
+        else return false;
+    }
+    return !options.config_path.empty();
+}
+
+double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!Logger::getInstance().init(options.log_path)) {
+        std::cerr << "Failed to open log " << options.log_path << std::endl;
+        return 1;
+    }
+    if (!Config::getInstance().load(options.config_path)) {
+        std::cerr << "Failed to load config " << options.config_path << std::endl;
+        return 1;
+    }
+
+    WxPusher pusher(
+        Config::getInstance().getWxPusherToken(),
+        Config::getInstance().getWxPusherRecipients(),
+        Config::getInstance().getWxPusherEndpoint(),
+        Config::getInstance().getWxPusherCaFile(),
+        Config::getInstance().getTlsSessionFile()
+    );
+    pusher.setTemplates(
+        Config::getInstance().getPushSummaryTemplate(),
+        Config::getInstance().getPushCodeSummaryTemplate(),
+        Config::getInstance().getPushContentTemplate()
+    );
+    if (Config::getInstance().getPushHedging()) {
+        pusher.enableHedging(Config::getInstance().getWxPusherSecondaryEndpoint());
+    }
+
+    // The monitor is never initialised; the forwarder only needs it for
+    // bookkeeping and deletion, which the benchmark config should disable
+    SmsMonitor monitor;
+    PushScheduler scheduler(
+        pusher,
+        Config::getInstance().getPushRatePerMinute(),
+        Config::getInstance().getPushBurst()
+    );
+    SmsForwarder forwarder(scheduler, monitor);
+
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    std::map<std::string, Clock::time_point> submitted;
+    std::vector<double> latencies_ms;
+    long failures = 0;
+
+    forwarder.setDeliveryHook([&](const std::string& sms_path, bool success) {
+        auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = submitted.find(sms_path);
+        if (it == submitted.end()) return;
+        if (success) {
+            latencies_ms.push_back(std::chrono::duration<double, std::milli>(now - it->second).count());
+        } else {
+            failures++;
+        }
+        submitted.erase(it);
+        done_cv.notify_one();
+    });
+
+    scheduler.start();
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    auto start = Clock::now();
+
+    for (long seq = 0; seq < options.count; seq++) {
+        if (options.rate > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(seq / options.rate)));
+        }
+
+        std::string path = "/bench/SMS/" + std::to_string(seq);
+        std::string sender = "+86138" + std::to_string(10000000 + seq % 1000);
+        std::string text = roll(rng) < options.otp_ratio
+            ? "Your verification code is " + std::to_string(100000 + seq % 900000) + " [seq " + std::to_string(seq) + "]"
+            : "Benchmark message body [seq " + std::to_string(seq) + "]";
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            submitted[path] = Clock::now();
+        }
+        SmsRecord record(std::make_shared<SmsArena>(256), path, "/bench/Modem/0");
+        record.number = record.keep(sender);
+        record.text = record.keep(text);
+        record.state = MM_SMS_STATE_RECEIVED;
+        record.storage = MM_SMS_STORAGE_ME;
+        forwarder.onSms(std::move(record));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait_for(lock, std::chrono::seconds(options.timeout_s), [&] { return submitted.empty(); });
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    scheduler.stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    std::cout << "messages:   " << options.count << "\n"
+              << "delivered:  " << latencies_ms.size() << "\n"
+              << "failed:     " << failures << "\n"
+              << "unfinished: " << submitted.size() << "\n"
+              << "elapsed:    " << elapsed << " s\n"
+              << "throughput: " << latencies_ms.size() / elapsed << " msgs/s\n"
+              << "latency p50: " << percentile(latencies_ms, 0.50) << " ms\n"
+              << "latency p90: " << percentile(latencies_ms, 0.90) << " ms\n"
+              << "latency p99: " << percentile(latencies_ms, 0.99) << " ms\n"
+              << "latency max: " << (latencies_ms.empty() ? 0.0 : latencies_ms.back()) << " ms" << std::endl;
+    return submitted.empty() && failures == 0 ? 0 : 2;
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Run sms_forward against the mock ModemManager on a private session bus.
+#
+# Usage: tools/run_mock_modem.sh <build-dir> [mock_modem_manager options]
+# Example: tools/run_mock_modem.sh build --rate 50 --count 1000 --delayed-ratio 0.1
+#
+# Everything (bus, config, logs, metrics, event record) lives in a temporary
+# directory that is printed at the end. Set WXPUSHER_ENDPOINT (for example
+# http://127.0.0.1:8088/api/send/message with tools/wxpusher_stub running) to
+# keep pushes off the real WxPusher service. EXTRA_CONFIG adds key=value
+# settings separated by spaces and SMS_FORWARD_ARGS adds command line options,
+# e.g. to run several instances as a fleet.
+
+set -e
+
+BUILD_DIR=${1:?usage: $0 <build-dir> [mock options]}
+shift
+
+WORK_DIR=$(mktemp -d /tmp/sms_forward_mock.XXXXXX)
+
+dbus-daemon --session --fork --nopidfile \
+    --address="unix:path=$WORK_DIR/bus" \
+    --print-pid=3 3>"$WORK_DIR/dbus.pid"
+DBUS_ADDRESS="unix:path=$WORK_DIR/bus"
+
+cleanup() {
+    [ -n "$FORWARD_PID" ] && kill "$FORWARD_PID" 2>/dev/null || true
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null || true
+    kill "$(cat "$WORK_DIR/dbus.pid")" 2>/dev/null || true
+    echo "Results in $WORK_DIR (mock.csv, sms_forward.log, sms_forward.metrics)"
+}
+trap cleanup EXIT INT TERM
+
+cat > "$WORK_DIR/sms_forward.conf" <<CONF
+wx_pusher_token=AT_mock
+wx_pusher_uid=UID_mock
+forward_existing_sms=false
+debug_mode=false
+delete_after_forwarding=true
+dbus_address=$DBUS_ADDRESS
+metrics_file=$WORK_DIR/sms_forward.metrics
+send_socket=$WORK_DIR/send.sock
+send_queue_limit=0
+aggregator_spool_file=$WORK_DIR/aggregator_spool
+CONF
+if [ -n "$WXPUSHER_ENDPOINT" ]; then
+    echo "wx_pusher_endpoint=$WXPUSHER_ENDPOINT" >> "$WORK_DIR/sms_forward.conf"
+fi
+for setting in $EXTRA_CONFIG; do
+    echo "$setting" >> "$WORK_DIR/sms_forward.conf"
+done
+
+# Start the mock first so ModemManager is on the bus when sms_forward starts
+DBUS_SESSION_BUS_ADDRESS="$DBUS_ADDRESS" \
+    "$BUILD_DIR/mock_modem_manager" --record "$WORK_DIR/mock.csv" "$@" &
+MOCK_PID=$!
+sleep 1
+
+"$BUILD_DIR/sms_forward" --config "$WORK_DIR/sms_forward.conf" --log "$WORK_DIR/sms_forward.log" $SMS_FORWARD_ARGS &
+FORWARD_PID=$!
+
+wait "$MOCK_PID"
@@ -0,0 +1,171 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+
+// Outbound SMS benchmark. Submits synthetic SMS to the sms_forward send
+// socket, normally with tools/mock_modem_manager standing in for the modems,
+// and reports throughput and the send latency sms_forward measured for each
+// SMS, from submission to the modem confirming the send.
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string socket_path;
+    std::string number = "+8613800000000";
+    long count = 100;
+    double rate = 0.0; // SMS per second, 0 submits everything at once
+    int timeout_s = 300;
+};
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " --socket PATH [options]\n"
+              << "  --count N        SMS to send (default 100)\n"
+              << "  --rate R         SMS per second, 0 for all at once (default 0)\n"
+              << "  --number N       destination number (default +8613800000000)\n"
+              << "  --timeout S      give up waiting after S seconds (default 300)\n"
+              << "Raise send_queue_limit in the sms_forward config above --count unless\n"
+              << "queue rejection itself is being measured." << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+
+        if (arg == "--socket") options.socket_path = value;
+        else if (arg == "--number") options.number = value;
+        else if (arg == "--count") options.count = std::max(1L, atol(value.c_str()));
+        else if (arg == "--rate") options.rate = atof(value.c_str());
+        else if (arg == "--timeout") options.timeout_s = atoi(value.c_str());
+        else return false;
+    }
+    return !options.socket_path.empty();
+}
+
+double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, options.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Cannot connect to " << options.socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // Replies are read on this thread while the writer paces submissions
+    auto start = Clock::now();
+    std::thread writer([&]() {
+        for (long seq = 0; seq < options.count; seq++) {
+            if (options.rate > 0) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(seq / options.rate)));
+            }
+            if (!sendAll(fd, "SEND " + options.number + " Benchmark SMS [seq " + std::to_string(seq) + "]\n")) {
+                break;
+            }
+        }
+    });
+
+    struct timeval timeout{options.timeout_s, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<double> latencies_ms;
+    long queued = 0, busy = 0, failed = 0, errors = 0;
+    std::string buffer;
+    char chunk[4096];
+    while (latencies_ms.size() + failed + busy + errors < static_cast<size_t>(options.count)) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) break;
+        buffer.append(chunk, static_cast<size_t>(n));
+
+        size_t end;
+        while ((end = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, end);
+            buffer.erase(0, end + 1);
+
+            if (line.compare(0, 7, "QUEUED ") == 0) {
+                queued++;
+            } else if (line.compare(0, 5, "SENT ") == 0) {
+                latencies_ms.push_back(atof(line.c_str() + line.rfind(' ') + 1));
+            } else if (line.compare(0, 7, "FAILED ") == 0) {
+                failed++;
+            } else if (line == "BUSY") {
+                busy++;
+            } else {
+                errors++;
+                std::cerr << line << std::endl;
+            }
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    shutdown(fd, SHUT_RDWR);
+    writer.join();
+    close(fd);
+
+    long unfinished = queued - static_cast<long>(latencies_ms.size()) - failed;
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    std::cout << "messages:   " << options.count << "\n"
+              << "sent:       " << latencies_ms.size() << "\n"
+              << "failed:     " << failed << "\n"
+              << "busy:       " << busy << "\n"
+              << "errors:     " << errors << "\n"
+              << "unfinished: " << unfinished << "\n"
+              << "elapsed:    " << elapsed << " s\n"
+              << "throughput: " << latencies_ms.size() / elapsed << " sms/s\n"
+              << "latency p50: " << percentile(latencies_ms, 0.50) << " ms\n"
+              << "latency p90: " << percentile(latencies_ms, 0.90) << " ms\n"
+              << "latency p99: " << percentile(latencies_ms, 0.99) << " ms\n"
+              << "latency max: " << (latencies_ms.empty() ? 0.0 : latencies_ms.back()) << " ms" << std::endl;
+    return unfinished == 0 && failed == 0 && busy == 0 && errors == 0 ? 0 : 2;
+}
@@ -0,0 +1,486 @@
+/*
+ * SMS Forward - A utility to forward SMS messages to WxPusher
+ *
+ * Copyright (c) 2025 J.Kev.Fen
+ * All rights reserved.
+ *
+ * This software is proprietary and confidential.
+ * Use is subject to license terms.
+ *
+ * You may NOT modify, adapt, or create derivative works based on this software.
+ * You may NOT use this software for commercial purposes.
+ * You may NOT distribute, sublicense, or make this software available to any third party.
+ */
+
+// Test-only local stand-in for the WxPusher send API. It accepts the JSON
+// payload sms_forward posts, validates it, and answers like WxPusher after
+// an optional delay. Errors and throttling responses can be injected at
+// configurable rates, and every request is recorded with its arrival time.
+// Requests repeating an Idempotency-Key get the first answer again, like a
+// deduplicating relay would. Send records reach their phone after a delay,
+// or fail at a configurable rate, as reported by the send record query API.
+// Plain HTTP only; point wx_pusher_endpoint at http://127.0.0.1:<port>/api/send/message.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int port = 8088;
+    int latency_ms = 0;
+    int jitter_ms = 0;
+    double error_rate = 0.0;
+    double throttle_rate = 0.0;
+    double stall_rate = 0.0;
+    int stall_ms = 5000;
+    double undelivered_rate = 0.0;
+    int delivery_ms = 1000;
+    std::string record_path;
+};
+
+Options g_options;
+std::mutex g_record_mutex;
+FILE* g_record = nullptr;
+std::atomic<long> g_requests(0);
+std::atomic<long> g_invalid(0);
+std::atomic<long> g_duplicates(0);
+std::atomic<long> g_message_ids(1);
+std::atomic<long> g_send_records(1);
+std::mutex g_replay_mutex;
+std::map<std::string, std::string> g_replies; // Idempotency-Key -> first successful response
+
+// Fate of a send record, decided when it is created
+struct SendRecord {
+    std::chrono::steady_clock::time_point settles;
+    bool delivered;
+};
+std::mutex g_send_record_mutex;
+std::map<long, SendRecord> g_send_record_fates;
+
+// Minimal JSON syntax checker, enough to reject malformed payloads
+class JsonValidator {
+public:
+    explicit JsonValidator(const std::string& text) : s(text), pos(0) {}
+
+    bool validate() {
+        skipSpace();
+        if (!value(0)) return false;
+        skipSpace();
+        return pos == s.size();
+    }
+
+private:
+    const std::string& s;
+    size_t pos;
+
+    void skipSpace() {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) pos++;
+    }
+
+    bool literal(const char* word) {
+        size_t len = strlen(word);
+        if (s.compare(pos, len, word) != 0) return false;
+        pos += len;
+        return true;
+    }
+
+    bool string() {
+        if (pos >= s.size() || s[pos] != '"') return false;
+        pos++;
+        while (pos < s.size()) {
+            unsigned char c = s[pos++];
+            if (c == '"') return true;
+            if (c < 0x20) return false;
+            if (c == '\\') {
+                if (pos >= s.size()) return false;
+                char e = s[pos++];
+                if (e == 'u') {
+                    for (int i = 0; i < 4; i++) {
+                        if (pos >= s.size() || !isxdigit(static_cast<unsigned char>(s[pos++]))) return false;
+                    }
+                } else if (!strchr("\"\\/bfnrt", e)) {
+                    return false;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool number() {
+        size_t start = pos;
+        if (pos < s.size() && s[pos] == '-') pos++;
+        while (pos < s.size() && (isdigit(static_cast<unsigned char>(s[pos])) || strchr(".eE+-", s[pos]))) pos++;
+        return pos > start;
+    }
+
+    bool value(int depth) {
+        if (depth > 32 || pos >= s.size()) return false;
+        char c = s[pos];
+        if (c == '{') return container(depth, '}', true);
+        if (c == '[') return container(depth, ']', false);
+        if (c == '"') return string();
+        if (c == 't') return literal("true");
+        if (c == 'f') return literal("false");
+        if (c == 'n') return literal("null");
+        return number();
+    }
+
+    bool container(int depth, char close, bool object) {
+        pos++;
+        skipSpace();
+        if (pos < s.size() && s[pos] == close) {
+            pos++;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            if (object) {
+                if (!string()) return false;
+                skipSpace();
+                if (pos >= s.size() || s[pos++] != ':') return false;
+                skipSpace();
+            }
+            if (!value(depth + 1)) return false;
+            skipSpace();
+            if (pos >= s.size()) return false;
+            char c = s[pos++];
+            if (c == close) return true;
+            if (c != ',') return false;
+        }
+    }
+};
+
+// Value of a header, from the lowercased header block
+std::string headerValue(const std::string& headers, const std::string& name) {
+    size_t pos = headers.find("\r\n" + name + ":");
+    if (pos == std::string::npos) return "";
+    pos += name.size() + 3;
+    size_t end = headers.find("\r\n", pos);
+    std::string value = headers.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t") + 1);
+    return value;
+}
+
+// Extract the sequence number the mock modem and push_bench embed as "[seq N]"
+std::string extractSeq(const std::string& body) {
+    size_t pos = body.find("[seq ");
+    if (pos == std::string::npos) return "";
+    size_t end = body.find(']', pos);
+    return end == std::string::npos ? "" : body.substr(pos + 5, end - pos - 5);
+}
+
+// Entries of a flat JSON array member such as "uids":["UID_a","UID_b"], unquoted
+std::vector<std::string> arrayMember(const std::string& body, const std::string& name) {
+    std::vector<std::string> entries;
+    size_t pos = body.find("\"" + name + "\":[");
+    if (pos == std::string::npos) return entries;
+    pos += name.size() + 4;
+    size_t end = body.find(']', pos);
+    if (end == std::string::npos) return entries;
+
+    std::string list = body.substr(pos, end - pos);
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        std::string entry = list.substr(start, comma - start);
+        if (entry.size() >= 2 && entry.front() == '"') entry = entry.substr(1, entry.size() - 2);
+        if (!entry.empty()) entries.push_back(entry);
+        start = comma + 1;
+    }
+    return entries;
+}
+
+void record(long long arrival_us, const std::string& seq, int status, size_t bytes) {
+    if (!g_record) return;
+    std::lock_guard<std::mutex> lock(g_record_mutex);
+    fprintf(g_record, "%lld,%s,%d,%zu\n", arrival_us, seq.c_str(), status, bytes);
+    fflush(g_record);
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string httpResponse(int status, const char* reason, const std::string& body) {
+    return "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+           "Content-Type: application/json;charset=UTF-8\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: keep-alive\r\n\r\n" + body;
+}
+
+std::string handleRequest(const std::string& body, std::mt19937& rng, int& status) {
+    if (!JsonValidator(body).validate() ||
+        body.find("\"appToken\"") == std::string::npos ||
+        body.find("\"content\"") == std::string::npos ||
+        (body.find("\"uids\"") == std::string::npos && body.find("\"topicIds\"") == std::string::npos)) {
+        g_invalid++;
+        status = 400;
+        return httpResponse(status, "Bad Request",
+                            "{\"code\":1001,\"msg\":\"invalid payload\",\"data\":null,\"success\":false}");
+    }
+
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    double r = roll(rng);
+    if (r < g_options.throttle_rate) {
+        status = 429;
+        return httpResponse(status, "Too Many Requests",
+                            "{\"code\":1001,\"msg\":\"发送太频繁\",\"data\":null,\"success\":false}");
+    }
+    if (r < g_options.throttle_rate + g_options.error_rate) {
+        status = 500;
+        return httpResponse(status, "Internal Server Error",
+                            "{\"code\":1002,\"msg\":\"injected error\",\"data\":null,\"success\":false}");
+    }
+
+    // One message with a send record per recipient, like WxPusher
+    long id = g_message_ids++;
+    std::string data;
+    auto addRecord = [&](const std::string& uid, const std::string& topic_id) {
+        long record_id = g_send_records++;
+        {
+            std::lock_guard<std::mutex> lock(g_send_record_mutex);
+            g_send_record_fates[record_id] = SendRecord{
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(g_options.delivery_ms),
+                roll(rng) >= g_options.undelivered_rate};
+        }
+        data += (data.empty() ? "{" : ",{") + std::string("\"uid\":") + (uid.empty() ? "null" : "\"" + uid + "\"") +
+                ",\"topicId\":" + (topic_id.empty() ? "null" : topic_id) +
+                ",\"messageId\":" + std::to_string(id) + ",\"messageContentId\":" + std::to_string(id) +
+                ",\"sendRecordId\":" + std::to_string(record_id) + ",\"code\":1000,\"status\":\"创建发送任务成功\"}";
+    };
+    for (const auto& uid : arrayMember(body, "uids")) addRecord(uid, "");
+    for (const auto& topic_id : arrayMember(body, "topicIds")) addRecord("", topic_id);
+
+    status = 200;
+    return httpResponse(status, "OK",
+        "{\"code\":1000,\"msg\":\"处理成功\",\"data\":[" + data + "],\"success\":true}");
+}
+
+// Send record query, GET /api/send/query/{sendRecordId}: the record's status
+// reads 发送中 while on its way, then 发送成功 or 发送失败
+std::string handleRecordQuery(const std::string& record_id, int& status) {
+    long id = atol(record_id.c_str());
+    std::string state;
+    {
+        std::lock_guard<std::mutex> lock(g_send_record_mutex);
+        auto it = g_send_record_fates.find(id);
+        if (it != g_send_record_fates.end()) {
+            state = std::chrono::steady_clock::now() < it->second.settles ? "发送中"
+                  : it->second.delivered ? "发送成功" : "发送失败";
+        }
+    }
+    if (state.empty()) {
+        status = 200;
+        return httpResponse(status, "OK", "{\"code\":1001,\"msg\":\"发送记录不存在\",\"data\":null,\"success\":false}");
+    }
+    status = 200;
+    return httpResponse(status, "OK",
+        "{\"code\":1000,\"msg\":\"处理成功\",\"data\":{\"sendRecordId\":" + std::to_string(id) +
+        ",\"status\":\"" + state + "\"},\"success\":true}");
+}
+
+void serveConnection(int fd) {
+    std::mt19937 rng(std::random_device{}());
+    std::string buffer;
+    char chunk[8192];
+
+    while (true) {
+        // Read until the end of the headers
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        auto arrival = std::chrono::system_clock::now();
+
+        size_t content_length = 0;
+        std::string headers = buffer.substr(0, header_end);
+        for (char& c : headers) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        size_t cl = headers.find("content-length:");
+        if (cl != std::string::npos) {
+            content_length = strtoul(headers.c_str() + cl + 15, nullptr, 10);
+        }
+
+        size_t total = header_end + 4 + content_length;
+        while (buffer.size() < total) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+
+        std::string idempotency_key = headerValue(headers, "idempotency-key");
+        std::string body = buffer.substr(header_end + 4, content_length);
+        bool head = buffer.compare(0, 5, "HEAD ") == 0;
+        bool record_query = buffer.compare(0, 20, "GET /api/send/query/") == 0;
+        std::string record_id = record_query ? buffer.substr(20, buffer.find(' ', 20) - 20) : "";
+        buffer.erase(0, total);
+
+        // Send record queries are answered at once and not recorded
+        if (record_query) {
+            int status = 0;
+            if (!sendAll(fd, handleRecordQuery(record_id, status))) {
+                close(fd);
+                return;
+            }
+            continue;
+        }
+
+        // Connection warm-up probes are answered without touching the stats
+        if (head || body.empty()) {
+            std::string response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+            if (!sendAll(fd, response)) {
+                close(fd);
+                return;
+            }
+            continue;
+        }
+        g_requests++;
+
+        int delay = g_options.latency_ms;
+        if (g_options.jitter_ms > 0) {
+            delay += std::uniform_int_distribution<int>(0, g_options.jitter_ms)(rng);
+        }
+        if (g_options.stall_rate > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < g_options.stall_rate) {
+            delay += g_options.stall_ms;
+        }
+        if (delay > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        }
+
+        int status = 0;
+        std::string response;
+        {
+            std::lock_guard<std::mutex> lock(g_replay_mutex);
+            auto it = idempotency_key.empty() ? g_replies.end() : g_replies.find(idempotency_key);
+            if (it != g_replies.end()) {
+                // Recorded as 208 so replays stand out, the response is the original
+                g_duplicates++;
+                status = 208;
+                response = it->second;
+            }
+        }
+        if (response.empty()) {
+            response = handleRequest(body, rng, status);
+            if (status == 200 && !idempotency_key.empty()) {
+                std::lock_guard<std::mutex> lock(g_replay_mutex);
+                g_replies.emplace(idempotency_key, response);
+            }
+        }
+        long long arrival_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            arrival.time_since_epoch()).count();
+        record(arrival_us, extractSeq(body), status, body.size());
+
+        if (!sendAll(fd, response)) {
+            close(fd);
+            return;
+        }
+    }
+}
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --port N            listen port on 127.0.0.1 (default 8088)\n"
+              << "  --latency-ms MS     delay before each response (default 0)\n"
+              << "  --jitter-ms MS      additional random delay up to MS (default 0)\n"
+              << "  --error-rate F      fraction of requests answered with HTTP 500 (default 0)\n"
+              << "  --throttle-rate F   fraction of requests answered with HTTP 429 (default 0)\n"
+              << "  --stall-rate F      fraction of requests delayed by --stall-ms more (default 0)\n"
+              << "  --stall-ms MS       extra delay of a stalled request (default 5000)\n"
+              << "  --delivery-ms MS    time until a send record is delivered or fails (default 1000)\n"
+              << "  --undelivered-rate F  fraction of send records that fail to deliver (default 0)\n"
+              << "  --record FILE       append arrival_us,seq,status,bytes per request" << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+
+        if (arg == "--port") g_options.port = atoi(value.c_str());
+        else if (arg == "--latency-ms") g_options.latency_ms = atoi(value.c_str());
+        else if (arg == "--jitter-ms") g_options.jitter_ms = atoi(value.c_str());
+        else if (arg == "--error-rate") g_options.error_rate = atof(value.c_str());
+        else if (arg == "--throttle-rate") g_options.throttle_rate = atof(value.c_str());
+        else if (arg == "--stall-rate") g_options.stall_rate = atof(value.c_str());
+        else if (arg == "--stall-ms") g_options.stall_ms = atoi(value.c_str());
+        else if (arg == "--delivery-ms") g_options.delivery_ms = atoi(value.c_str());
+        else if (arg == "--undelivered-rate") g_options.undelivered_rate = atof(value.c_str());
+        else if (arg == "--record") g_options.record_path = value;
+        else return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!g_options.record_path.empty()) {
+        g_record = fopen(g_options.record_path.c_str(), "a");
+        if (!g_record) {
+            std::cerr << "Cannot open " << g_options.record_path << std::endl;
+            return 1;
+        }
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(g_options.port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+        std::cerr << "Cannot listen on port " << g_options.port << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::cerr << "WxPusher stub listening on http://127.0.0.1:" << g_options.port << "/api/send/message" << std::endl;
+
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serveConnection, fd).detach();
+    }
+}